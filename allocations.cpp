@@ -0,0 +1,190 @@
+#include "allocations.h"
+
+#include <algorithm>
+#include <new>
+
+#if defined(COUNT_ALLOCATIONS)
+
+static thread_local size_t thread_allocation_count = 0;
+
+// Every replaceable allocation function counts, the nothrow ones included,
+// so containers using them are not missed. The sized and aligned forms only
+// exist when the language standard has them.
+
+void*
+operator new(std::size_t size)
+{
+    thread_allocation_count++;
+    void* pointer = std::malloc(size == 0 ? 1 : size);
+    if (!pointer) throw std::bad_alloc();
+    return pointer;
+}
+
+void*
+operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void*
+operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    thread_allocation_count++;
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+void*
+operator new[](std::size_t size, const std::nothrow_t& tag) noexcept
+{
+    return operator new(size, tag);
+}
+
+void
+operator delete(void* pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void
+operator delete[](void* pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void
+operator delete(void* pointer, const std::nothrow_t&) noexcept
+{
+    std::free(pointer);
+}
+
+void
+operator delete[](void* pointer, const std::nothrow_t&) noexcept
+{
+    std::free(pointer);
+}
+
+#if defined(__cpp_sized_deallocation)
+
+void
+operator delete(void* pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+void
+operator delete[](void* pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+#endif
+
+#if defined(__cpp_aligned_new)
+
+void*
+operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    thread_allocation_count++;
+    void* pointer = NULL;
+    const size_t alignment_prime = std::max(sizeof(void*), static_cast<size_t>(alignment));
+    if (posix_memalign(&pointer, alignment_prime, size == 0 ? 1 : size) != 0) return NULL;
+    return pointer;
+}
+
+void*
+operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t& tag) noexcept
+{
+    return operator new(size, alignment, tag);
+}
+
+void*
+operator new(std::size_t size, std::align_val_t alignment)
+{
+    void* pointer = operator new(size, alignment, std::nothrow);
+    if (!pointer) throw std::bad_alloc();
+    return pointer;
+}
+
+void*
+operator new[](std::size_t size, std::align_val_t alignment)
+{
+    return operator new(size, alignment);
+}
+
+void
+operator delete(void* pointer, std::align_val_t) noexcept
+{
+    std::free(pointer);
+}
+
+void
+operator delete[](void* pointer, std::align_val_t) noexcept
+{
+    std::free(pointer);
+}
+
+void
+operator delete(void* pointer, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    std::free(pointer);
+}
+
+void
+operator delete[](void* pointer, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    std::free(pointer);
+}
+
+void
+operator delete(void* pointer, std::size_t, std::align_val_t) noexcept
+{
+    std::free(pointer);
+}
+
+void
+operator delete[](void* pointer, std::size_t, std::align_val_t) noexcept
+{
+    std::free(pointer);
+}
+
+#endif
+
+bool
+is_counting_allocations()
+{
+    return true;
+}
+
+size_t
+get_thread_allocation_count()
+{
+    return thread_allocation_count;
+}
+
+#else
+
+bool
+is_counting_allocations()
+{
+    return false;
+}
+
+size_t
+get_thread_allocation_count()
+{
+    return 0;
+}
+
+#endif
+
+AllocationCounter::AllocationCounter() :
+    start_count(get_thread_allocation_count())
+{
+}
+
+size_t
+AllocationCounter::get_count() const
+{
+    return get_thread_allocation_count() - start_count;
+}
+
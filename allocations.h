@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdlib>
+
+// Per thread heap allocation accounting. The global operator new hooks are
+// only compiled in when configured with COUNT_ALLOCATIONS, otherwise every
+// count is zero.
+
+bool
+is_counting_allocations();
+
+size_t
+get_thread_allocation_count();
+
+struct AllocationCounter
+{
+    AllocationCounter();
+
+    size_t
+    get_count() const;
+
+private:
+
+    size_t start_count;
+};
+
@@ -0,0 +1,405 @@
+#include "alphabeta.h"
+
+#include "policy.h"
+#include <algorithm>
+#include <boost/functional/hash.hpp>
+
+static const int max_value = 1 << 29;
+static const int aspiration_window = 50; // five gold
+
+TranspositionTable::TranspositionTable(const size_t& max_bytes) :
+    slots(),
+    mask(0)
+{
+    size_t count = 1;
+    while (2*count*sizeof(Slot) <= max_bytes) count *= 2;
+    slots.reset(new Slot[count]);
+    mask = count-1;
+    clear();
+}
+
+bool
+TranspositionTable::probe(const Hash& hash, TranspositionEntry& entry) const
+{
+    const Slot& slot = slots[hash & mask];
+    const uint64_t data = slot.data.load(std::memory_order_relaxed);
+    const uint64_t check = slot.check.load(std::memory_order_relaxed);
+    if ((check ^ data) != hash || data == 0) return false;
+
+    entry.value = static_cast<int32_t>(data & 0xffffffff);
+    entry.depth = (data >> 32) & 0xff;
+    entry.bound = static_cast<Bound>((data >> 40) & 0xff);
+    entry.direction = static_cast<Direction>((data >> 48) & 0xff);
+    return true;
+}
+
+void
+TranspositionTable::store(const Hash& hash, const TranspositionEntry& entry)
+{
+    assert( entry.depth >= 0 && entry.depth < 256 );
+    const uint64_t data = static_cast<uint32_t>(entry.value) |
+        static_cast<uint64_t>(entry.depth) << 32 |
+        static_cast<uint64_t>(entry.bound) << 40 |
+        static_cast<uint64_t>(entry.direction) << 48 |
+        static_cast<uint64_t>(1) << 56; // never 0, which marks empty slots
+
+    Slot& slot = slots[hash & mask];
+    slot.data.store(data, std::memory_order_relaxed);
+    slot.check.store(hash ^ data, std::memory_order_relaxed);
+}
+
+void
+TranspositionTable::clear()
+{
+    for (size_t kk=0; kk<=mask; kk++)
+    {
+        slots[kk].data.store(0, std::memory_order_relaxed);
+        slots[kk].check.store(0, std::memory_order_relaxed);
+    }
+}
+
+size_t
+TranspositionTable::get_byte_count() const
+{
+    return (mask+1)*sizeof(Slot);
+}
+
+AlphaBetaSearch::AlphaBetaSearch(const Grid& grid, const SymmetryGroup& symmetries, TranspositionTable& table, const bool& max_n, const DefaultEvaluator* evaluator) :
+    best_direction(STAY),
+    best_value(0),
+    completed_depth(0),
+    node_count(0),
+    table_hit_count(0),
+    grid(grid),
+    symmetries(symmetries),
+    table(table),
+    max_n(max_n),
+    evaluator(evaluator),
+    token(NULL),
+    root_hero_index(0),
+    root_turns_left(0),
+    aborted(false),
+    killers(),
+    histories(5*grid.cells.size(), 0)
+{
+}
+
+Utilities
+AlphaBetaSearch::get_leaf_utilities(const State& state, const int& turns_left) const
+{
+    // finished games score exactly
+    if (evaluator == NULL || turns_left <= 0) return get_utilities(state, turns_left);
+    return evaluator->get_utilities(state, turns_left);
+}
+
+bool
+AlphaBetaSearch::is_aborted()
+{
+    if (!aborted && (node_count & 255) == 0) aborted = token->is_cancelled();
+    return aborted;
+}
+
+Hash
+AlphaBetaSearch::get_table_key(const State& state, const int& turns_left, int& symmetry_index) const
+{
+    // symmetric states share their entry, the utilities depend on the turns
+    // left and paranoid values on where the root hero is in the turn order
+    const CanonicalKey key = symmetries.get_canonical_key(state);
+    symmetry_index = key.symmetry_index;
+    Hash hash = key.hash;
+    boost::hash_combine(hash, turns_left);
+    if (!max_n) boost::hash_combine(hash, (root_hero_index-state.next_hero_index+4)%4);
+    return hash;
+}
+
+int
+AlphaBetaSearch::order_moves(const State& state, const int& ply, const Direction& table_direction, Directions& directions) const
+{
+    const PositionIndex index = grid.get_index(state.heroes[state.next_hero_index].position);
+    const LegalDirections legal = get_legal_directions(grid, index);
+
+    boost::array<int, 5> scores;
+    for (int kk=0; kk<legal.size; kk++)
+    {
+        const Direction direction = legal.directions[kk];
+        int score = histories[5*index+direction];
+        if (direction == killers[ply][1]) score = 1 << 28;
+        if (direction == killers[ply][0]) score = 1 << 29;
+        if (direction == table_direction) score = 1 << 30;
+
+        // insertion sort by decreasing score
+        int ll = kk;
+        for (; ll>0 && scores[ll-1] < score; ll--)
+        {
+            scores[ll] = scores[ll-1];
+            directions[ll] = directions[ll-1];
+        }
+        scores[ll] = score;
+        directions[ll] = direction;
+    }
+
+    return legal.size;
+}
+
+void
+AlphaBetaSearch::record_cutoff(const State& state, const int& ply, const Direction& direction, const int& depth)
+{
+    if (killers[ply][0] != direction)
+    {
+        killers[ply][1] = killers[ply][0];
+        killers[ply][0] = direction;
+    }
+
+    const PositionIndex index = grid.get_index(state.heroes[state.next_hero_index].position);
+    histories[5*index+direction] += depth*depth;
+}
+
+int
+AlphaBetaSearch::search(const State& state, const int& depth, const int& ply, int alpha, int beta)
+{
+    node_count++;
+    if (is_aborted()) return 0;
+
+    const int turns_left = root_turns_left-ply;
+    if (depth <= 0 || turns_left <= 0) return get_leaf_utilities(state, turns_left)[root_hero_index];
+
+    int symmetry_index = 0;
+    const Hash hash = get_table_key(state, turns_left, symmetry_index);
+
+    TranspositionEntry entry;
+    Direction table_direction = no_direction;
+    if (table.probe(hash, entry))
+    {
+        table_hit_count++;
+        table_direction = symmetries.from_canonical(entry.direction, symmetry_index);
+        if (ply > 0 && entry.depth >= depth)
+        {
+            if (entry.bound == BOUND_EXACT) return entry.value;
+            if (entry.bound == BOUND_LOWER && entry.value >= beta) return entry.value;
+            if (entry.bound == BOUND_UPPER && entry.value <= alpha) return entry.value;
+        }
+    }
+
+    Directions directions;
+    const int count = order_moves(state, ply, table_direction, directions);
+
+    const bool is_max = state.next_hero_index == root_hero_index;
+    const int alpha_start = alpha;
+    const int beta_start = beta;
+    int best = is_max ? -max_value : max_value;
+    Direction best_move = directions[0];
+    for (int kk=0; kk<count; kk++)
+    {
+        State state_prime(state);
+        state_prime.update(directions[kk]);
+        const int value = search(state_prime, depth-1, ply+1, alpha, beta);
+        if (aborted) return 0;
+
+        if (is_max ? value > best : value < best)
+        {
+            best = value;
+            best_move = directions[kk];
+        }
+        if (is_max) alpha = std::max(alpha, value);
+        else beta = std::min(beta, value);
+        if (alpha >= beta)
+        {
+            record_cutoff(state, ply, directions[kk], depth);
+            break;
+        }
+    }
+
+    entry.value = best;
+    entry.depth = depth;
+    entry.bound = best <= alpha_start ? BOUND_UPPER : best >= beta_start ? BOUND_LOWER : BOUND_EXACT;
+    entry.direction = symmetries.to_canonical(best_move, symmetry_index);
+    table.store(hash, entry);
+
+    if (ply == 0) best_direction = best_move;
+    return best;
+}
+
+Utilities
+AlphaBetaSearch::search_max_n(const State& state, const int& depth, const int& ply)
+{
+    node_count++;
+    const int turns_left = root_turns_left-ply;
+    if (is_aborted() || depth <= 0 || turns_left <= 0) return get_leaf_utilities(state, turns_left);
+
+    int symmetry_index = 0;
+    const Hash hash = get_table_key(state, turns_left, symmetry_index);
+
+    TranspositionEntry entry;
+    Direction table_direction = no_direction;
+    if (table.probe(hash, entry))
+    {
+        table_hit_count++;
+        table_direction = symmetries.from_canonical(entry.direction, symmetry_index);
+    }
+
+    Directions directions;
+    const int count = order_moves(state, ply, table_direction, directions);
+
+    const int hero_index = state.next_hero_index;
+    Utilities best;
+    Direction best_move = directions[0];
+    for (int kk=0; kk<count; kk++)
+    {
+        State state_prime(state);
+        state_prime.update(directions[kk]);
+        const Utilities utilities = search_max_n(state_prime, depth-1, ply+1);
+        if (aborted) return utilities;
+
+        if (kk == 0 || utilities[hero_index] > best[hero_index])
+        {
+            best = utilities;
+            best_move = directions[kk];
+        }
+    }
+    record_cutoff(state, ply, best_move, depth);
+
+    entry.value = best[hero_index];
+    entry.depth = depth;
+    entry.bound = BOUND_NONE;
+    entry.direction = symmetries.to_canonical(best_move, symmetry_index);
+    table.store(hash, entry);
+
+    if (ply == 0) best_direction = best_move;
+    return best;
+}
+
+void
+AlphaBetaSearch::run(const State& state, const int& turns_left, const CancellationToken& token, const int& start_depth, const int& max_depth)
+{
+    this->token = &token;
+    root_hero_index = state.next_hero_index;
+    root_turns_left = turns_left;
+    aborted = false;
+    best_direction = STAY;
+    best_value = 0;
+    completed_depth = 0;
+    node_count = 0;
+    table_hit_count = 0;
+    for (int ply=0; ply<max_ply; ply++)
+        std::fill(killers[ply].begin(), killers[ply].end(), no_direction);
+    for (Histories::iterator hi=histories.begin(), hie=histories.end(); hi!=hie; hi++)
+        *hi /= 2; // older cutoffs matter less
+
+    const int last_depth = std::min(std::min(max_depth, turns_left), max_ply-1);
+    Direction direction = STAY;
+    for (int depth=start_depth; depth<=last_depth && !aborted; depth++)
+    {
+        int value = 0;
+        if (max_n)
+        {
+            value = search_max_n(state, depth, 0)[root_hero_index];
+        }
+        else
+        {
+            // widen the window on the side that failed until the value fits
+            int window = aspiration_window;
+            int alpha = completed_depth > 0 ? best_value-window : -max_value;
+            int beta = completed_depth > 0 ? best_value+window : max_value;
+            while (true)
+            {
+                value = search(state, depth, 0, alpha, beta);
+                if (aborted) break;
+                window *= 4;
+                if (value <= alpha) alpha = std::max(-max_value, value-window);
+                else if (value >= beta) beta = std::min(max_value, value+window);
+                else break;
+            }
+        }
+        if (aborted) break;
+
+        direction = best_direction;
+        best_value = value;
+        completed_depth = depth;
+    }
+
+    best_direction = direction;
+}
+
+static
+int
+get_minimax_value(const Grid& grid, const State& state, const int& depth, const int& turns_left, const int& hero_index, int& node_count)
+{
+    node_count++;
+    if (depth == 0) return get_utilities(state, turns_left)[hero_index];
+
+    const bool is_max = state.next_hero_index == hero_index;
+    const LegalDirections legal = get_legal_directions(grid, grid.get_index(state.heroes[state.next_hero_index].position));
+    int best = is_max ? -max_value : max_value;
+    for (int kk=0; kk<legal.size; kk++)
+    {
+        State state_prime(state);
+        state_prime.update(legal.directions[kk]);
+        const int value = get_minimax_value(grid, state_prime, depth-1, turns_left-1, hero_index, node_count);
+        best = is_max ? std::max(best, value) : std::min(best, value);
+    }
+    return best;
+}
+
+void
+test_alphabeta()
+{
+    std::cout << "Doing alpha-beta search test...\n";
+
+    const Tiles tiles = make_benchmark_tiles(18);
+    const PTree root = make_initial_state_json(tiles, 1200);
+    const Tiles background_tiles = neutralize_tiles(tiles);
+    const HashedPair<Tiles> hashed_background_tiles(background_tiles);
+    const Grid grid(background_tiles);
+    const State state(root, hashed_background_tiles, grid);
+    const SymmetryGroup symmetries(grid, state);
+
+    // lock free slots round trip
+    {
+        TranspositionTable table(1024);
+        assert( table.get_byte_count() == 1024 );
+        TranspositionEntry entry = {-1234, 7, BOUND_LOWER, SOUTH};
+        table.store(42, entry);
+        TranspositionEntry entry_prime;
+        assert( table.probe(42, entry_prime) );
+        assert( entry_prime.value == -1234 && entry_prime.depth == 7 && entry_prime.bound == BOUND_LOWER && entry_prime.direction == SOUTH );
+        assert( !table.probe(42+64, entry_prime) );
+        table.clear();
+        assert( !table.probe(42, entry_prime) );
+    }
+
+    // the pruned searches agree with plain minimax
+    {
+        TranspositionTable table(16*1024*1024);
+        CancellationToken token;
+        AlphaBetaSearch search(grid, symmetries, table, false);
+        search.run(state, 1200, token, 1, 5);
+        assert( search.completed_depth == 5 );
+
+        int minimax_count = 0;
+        const int minimax_value = get_minimax_value(grid, state, 5, 1200, state.next_hero_index, minimax_count);
+        assert( search.best_value == minimax_value );
+        std::cout << "depth 5 " << search.node_count << " nodes against " << minimax_count << " for minimax" << std::endl;
+
+        AlphaBetaSearch max_n_search(grid, symmetries, table, true);
+        max_n_search.run(state, 1200, token, 1, 4);
+        assert( max_n_search.completed_depth == 4 );
+    }
+
+    // deepen until the deadline, which is met to the node check
+    for (int max_n=0; max_n<2; max_n++)
+    {
+        TranspositionTable table(64*1024*1024);
+        AlphaBetaSearch search(grid, symmetries, table, max_n);
+        CancellationToken token;
+        const double start_time = get_double_time();
+        token.set_deadline(start_time+.2);
+        search.run(state, 1200, token, 1, 1000);
+        const double end_time = get_double_time();
+        assert( search.completed_depth > 0 );
+        std::cout << (max_n ? "max-n " : "paranoid ") << "depth " << search.completed_depth << " " << static_cast<int>(1e-3*search.node_count/(end_time-start_time)) << "knode/s " << 1e6*(end_time-start_time-.2) << "us past the deadline" << std::endl;
+        assert( end_time-start_time < .2+.01 );
+    }
+
+    std::cout << "...done!\n";
+}
+
@@ -0,0 +1,130 @@
+#pragma once
+
+#include "evaluation.h"
+#include "symmetry.h"
+#include "scheduler.h"
+#include <atomic>
+#include <vector>
+#include <boost/scoped_array.hpp>
+
+enum Bound
+{
+    BOUND_NONE, // move ordering only
+    BOUND_EXACT,
+    BOUND_LOWER,
+    BOUND_UPPER,
+};
+
+// Table or killer move not known yet, never a legal direction.
+static const Direction no_direction = static_cast<Direction>(5);
+
+struct TranspositionEntry
+{
+    int value;
+    int depth; // plies searched below the entry
+    Bound bound;
+    Direction direction;
+};
+
+// Fixed size table shared by every search thread. Slots are written without
+// locks: the key is stored xored with the packed entry, so a slot torn by two
+// concurrent writes reads as a miss. Always replaces.
+struct TranspositionTable
+{
+    TranspositionTable(const size_t& max_bytes);
+
+    bool
+    probe(const Hash& hash, TranspositionEntry& entry) const;
+
+    void
+    store(const Hash& hash, const TranspositionEntry& entry);
+
+    void
+    clear();
+
+    size_t
+    get_byte_count() const;
+
+private:
+
+    struct Slot
+    {
+        std::atomic<uint64_t> check; // hash xor data
+        std::atomic<uint64_t> data;
+    };
+
+    TranspositionTable(const TranspositionTable& table); // no copy
+
+    boost::scoped_array<Slot> slots;
+    size_t mask;
+};
+
+// Iterative deepening over single hero moves. In paranoid mode the hero to
+// play at the root maximizes its utility and the three others minimize it,
+// with alpha-beta, aspiration windows around the previous iteration value,
+// transposition table, killer and history move ordering. In max-n mode every
+// hero maximizes its own utility and the table only orders moves. Several
+// searches sharing one table run in parallel (lazy SMP), each starting at a
+// different depth so they do not all search the same tree. Leaves are scored
+// by get_utilities, or by evaluator when there is one.
+struct AlphaBetaSearch
+{
+    AlphaBetaSearch(const Grid& grid, const SymmetryGroup& symmetries, TranspositionTable& table, const bool& max_n, const DefaultEvaluator* evaluator=NULL);
+
+    /// Deepen until the token is cancelled or max_depth plies were searched.
+    void
+    run(const State& state, const int& turns_left, const CancellationToken& token, const int& start_depth, const int& max_depth);
+
+    // result of the deepest search, complete or not
+    Direction best_direction;
+    int best_value; // root hero utility
+    int completed_depth;
+    uint64_t node_count;
+    uint64_t table_hit_count;
+
+private:
+
+    static const int max_ply = 64;
+
+    typedef boost::array<Direction, 2> Killers;
+    typedef boost::array<Killers, max_ply> PlyKillers;
+    typedef std::vector<int> Histories;
+    typedef boost::array<Direction, 5> Directions;
+
+    int
+    search(const State& state, const int& depth, const int& ply, int alpha, int beta);
+
+    Utilities
+    search_max_n(const State& state, const int& depth, const int& ply);
+
+    int
+    order_moves(const State& state, const int& ply, const Direction& table_direction, Directions& directions) const;
+
+    void
+    record_cutoff(const State& state, const int& ply, const Direction& direction, const int& depth);
+
+    Utilities
+    get_leaf_utilities(const State& state, const int& turns_left) const;
+
+    bool
+    is_aborted();
+
+    Hash
+    get_table_key(const State& state, const int& turns_left, int& symmetry_index) const;
+
+    const Grid& grid;
+    const SymmetryGroup& symmetries;
+    TranspositionTable& table;
+    const bool max_n;
+    const DefaultEvaluator* evaluator;
+    const CancellationToken* token;
+    int root_hero_index;
+    int root_turns_left;
+    bool aborted;
+    PlyKillers killers;
+    Histories histories; // cutoff score of each cell and direction
+};
+
+void
+test_alphabeta();
+
@@ -0,0 +1,62 @@
+#include "alphabeta_bot.h"
+
+#include "logger.h"
+#include <boost/bind/bind.hpp>
+
+BotTables::BotTables(const Options& opt) :
+    table(static_cast<size_t>(opt.search_memory)*1024*1024)
+{
+}
+
+Bot::Bot(const Options& opt, const Game& game, Rng& rng, BotTables& tables) :
+    symmetries(game.background_grid, game.state, opt.canonical_keys),
+    evaluator(opt.evaluation_weights.empty() ? NULL : new DefaultEvaluator(make_default_evaluator(game.background_grid, opt.evaluation_weights))),
+    table(tables.table),
+    searches(),
+    search_state(NULL),
+    search_turns_left(0)
+{
+    const int thread_count = get_scheduler().get_worker_count();
+    for (int kk=0; kk<thread_count; kk++)
+        searches.push_back(new AlphaBetaSearch(game.background_grid, symmetries, table, opt.max_n, evaluator.get()));
+
+    LogLine(LOG_INFO) << (opt.max_n ? "max-n" : "paranoid") << " search table " << table.get_byte_count()/(1024*1024) << "MB " << symmetries.symmetries.size() << " symmetries" << (evaluator ? " weights " + opt.evaluation_weights : "");
+}
+
+void
+Bot::search(const int& search_index, const CancellationToken& token)
+{
+    // helpers start one or two plies deeper to spread over the table
+    searches[search_index].run(*search_state, search_turns_left, token, 1+search_index%3, 1000);
+}
+
+Direction
+Bot::get_move(const Game& game, const CancellationToken& token)
+{
+    const double start_time = get_double_time();
+
+    search_state = &game.state;
+    search_turns_left = game.turn_max - game.turn;
+    get_scheduler().parallel_for(searches.size(), boost::bind(&Bot::search, this, boost::placeholders::_1, boost::cref(token)));
+    search_state = NULL;
+
+    // deepest completed iteration, the main search on ties
+    uint64_t node_count = 0;
+    const AlphaBetaSearch* best = &searches[0];
+    for (Searches::const_iterator si=searches.begin(), sie=searches.end(); si!=sie; si++)
+    {
+        node_count += si->node_count;
+        if (si->completed_depth > best->completed_depth) best = &*si;
+    }
+
+    const double end_time = get_double_time();
+    LogLine(LOG_INFO) << "alpha-beta depth " << best->completed_depth << " value " << best->best_value << " " << node_count << " nodes " << static_cast<int>(1e-3*node_count/(end_time-start_time)) << "knode/s " << clock_it(end_time-start_time) << " (" << clock_it(end_time-token.get_deadline()) << " past the deadline)";
+
+    return best->best_direction;
+}
+
+void
+Bot::advance_game(Game& game, const Direction& direction)
+{
+}
+
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "game.h"
+#include "alphabeta.h"
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/scoped_ptr.hpp>
+
+// Transposition table of --search-memory MB, made once and kept across
+// games. Keys hold the whole state, board included.
+struct BotTables
+{
+    BotTables(const Options& opt);
+
+    TranspositionTable table;
+
+private:
+
+    BotTables(const BotTables& tables); // no copy
+};
+
+// Iterative deepening paranoid alpha-beta, or max-n with --max-n, over
+// single hero moves. Every worker deepens its own search on a shared
+// transposition table and the deepest completed one answers.
+struct Bot
+{
+    Bot(const Options& opt, const Game& game, Rng& rng, BotTables& tables);
+
+    Direction
+    get_move(const Game& game, const CancellationToken& token); // token may be cut during the search
+
+    void
+    advance_game(Game& game, const Direction& direction);
+
+private:
+
+    typedef boost::ptr_vector<AlphaBetaSearch> Searches;
+
+    void
+    search(const int& search_index, const CancellationToken& token);
+
+    const SymmetryGroup symmetries; // trivial unless --canonical-keys
+    boost::scoped_ptr<const DefaultEvaluator> evaluator; // with --evaluation-weights
+    TranspositionTable& table; // of the bot tables
+    Searches searches; // one per worker
+    const State* search_state;
+    int search_turns_left;
+
+};
+
@@ -0,0 +1,366 @@
+#include "bitboard.h"
+
+#include "grid.h"
+#include <cassert>
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+const int Bitboard::word_count;
+const int Bitboard::capacity;
+
+Bitboard::Bitboard()
+{
+    std::fill(words.begin(), words.end(), 0);
+}
+
+#if defined(__AVX2__)
+
+static
+__m256i
+load_words(const uint64_t* words)
+{
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words));
+}
+
+static
+void
+store_words(uint64_t* words, const __m256i& value)
+{
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(words), value);
+}
+
+bool
+Bitboard::any() const
+{
+    __m256i accumulator = _mm256_setzero_si256();
+    for (int kk=0; kk<word_count; kk+=4)
+        accumulator = _mm256_or_si256(accumulator, load_words(&words[kk]));
+    return !_mm256_testz_si256(accumulator, accumulator);
+}
+
+Bitboard&
+Bitboard::operator|=(const Bitboard& board)
+{
+    for (int kk=0; kk<word_count; kk+=4)
+        store_words(&words[kk], _mm256_or_si256(load_words(&words[kk]), load_words(&board.words[kk])));
+    return *this;
+}
+
+Bitboard&
+Bitboard::operator&=(const Bitboard& board)
+{
+    for (int kk=0; kk<word_count; kk+=4)
+        store_words(&words[kk], _mm256_and_si256(load_words(&words[kk]), load_words(&board.words[kk])));
+    return *this;
+}
+
+Bitboard&
+Bitboard::and_not(const Bitboard& board)
+{
+    for (int kk=0; kk<word_count; kk+=4)
+        store_words(&words[kk], _mm256_andnot_si256(load_words(&board.words[kk]), load_words(&words[kk])));
+    return *this;
+}
+
+#else
+
+bool
+Bitboard::any() const
+{
+    uint64_t accumulator = 0;
+    for (int kk=0; kk<word_count; kk++)
+        accumulator |= words[kk];
+    return accumulator != 0;
+}
+
+Bitboard&
+Bitboard::operator|=(const Bitboard& board)
+{
+    for (int kk=0; kk<word_count; kk++)
+        words[kk] |= board.words[kk];
+    return *this;
+}
+
+Bitboard&
+Bitboard::operator&=(const Bitboard& board)
+{
+    for (int kk=0; kk<word_count; kk++)
+        words[kk] &= board.words[kk];
+    return *this;
+}
+
+Bitboard&
+Bitboard::and_not(const Bitboard& board)
+{
+    for (int kk=0; kk<word_count; kk++)
+        words[kk] &= ~board.words[kk];
+    return *this;
+}
+
+#endif
+
+int
+Bitboard::count() const
+{
+    int count = 0;
+    for (int kk=0; kk<word_count; kk++)
+        count += __builtin_popcountll(words[kk]);
+    return count;
+}
+
+Bitboard
+Bitboard::shifted(const int& offset) const
+{
+    Bitboard board;
+    const int word_shift = (offset >= 0 ? offset : -offset) >> 6;
+    const int bit_shift = (offset >= 0 ? offset : -offset) & 63;
+
+    for (int kk=0; kk<word_count; kk++)
+    {
+        // source words of destination word kk
+        const int source = offset >= 0 ? kk-word_shift : kk+word_shift;
+        const int carry = offset >= 0 ? source-1 : source+1;
+        const uint64_t source_word = source >= 0 && source < word_count ? words[source] : 0;
+        const uint64_t carry_word = carry >= 0 && carry < word_count ? words[carry] : 0;
+
+        if (bit_shift == 0) board.words[kk] = source_word;
+        else if (offset >= 0) board.words[kk] = (source_word << bit_shift) | (carry_word >> (64-bit_shift));
+        else board.words[kk] = (source_word >> bit_shift) | (carry_word << (64-bit_shift));
+    }
+
+    return board;
+}
+
+int
+Bitboard::pop_first()
+{
+    for (int kk=0; kk<word_count; kk++)
+    {
+        if (!words[kk]) continue;
+        const int bit = __builtin_ctzll(words[kk]);
+        words[kk] &= words[kk]-1;
+        return 64*kk + bit;
+    }
+    return -1;
+}
+
+Bitboard
+operator|(const Bitboard& board_aa, const Bitboard& board_bb)
+{
+    Bitboard board(board_aa);
+    return board |= board_bb;
+}
+
+Bitboard
+operator&(const Bitboard& board_aa, const Bitboard& board_bb)
+{
+    Bitboard board(board_aa);
+    return board &= board_bb;
+}
+
+bool
+operator==(const Bitboard& board_aa, const Bitboard& board_bb)
+{
+    return board_aa.words == board_bb.words;
+}
+
+// All four directions in one pass. Offsets are 1 and stride, both below 64,
+// so each destination word only needs its two neighbor words as carries.
+#if defined(__AVX2__)
+
+Bitboard
+get_neighbors(const Bitboard& board, const int& stride)
+{
+    assert( stride > 1 && stride < 64 );
+
+    boost::array<uint64_t, Bitboard::word_count+2> padded;
+    padded.front() = 0;
+    std::copy(board.words.begin(), board.words.end(), padded.begin()+1);
+    padded.back() = 0;
+
+    const __m128i one = _mm_cvtsi32_si128(1);
+    const __m128i sixty_three = _mm_cvtsi32_si128(63);
+    const __m128i row = _mm_cvtsi32_si128(stride);
+    const __m128i row_carry = _mm_cvtsi32_si128(64-stride);
+
+    Bitboard neighbors;
+    for (int kk=0; kk<Bitboard::word_count; kk+=4)
+    {
+        const __m256i previous = load_words(&padded[kk]);
+        const __m256i center = load_words(&padded[kk+1]);
+        const __m256i next = load_words(&padded[kk+2]);
+
+        __m256i result = _mm256_or_si256(_mm256_sll_epi64(center, one), _mm256_srl_epi64(previous, sixty_three));
+        result = _mm256_or_si256(result, _mm256_or_si256(_mm256_srl_epi64(center, one), _mm256_sll_epi64(next, sixty_three)));
+        result = _mm256_or_si256(result, _mm256_or_si256(_mm256_sll_epi64(center, row), _mm256_srl_epi64(previous, row_carry)));
+        result = _mm256_or_si256(result, _mm256_or_si256(_mm256_srl_epi64(center, row), _mm256_sll_epi64(next, row_carry)));
+        store_words(&neighbors.words[kk], result);
+    }
+
+    return neighbors;
+}
+
+#else
+
+Bitboard
+get_neighbors(const Bitboard& board, const int& stride)
+{
+    assert( stride > 1 && stride < 64 );
+
+    Bitboard neighbors;
+    for (int kk=0; kk<Bitboard::word_count; kk++)
+    {
+        const uint64_t previous = kk > 0 ? board.words[kk-1] : 0;
+        const uint64_t center = board.words[kk];
+        const uint64_t next = kk+1 < Bitboard::word_count ? board.words[kk+1] : 0;
+
+        neighbors.words[kk] =
+            (center << 1) | (previous >> 63) |
+            (center >> 1) | (next << 63) |
+            (center << stride) | (previous >> (64-stride)) |
+            (center >> stride) | (next << (64-stride));
+    }
+
+    return neighbors;
+}
+
+#endif
+
+Bitboard
+flood_fill(const Bitboard& sources, const Bitboard& passable, const int& stride)
+{
+    Bitboard reached(sources);
+    while (true)
+    {
+        Bitboard frontier = get_neighbors(reached, stride);
+        frontier &= passable;
+        frontier.and_not(reached);
+        if (!frontier.any()) return reached;
+        reached |= frontier;
+    }
+}
+
+Bitboard
+reach_within(const Bitboard& sources, const Bitboard& passable, const int& stride, const int& step_count)
+{
+    Bitboard reached(sources);
+    for (int step=0; step<step_count; step++)
+    {
+        Bitboard frontier = get_neighbors(reached, stride);
+        frontier &= passable;
+        frontier.and_not(reached);
+        if (!frontier.any()) break;
+        reached |= frontier;
+    }
+    return reached;
+}
+
+bool
+is_adjacent(const Bitboard& board_aa, const Bitboard& board_bb, const int& stride)
+{
+    return (get_neighbors(board_aa, stride) & board_bb).any();
+}
+
+void
+test_bitboard()
+{
+    std::cout << "Doing bitboard test...\n";
+
+    { // shifts against single bits
+        Bitboard board;
+        board.set(70);
+        board.set(900);
+        assert( board.count() == 2 );
+        assert( board.shifted(1).test(71) && board.shifted(1).test(901) );
+        assert( board.shifted(-70).test(0) && board.shifted(-70).test(830) );
+        assert( board.shifted(130).test(200) && board.shifted(130).count() == 1 );
+        Bitboard board_prime(board);
+        assert( board_prime.pop_first() == 70 );
+        assert( board_prime.pop_first() == 900 );
+        assert( board_prime.pop_first() == -1 );
+        assert( !board_prime.any() );
+    }
+
+    for (int size=10; size<=28; size+=6)
+    {
+        const Grid grid(neutralize_tiles(make_benchmark_tiles(size)));
+
+        // bitboards against bfs distances
+        const PositionIndex source = grid.get_index(Position(0,0));
+        assert( grid.passable.test(source) );
+        Distances distances;
+        fill_distances(grid, source, distances);
+
+        Bitboard sources;
+        sources.set(source);
+        const Bitboard filled = flood_fill(sources, grid.passable, grid.stride);
+        const Bitboard reached = reach_within(sources, grid.passable, grid.stride, 6);
+        for (int index=0; index<static_cast<int>(grid.cells.size()); index++)
+        {
+            const bool walked = grid.passable.test(index) && distances[index] >= 0;
+            assert( filled.test(index) == walked );
+            assert( reached.test(index) == (walked && distances[index] <= 6) );
+        }
+
+        // adjacency against positions
+        for (int kk=0; kk<size*size; kk++)
+        {
+            const Position position_aa(kk%size, kk/size);
+            const Position position_bb((kk*7)%size, (kk/size+kk%3)%size);
+            if (position_aa == position_bb) continue; // next_to includes the position itself
+            Bitboard board_aa;
+            Bitboard board_bb;
+            board_aa.set(grid.get_index(position_aa));
+            board_bb.set(grid.get_index(position_bb));
+            assert( is_adjacent(board_aa, board_bb, grid.stride) == position_aa.next_to(position_bb) );
+        }
+
+        typedef std::vector<PositionIndex> Indexes;
+        Indexes passable_indexes;
+        Bitboard remaining(grid.passable);
+        for (int index=remaining.pop_first(); index>=0; index=remaining.pop_first())
+            passable_indexes.push_back(index);
+        assert( static_cast<int>(passable_indexes.size()) == grid.passable.count() );
+
+        const int payload = 200000/size;
+        double bitboard_delta = 0;
+        double bfs_delta = 0;
+        long int filled_count = 0;
+        for (int pass=0; pass<2; pass++)
+        {
+            const double start_time = get_double_time();
+            for (int kk=0; kk<payload; kk++)
+            {
+                const PositionIndex source_prime = passable_indexes[kk%passable_indexes.size()];
+                if (pass == 0)
+                {
+                    Bitboard sources_prime;
+                    sources_prime.set(source_prime);
+                    filled_count += flood_fill(sources_prime, grid.passable, grid.stride).count();
+                }
+                else
+                {
+                    fill_distances(grid, source_prime, distances);
+                    filled_count += distances[source_prime]; // zero, keeps the call
+                }
+            }
+            const double end_time = get_double_time();
+            (pass == 0 ? bitboard_delta : bfs_delta) = end_time-start_time;
+        }
+
+        std::cout << "fill " << size << "x" << size << " " << filled_count/payload << " cells";
+        std::cout << " bitboard " << static_cast<int>(1e-3*payload/bitboard_delta) << "kfill/s";
+        std::cout << " bfs " << static_cast<int>(1e-3*payload/bfs_delta) << "kbfs/s";
+        std::cout << " speedup " << bfs_delta/bitboard_delta << std::endl;
+    }
+
+#if defined(__AVX2__)
+    std::cout << "using avx2 kernels" << std::endl;
+#endif
+
+    std::cout << "...done!\n";
+}
+
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "position.h"
+#include <boost/array.hpp>
+
+// One bit per PositionIndex of a padded board. 16 words cover the 30x30
+// padded 28x28 board. Moving every cell of the set one step in a direction
+// is a shift by the grid offset of that direction; expansions are masked by
+// sets that never contain the UNKNOWN border, so bits shifted off a row end
+// in the border and never wrap to the next row.
+struct Bitboard
+{
+    typedef boost::array<uint64_t, 16> Words;
+
+    static const int word_count = 16;
+    static const int capacity = 64*word_count;
+
+    Bitboard(); // empty
+
+    bool
+    test(const PositionIndex& index) const
+    {
+        return (words[index >> 6] >> (index & 63)) & 1;
+    }
+
+    void
+    set(const PositionIndex& index)
+    {
+        words[index >> 6] |= static_cast<uint64_t>(1) << (index & 63);
+    }
+
+    void
+    reset(const PositionIndex& index)
+    {
+        words[index >> 6] &= ~(static_cast<uint64_t>(1) << (index & 63));
+    }
+
+    bool
+    any() const;
+
+    int
+    count() const;
+
+    Bitboard&
+    operator|=(const Bitboard& board);
+
+    Bitboard&
+    operator&=(const Bitboard& board);
+
+    Bitboard&
+    and_not(const Bitboard& board); // remove the cells of board
+
+    Bitboard
+    shifted(const int& offset) const; // bit index moves to index+offset
+
+    int
+    pop_first(); // remove and return the lowest index, -1 when empty
+
+    Words words;
+};
+
+Bitboard
+operator|(const Bitboard& board_aa, const Bitboard& board_bb);
+
+Bitboard
+operator&(const Bitboard& board_aa, const Bitboard& board_bb);
+
+bool
+operator==(const Bitboard& board_aa, const Bitboard& board_bb);
+
+/// Cells one step away from any cell of board, board itself excluded unless
+/// two of its cells are neighbors.
+Bitboard
+get_neighbors(const Bitboard& board, const int& stride);
+
+/// Cells of passable connected to sources, sources included.
+Bitboard
+flood_fill(const Bitboard& sources, const Bitboard& passable, const int& stride);
+
+/// Cells of passable reached from sources in at most step_count steps.
+Bitboard
+reach_within(const Bitboard& sources, const Bitboard& passable, const int& stride, const int& step_count);
+
+/// True when a cell of board_aa is next to a cell of board_bb.
+bool
+is_adjacent(const Bitboard& board_aa, const Bitboard& board_bb, const int& stride);
+
+void
+test_bitboard();
+
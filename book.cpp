@@ -0,0 +1,198 @@
+#include "book.h"
+
+#include "game.h"
+#include "search_tree.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <unistd.h>
+
+static_assert(sizeof(BookEntry) == 24, "book layout changed, bump the version");
+static_assert(sizeof(BookFileHeader) == 16, "book layout changed, bump the version");
+
+const uint32_t BookFileHeader::magic_value;
+const uint16_t BookFileHeader::version_value;
+
+static
+bool
+is_before(const BookEntry& entry_aa, const BookEntry& entry_bb)
+{
+    if (entry_aa.map_hash != entry_bb.map_hash) return entry_aa.map_hash < entry_bb.map_hash;
+    if (entry_aa.state_hash != entry_bb.state_hash) return entry_aa.state_hash < entry_bb.state_hash;
+    return entry_aa.visits > entry_bb.visits;
+}
+
+static
+bool
+is_same_state(const BookEntry& entry_aa, const BookEntry& entry_bb)
+{
+    return entry_aa.map_hash == entry_bb.map_hash && entry_aa.state_hash == entry_bb.state_hash;
+}
+
+void
+merge_book_entries(BookEntries& entries)
+{
+    std::sort(entries.begin(), entries.end(), is_before);
+    entries.erase(std::unique(entries.begin(), entries.end(), is_same_state), entries.end());
+}
+
+void
+write_book(const std::string& path, const BookEntries& entries)
+{
+    BookFileHeader header;
+    header.magic = BookFileHeader::magic_value;
+    header.version = BookFileHeader::version_value;
+    header.entry_size = sizeof(BookEntry);
+    header.count = entries.size();
+
+    std::ofstream file(path.c_str(), std::ios::binary);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (!entries.empty()) file.write(reinterpret_cast<const char*>(&entries[0]), entries.size()*sizeof(BookEntry));
+    if (!file) throw std::runtime_error("can't write book file " + path);
+}
+
+BookEntries
+read_book(const std::string& path)
+{
+    std::ifstream file(path.c_str(), std::ios::binary);
+    if (!file) throw std::runtime_error("can't open book file " + path);
+
+    BookFileHeader header;
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file || header.magic != BookFileHeader::magic_value || header.version != BookFileHeader::version_value || header.entry_size != sizeof(BookEntry)) throw std::runtime_error("bad book file " + path);
+
+    BookEntries entries(header.count);
+    if (!entries.empty()) file.read(reinterpret_cast<char*>(&entries[0]), entries.size()*sizeof(BookEntry));
+    if (!file) throw std::runtime_error("truncated book file " + path);
+
+    for (BookEntries::const_iterator ei=entries.begin(), eie=entries.end(); ei!=eie; ei++)
+        if (ei->direction > WEST) throw std::runtime_error("bad book direction in " + path);
+
+    return entries;
+}
+
+BookEntries
+generate_book_line(const Tiles& tiles, const int& half_turn_count, const int& playout_count, Rng& rng)
+{
+    const Game game(make_initial_state_json(tiles, 1200));
+    State state(game.state);
+
+    // the tree follows the line, keeping the search of the move played
+    SearchTree tree(256*1024*1024);
+    tree.reset(state, game.turn_max);
+
+    BookEntries entries;
+    for (int turn=0; turn<half_turn_count; turn++)
+    {
+        tree.run_playouts(playout_count, rng);
+        const DirectionVisits visits = tree.get_root_visits();
+        const Direction direction = static_cast<Direction>(std::max_element(visits.begin(), visits.end())-visits.begin());
+
+        const CanonicalKey key = game.symmetries.get_canonical_key(state);
+        BookEntry entry;
+        entry.map_hash = game.hashed_background_tiles.hash;
+        entry.state_hash = key.hash;
+        entry.visits = visits[direction];
+        entry.direction = game.symmetries.to_canonical(direction, key.symmetry_index);
+        std::fill(entry.padding, entry.padding+3, 0);
+        entries.push_back(entry);
+
+        tree.advance_root(direction);
+        state.update(direction);
+    }
+
+    return entries;
+}
+
+OpeningBook::OpeningBook(const std::string& path, const Hash& map_hash, const SymmetryGroup& symmetries) :
+    symmetries(symmetries),
+    moves()
+{
+    const BookEntries entries = read_book(path);
+    for (BookEntries::const_iterator ei=entries.begin(), eie=entries.end(); ei!=eie; ei++)
+        if (ei->map_hash == map_hash) moves[ei->state_hash] = static_cast<Direction>(ei->direction);
+}
+
+bool
+OpeningBook::lookup(const State& state, Direction& direction) const
+{
+    const CanonicalKey key = symmetries.get_canonical_key(state);
+    const Moves::const_iterator mi = moves.find(key.hash);
+    if (mi == moves.end()) return false;
+    direction = symmetries.from_canonical(mi->second, key.symmetry_index);
+    return true;
+}
+
+void
+test_book()
+{
+    std::cout << "Doing opening book test...\n";
+
+    Rng rng(42);
+
+    // maps saved by --collect-map read back
+    const Tiles tiles = make_symmetric_benchmark_tiles(12);
+    {
+        std::stringstream stream;
+        stream << tiles;
+        const Tiles tiles_prime = read_tiles(stream);
+        assert( hash_value(tiles_prime) == hash_value(tiles) );
+    }
+
+    BookEntries entries;
+    for (int line=0; line<2; line++)
+    {
+        const BookEntries line_entries = generate_book_line(tiles, 16, 2000, rng);
+        assert( line_entries.size() == 16 );
+        entries.insert(entries.end(), line_entries.begin(), line_entries.end());
+    }
+    merge_book_entries(entries);
+    assert( entries.size() >= 16 && entries.size() <= 32 );
+
+    char path[] = "/tmp/vindinium_book_XXXXXX";
+    const int fd = mkstemp(path);
+    assert( fd >= 0 );
+    close(fd);
+    write_book(path, entries);
+
+    const Game game(make_initial_state_json(tiles, 1200));
+    {
+        const OpeningBook other_book(path, game.hashed_background_tiles.hash+1, game.symmetries);
+        assert( other_book.size() == 0 );
+    }
+    const OpeningBook book(path, game.hashed_background_tiles.hash, game.symmetries);
+    assert( book.size() == entries.size() );
+    std::remove(path);
+
+    // a whole line replays from the book, so do its symmetric images
+    State state(game.state);
+    int hit_count = 0;
+    int symmetric_hit_count = 0;
+    Direction direction = STAY;
+    while (book.lookup(state, direction))
+    {
+        for (int kk=1; kk<static_cast<int>(game.symmetries.symmetries.size()); kk++)
+        {
+            Direction direction_prime = STAY;
+            symmetric_hit_count += book.lookup(game.symmetries.transform_state(state, kk), direction_prime);
+            assert( direction_prime == game.symmetries.to_canonical(direction, kk) );
+        }
+        state.update(direction);
+        hit_count++;
+    }
+    assert( hit_count >= 16 );
+    assert( symmetric_hit_count == hit_count*(static_cast<int>(game.symmetries.symmetries.size())-1) );
+
+    const int payload = 1000000;
+    const double start_time = get_double_time();
+    int checksum = 0;
+    for (int kk=0; kk<payload; kk++)
+        checksum += book.lookup(game.state, direction) + direction;
+    const double end_time = get_double_time();
+
+    std::cout << entries.size() << " entries " << hit_count << " line hits " << symmetric_hit_count << " symmetric hits lookup " << 1e9*(end_time-start_time)/payload << "ns (" << checksum%1000 << ")" << std::endl;
+
+    std::cout << "...done!\n";
+}
+
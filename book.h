@@ -0,0 +1,78 @@
+#pragma once
+
+#include "state.h"
+#include "symmetry.h"
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <boost/unordered_map.hpp>
+
+// Opening moves searched offline. Entries are keyed by the hash of the
+// background tiles and the canonical hash of the state, both boost hashes: a
+// book only holds on the platform and boost version that generated it.
+// Directions are stored in the canonical frame, see SymmetryGroup. Like
+// snapshot files, book files are a 16 byte header followed by the entries in
+// host order.
+struct BookEntry
+{
+    uint64_t map_hash;
+    uint64_t state_hash;
+    uint32_t visits; // playouts behind the move, the deepest search wins on merge
+    uint8_t direction;
+    uint8_t padding[3];
+};
+
+struct BookFileHeader
+{
+    static const uint32_t magic_value = 0x4b4f4256; // "VBOK"
+    static const uint16_t version_value = 2;
+
+    uint32_t magic;
+    uint16_t version;
+    uint16_t entry_size;
+    uint64_t count;
+};
+
+typedef std::vector<BookEntry> BookEntries;
+
+/// Keep the deepest entry of each state.
+void
+merge_book_entries(BookEntries& entries);
+
+void
+write_book(const std::string& path, const BookEntries& entries);
+
+/// Throws std::runtime_error on a missing or bad file.
+BookEntries
+read_book(const std::string& path);
+
+/// Self-play opening on tiles: every hero plays the most visited move of a
+/// search of playout_count playouts, for half_turn_count half turns.
+BookEntries
+generate_book_line(const Tiles& tiles, const int& half_turn_count, const int& playout_count, Rng& rng);
+
+// Book moves of a single map.
+struct OpeningBook
+{
+    OpeningBook(const std::string& path, const Hash& map_hash, const SymmetryGroup& symmetries);
+
+    bool
+    lookup(const State& state, Direction& direction) const;
+
+    size_t
+    size() const
+    {
+        return moves.size();
+    }
+
+private:
+
+    typedef boost::unordered_map<Hash, Direction> Moves;
+
+    const SymmetryGroup& symmetries;
+    Moves moves; // by canonical state hash
+};
+
+void
+test_book();
+
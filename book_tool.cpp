@@ -0,0 +1,126 @@
+#include "book.h"
+#include "scheduler.h"
+#include "logger.h"
+
+#include <fstream>
+#include <boost/bind/bind.hpp>
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/positional_options.hpp>
+#include <boost/program_options/variables_map.hpp>
+#include <boost/program_options/parsers.hpp>
+namespace po = boost::program_options;
+
+// Offline generation of the opening book. Every map saved by --collect-map
+// gets several self-play lines, each line a task on the worker pool.
+
+typedef std::vector<std::string> Paths;
+typedef std::vector<Tiles> TilesList;
+typedef std::vector<BookEntries> LineEntries;
+
+struct BookJob
+{
+    const TilesList& maps;
+    const StreamRng& master_rng;
+    const int line_count;
+    const int half_turn_count;
+    const int playout_count;
+    LineEntries& lines;
+};
+
+static
+void
+run_book_line(const BookJob& job, const int& task_index)
+{
+    Rng rng = job.master_rng.get_stream(task_index);
+    job.lines[task_index] = generate_book_line(job.maps[task_index/job.line_count], job.half_turn_count, job.playout_count, rng);
+}
+
+int main(int argc, char* argv[])
+{
+    Paths map_paths;
+    std::string book_path;
+    int line_count;
+    int half_turn_count;
+    int playout_count;
+    int threads;
+    uint64_t seed;
+
+    po::options_description po_options("book_tool [options] map files");
+    po_options.add_options()
+        ("help,h", "display this message")
+        ("map", po::value<Paths>(&map_paths), "map saved by --collect-map")
+        ("book", po::value<std::string>(&book_path)->default_value("opening.book"), "book file written")
+        ("lines", po::value<int>(&line_count)->default_value(8), "self-play lines per map")
+        ("half-turns", po::value<int>(&half_turn_count)->default_value(80), "half turns of each line")
+        ("playouts", po::value<int>(&playout_count)->default_value(200000), "playouts searched per move")
+        ("threads", po::value<int>(&threads)->default_value(0), "number of worker threads, 0 for one per core")
+        ("seed", po::value<uint64_t>(&seed)->default_value(42), "random seed");
+    po::positional_options_description positional;
+    positional.add("map", -1);
+
+    try
+    {
+        po::variables_map vm;
+        po::store(po::command_line_parser(argc, argv).options(po_options).positional(positional).run(), vm);
+        po::notify(vm);
+
+        if (vm.count("help") || map_paths.empty())
+        {
+            std::cout << po_options;
+            return 0;
+        }
+
+        if (line_count <= 0) throw po::invalid_option_value("lines <= 0");
+        if (half_turn_count <= 0) throw po::invalid_option_value("half_turns <= 0");
+        if (playout_count <= 0) throw po::invalid_option_value("playouts <= 0");
+        if (threads < 0) throw po::invalid_option_value("threads < 0");
+    }
+    catch (std::exception& ex)
+    {
+        std::cerr << "Error occurred when parsing options: " << ex.what() << std::endl;
+        std::cerr << po_options;
+        return 1;
+    }
+
+    TilesList maps;
+    for (Paths::const_iterator pi=map_paths.begin(), pie=map_paths.end(); pi!=pie; pi++)
+    {
+        std::ifstream handle(pi->c_str());
+        try
+        {
+            if (!handle) throw std::runtime_error("can't open file");
+            maps.push_back(read_tiles(handle));
+            const Grid grid(maps.back()); // throws past the grid size
+        }
+        catch (std::exception& ex)
+        {
+            std::cerr << "Error occurred when reading map " << *pi << ": " << ex.what() << std::endl;
+            return 1;
+        }
+        std::cout << *pi << " " << maps.back().shape()[0] << "x" << maps.back().shape()[0] << std::endl;
+    }
+
+    init_scheduler(threads, false);
+    std::cout << get_scheduler().get_worker_count() << " workers " << maps.size() << " maps " << line_count << " lines of " << half_turn_count << " half turns" << std::endl;
+
+    const StreamRng master_rng(seed);
+    const int task_count = maps.size()*line_count;
+    LineEntries lines(task_count);
+    const BookJob job = {maps, master_rng, line_count, half_turn_count, playout_count, lines};
+
+    const double start_time = get_double_time();
+    get_scheduler().parallel_for(task_count, boost::bind(run_book_line, boost::cref(job), boost::placeholders::_1));
+    const double end_time = get_double_time();
+
+    BookEntries entries;
+    for (LineEntries::const_iterator li=lines.begin(), lie=lines.end(); li!=lie; li++)
+        entries.insert(entries.end(), li->begin(), li->end());
+    const size_t searched_count = entries.size();
+    merge_book_entries(entries);
+    write_book(book_path, entries);
+
+    std::cout << book_path << " " << entries.size() << " entries from " << searched_count << " searches " << clock_it(end_time-start_time) << " " << static_cast<int>(1e-3*searched_count*playout_count/(end_time-start_time)) << "kplayout/s" << std::endl;
+
+    return 0;
+}
+
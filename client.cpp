@@ -5,11 +5,33 @@
 #include "network.h"
 #include "options.h"
 #include "tiles.h"
+#include "grid.h"
+#include "pool.h"
+#include "search_tree.h"
+#include "logger.h"
+#include "scheduler.h"
+#include "engine.h"
+#include "territory.h"
+#include "threat.h"
+#include "macro.h"
+#include "policy.h"
+#include "snapshot.h"
+#include "shadow.h"
+#include "alphabeta.h"
+#include "evaluation.h"
+#include "endgame.h"
+#include "symmetry.h"
+#include "map_generator.h"
+#include "hierarchy.h"
+#include "book.h"
+#include "startup.h"
+#include "inference.h"
 
 #include <signal.h>
 #include <boost/regex.hpp>
 #include <cassert>
 #include <fstream>
+#include <boost/scoped_ptr.hpp>
 
 #if defined(OPENMP_FOUND)
 #include <omp.h>
@@ -17,11 +39,34 @@
 
 #define TURN_DURATION .8
 
+// Snapshot of the game rendered later by the logger thread.
+struct GameStatusRender
+{
+    GameStatusRender(const Game& game) :
+        game(game),
+        state(game.state),
+        turn(game.turn)
+    {
+    }
+
+    void
+    operator()(std::ostream& os) const
+    {
+        game.status(os, state, turn);
+    }
+
+    const Game& game;
+    const State state;
+    const int turn;
+};
+
 Game
-play_game(const Options& options, Rng& rng)
+play_game(const Options& options, Rng& rng, BotTables* tables) // NULL with an engine daemon
 {
     static const boost::regex re_url("^(?:http://)?([^/]+)(/.*)$");
 
+    Logger& logger = get_logger();
+
     HTTPConnection connection(options.server_name);
     connection.proxy = options.proxy;
     const PTree& initial_json = connection.get_initial_state_json(options);
@@ -34,7 +79,7 @@ play_game(const Options& options, Rng& rng)
     const std::string play_end_point(what[2].first, what[2].second);
 
     const std::string& view_url = initial_json.get<std::string>("viewUrl");
-    std::cout << "view game at " << view_url << std::endl;
+    LogLine(LOG_WARNING) << "view game at " << view_url;
     double start_time = get_double_time();
 
     if (options.collect_map) { // collect maps
@@ -42,63 +87,104 @@ play_game(const Options& options, Rng& rng)
         const HashedPair<Tiles> hashed_tiles(tiles);
         std::stringstream ss;
         ss << "map_" << std::hex << hashed_tiles.hash << std::dec << ".txt";
-        std::cout << "saving " << ss.str() << std::endl;
+        LogLine(LOG_INFO) << "saving " << ss.str();
         std::ofstream handle(ss.str().c_str());
         handle << hashed_tiles.value;
         handle.close();
     }
 
     Game game(initial_json);
-    Bot bot(options, game, rng);
 
-    while (!game.is_finished())
+    // moves come either from a local bot or from a shared engine daemon
+    boost::scoped_ptr<Bot> bot;
+    boost::scoped_ptr<EngineClient> engine;
+    if (options.engine_socket.empty()) bot.reset(new Bot(options, game, rng, *tables));
+    else
     {
-        OmpFlag continue_flag(true);
-
-        std::cout << std::endl;
-        std::cout << "======================================== " << clock_it(get_double_time() - start_time) << std::endl;
+        engine.reset(new EngineClient(options.engine_socket));
+        engine->start_game(game);
+        LogLine(LOG_INFO) << "engine ping " << clock_it(engine->ping());
+    }
 
-        game.status(std::cout);
+    boost::scoped_ptr<ShadowVerifier> shadow;
+    if (options.shadow) shadow.reset(new ShadowVerifier(game.background_grid, options.shadow_file));
 
-        std::cout << "++++++++++++++++++++++++++++++++++++++++ " << clock_it(get_double_time() - start_time) << std::endl;
+    CancellationToken search_token;
 
-        const Direction direction = bot.get_move(game);
-        std::cout << "bot direction " << direction << std::endl;
+    // the first move also pays for parsing the board and starting the bot
+    double first_move_time = -1;
+    double move_time_sum = 0;
+    int move_count = 0;
 
-        bot.advance_game(game, direction);
+    while (!game.is_finished())
+    {
+        LogLine(LOG_INFO) << "";
+        LogLine(LOG_INFO) << "======================================== " << clock_it(get_double_time() - start_time);
 
-        std::cout << "---------------------------------------- " << clock_it(get_double_time() - start_time) << std::endl;
+        if (logger.is_render_enabled(LOG_INFO)) logger.log_render(LOG_INFO, GameStatusRender(game));
 
-        std::cout << "view game at " << view_url << std::endl;
+        LogLine(LOG_INFO) << "++++++++++++++++++++++++++++++++++++++++ " << clock_it(get_double_time() - start_time);
 
-        PTree new_json;
-        double request_start_time;
-        double request_end_time;
-#if defined(OPENMP_FOUND)
-        #pragma omp parallel sections default(shared) shared(new_json, request_end_time, request_start_time, continue_flag, play_end_point, play_server_name, start_time, bot, game)
+        const double deadline = get_double_time() + options.search_time;
+        search_token.reset();
+        search_token.set_deadline(deadline);
+        const Direction direction = bot ? bot->get_move(game, search_token) : engine->get_move(game, deadline);
+        const double move_time = get_double_time() - start_time;
+        if (first_move_time < 0) first_move_time = move_time;
+        else
         {
+            move_time_sum += move_time;
+            move_count++;
+        }
+        LogLine(LOG_INFO) << "bot direction " << direction;
 
-            #pragma omp section
-#endif
-            {
-                request_start_time = get_double_time();
-                new_json = connection.get_new_state_json(play_end_point, direction);
-                request_end_time = get_double_time();
+        if (bot) bot->advance_game(game, direction);
+
+        LogLine(LOG_INFO) << "---------------------------------------- " << clock_it(get_double_time() - start_time);
+
+        LogLine(LOG_INFO) << "view game at " << view_url;
+
+        if (shadow) shadow->record(game.state, game.turn, direction);
+        const State previous_state(game.state);
+        const int previous_turn = game.turn;
+
+        const double request_start_time = get_double_time();
+        const PTree new_json = connection.get_new_state_json(play_end_point, direction);
+        const double request_end_time = get_double_time();
 
-                continue_flag.reset();
-            }
-        }
         game.state.update(new_json);
         game.update(new_json);
 
-        std::cout << "request took " << clock_it(request_end_time-request_start_time) << std::endl;
+        // inferred once for the bot and the shadow check
+        MoveInference inference;
+        const int opponent_count = game.turn-previous_turn-1;
+        if (opponent_count >= 0 && opponent_count <= 3)
+        {
+            inference = infer_opponent_moves(game.background_grid, previous_state, direction, game.state, opponent_count);
+            LogLine(LOG_INFO) << "opponent moves " << inference;
+
+            // the bot follows the opponents to keep its search
+            if (bot && inference.match_count > 0)
+                for (int kk=0; kk<opponent_count; kk++)
+                    bot->advance_game(game, inference.directions[kk]);
+        }
+
+        if (shadow) shadow->verify(game.state, game.turn, inference);
 
-        std::cout << "======================================== " << clock_it(get_double_time() - start_time) << std::endl;
+        LogLine(LOG_INFO) << "request took " << clock_it(request_end_time-request_start_time);
+
+        LogLine(LOG_INFO) << "======================================== " << clock_it(get_double_time() - start_time);
         start_time = get_double_time();
     }
 
     assert( game.is_finished() );
 
+    LogLine(LOG_WARNING) << "time to first move " << clock_it(first_move_time) << " steady move " << clock_it(move_count ? move_time_sum/move_count : 0) << " over " << move_count << " moves";
+
+    if (shadow) LogLine(LOG_WARNING) << "shadow " << shadow->check_count << " checks " << shadow->divergence_count << " divergences " << clock_it(shadow->check_count ? shadow->check_time/shadow->check_count : 0) << " per check";
+
+    logger.flush();
+
     return game;
 }
 
@@ -123,19 +209,63 @@ int main(int argc, char* argv[])
 #endif
 
 #if defined(OPENMP_FOUND)
-    omp_set_nested(true);
     std::cout << "\t> Running using OPENMP " << std::endl;
-    std::cout << "\t\t> " << omp_get_max_threads() << " threads max" << std::endl;
     std::cout << "\t\t> " << omp_get_wtick()*1e9 << "ns tick" << std::endl;
-    assert( omp_get_nested() );
 #endif
 
-//     test_random();
-    Rng rng;
-    rng.seed(rand());
-
     Options options = parse_options(argc, argv);
 
+    init_scheduler(options.threads, options.pin_threads);
+    std::cout << "\t> Running " << get_scheduler().get_worker_count() << " workers" << std::endl;
+
+    if (options.seed == 0) options.seed = static_cast<uint64_t>(get_double_time()*1e6);
+    std::cout << "\t> Using seed " << options.seed << std::endl;
+    Rng rng(options.seed);
+
+    if (options.self_test)
+    {
+        srand(1); // test_random expects the default libc seed
+        test_random();
+        test_grid();
+        test_map_generator();
+        test_hierarchy();
+        test_bitboard();
+        test_state();
+        test_state_allocations();
+        test_snapshot();
+        test_inference();
+        test_shadow();
+        test_territory();
+        test_threat();
+        test_macro();
+        test_policy();
+        test_pool();
+        test_search_tree();
+        test_alphabeta();
+        test_evaluation();
+        test_endgame();
+        test_symmetry();
+        test_book();
+        test_startup();
+        test_logger();
+        test_scheduler();
+        test_search_scaling();
+        test_engine();
+        return 0;
+    }
+
+    std::ofstream log_file;
+    if (!options.log_file.empty()) log_file.open(options.log_file.c_str(), std::ios::binary);
+    std::ostream& log_stream = options.log_file.empty() ? std::cout : log_file;
+    const LogLevel log_level = options.quiet ? LOG_WARNING : LOG_INFO;
+    if (options.log_format == "json") get_logger().add_sink(new JsonLogSink(log_stream, log_level));
+    else if (options.log_format == "binary") get_logger().add_sink(new BinaryLogSink(log_stream, log_level, !options.quiet));
+    else get_logger().add_sink(new TextLogSink(log_stream, log_level));
+
+    // made once for every game
+    boost::scoped_ptr<BotTables> tables;
+    if (options.engine_socket.empty()) tables.reset(new BotTables(options));
+
     typedef std::map<std::string, int> Wins;
     Wins wins;
 
@@ -145,14 +275,23 @@ int main(int argc, char* argv[])
         std::cout << "****************************************" << std::endl;
         std::cout << "game " << kk << "/" << options.number_of_games << std::endl;
 
-        const Game& game = play_game(options, rng);
+        boost::scoped_ptr<const Game> game;
+        try
+        {
+            game.reset(new Game(play_game(options, rng, tables.get())));
+        }
+        catch (std::exception& ex)
+        {
+            std::cerr << "Error occurred when playing game " << kk << ": " << ex.what() << std::endl;
+            return 1;
+        }
 
-        const int winner = game.state.get_winner();
+        const int winner = game->state.get_winner();
         if (winner < 0) wins["draw"]++;
         else {
             std::string winner_name = "bot";
-            if (game.hero_infos[winner].is_real_bot())
-                winner_name = game.hero_infos[winner].name;
+            if (game->hero_infos[winner].is_real_bot())
+                winner_name = game->hero_infos[winner].name;
             wins[winner_name]++;
         }
 
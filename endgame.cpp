@@ -0,0 +1,384 @@
+#include "endgame.h"
+
+#include "policy.h"
+#include <boost/functional/hash.hpp>
+
+int
+get_rank_score(const State& state, const int& hero_index)
+{
+    const int gold = state.heroes[hero_index].gold;
+    int score = 0;
+    for (int kk=0; kk<4; kk++)
+    {
+        if (kk == hero_index) continue;
+        const int other_gold = state.heroes[kk].gold;
+        score += gold > other_gold ? 2 : gold == other_gold ? 1 : 0;
+    }
+    return score;
+}
+
+GoldBounds
+get_gold_bounds(const State::Hero& hero, const int& moves_left, const int& mine_count, const int& owned_mine_count, const bool& may_kill)
+{
+    GoldBounds bounds;
+    bounds.lower = hero.gold - 2*std::min(moves_left, hero.gold/2);
+    bounds.upper = hero.gold;
+    for (int kk=1; kk<=moves_left; kk++)
+        bounds.upper += std::min<int>(mine_count, may_kill ? owned_mine_count+4*kk : hero.mines.size()+kk);
+    return bounds;
+}
+
+static
+int
+get_manhattan_distance(const Position& position_aa, const Position& position_bb)
+{
+    return std::abs(position_aa.x-position_bb.x) + std::abs(position_aa.y-position_bb.y);
+}
+
+// Heroes walk one tile per move and only jump by respawning on their spawn.
+static
+bool
+may_meet(const State::Hero& hero_aa, const bool& respawns_aa, const int& moves_aa, const State::Hero& hero_bb, const bool& respawns_bb, const int& moves_bb, const int& distance)
+{
+    const int reach = distance+moves_aa+moves_bb;
+    if (get_manhattan_distance(hero_aa.position, hero_bb.position) <= reach) return true;
+    if (respawns_aa && get_manhattan_distance(hero_aa.spawn_position, hero_bb.position) <= reach) return true;
+    if (respawns_bb && get_manhattan_distance(hero_aa.position, hero_bb.spawn_position) <= reach) return true;
+    return respawns_aa && respawns_bb && get_manhattan_distance(hero_aa.spawn_position, hero_bb.spawn_position) <= reach;
+}
+
+// A hero loses at most 20 life per half turn and 1 per move to thirst, or
+// is crushed on the spawn of another hero.
+static
+bool
+may_die(const State& state, const int& turns_left, const boost::array<int, 4>& moves_lefts, const int& hero_index)
+{
+    const State::Hero& hero = state.heroes[hero_index];
+    if (hero.life <= 20*turns_left + moves_lefts[hero_index]) return true;
+    for (int kk=0; kk<4; kk++)
+        if (kk != hero_index && get_manhattan_distance(hero.position, state.heroes[kk].spawn_position) <= moves_lefts[hero_index]) return true;
+    return false;
+}
+
+bool
+may_kill(const State& state, const int& turns_left, const boost::array<int, 4>& moves_lefts, const int& hero_index)
+{
+    const State::Hero& hero = state.heroes[hero_index];
+
+    boost::array<bool, 4> may_dies;
+    for (int kk=0; kk<4; kk++)
+        may_dies[kk] = may_die(state, turns_left, moves_lefts, kk);
+
+    for (int kk=0; kk<4; kk++)
+    {
+        if (kk == hero_index) continue;
+        const State::Hero& other = state.heroes[kk];
+
+        // the victim dies next to the hero, or stands on its spawn
+        if (moves_lefts[hero_index] > 0 && may_dies[kk] && may_meet(hero, may_dies[hero_index], moves_lefts[hero_index], other, true, moves_lefts[kk], 1)) return true;
+        if (may_dies[hero_index] && get_manhattan_distance(hero.spawn_position, other.position) <= moves_lefts[kk]) return true;
+        if (may_dies[hero_index] && may_dies[kk] && get_manhattan_distance(hero.spawn_position, other.spawn_position) <= moves_lefts[kk]) return true;
+    }
+
+    return false;
+}
+
+EndgameSolver::EndgameSolver(const Grid& grid, const SymmetryGroup& symmetries, TranspositionTable& table) :
+    node_count(0),
+    bound_cut_count(0),
+    grid(grid),
+    symmetries(symmetries),
+    table(table),
+    token(NULL),
+    root_hero_index(0),
+    root_turns_left(0),
+    root_direction(STAY),
+    aborted(false)
+{
+}
+
+int
+EndgameSolver::search(const State& state, const int& turns_left, int alpha, int beta)
+{
+    node_count++;
+    if (!aborted && (node_count & 255) == 0) aborted = token->is_cancelled();
+    if (aborted) return 0;
+
+    if (turns_left <= 0) return get_rank_score(state, root_hero_index);
+
+    const bool is_root = turns_left == root_turns_left;
+
+    // rank score range allowed by the gold every hero can still end with
+    if (!is_root)
+    {
+        boost::array<int, 4> moves_lefts;
+        int owned_mine_count = 0;
+        for (int kk=0; kk<4; kk++)
+        {
+            moves_lefts[kk] = get_moves_left(state, turns_left, kk);
+            owned_mine_count += state.heroes[kk].mines.size();
+        }
+
+        boost::array<GoldBounds, 4> bounds;
+        for (int kk=0; kk<4; kk++)
+            bounds[kk] = get_gold_bounds(state.heroes[kk], moves_lefts[kk], grid.mines.size(), owned_mine_count, may_kill(state, turns_left, moves_lefts, kk));
+
+        const GoldBounds& root_bounds = bounds[root_hero_index];
+        int min_score = 0;
+        int max_score = 0;
+        for (int kk=0; kk<4; kk++)
+        {
+            if (kk == root_hero_index) continue;
+            min_score += root_bounds.lower > bounds[kk].upper ? 2 : root_bounds.lower >= bounds[kk].upper ? 1 : 0;
+            max_score += root_bounds.upper < bounds[kk].lower ? 0 : root_bounds.upper <= bounds[kk].lower ? 1 : 2;
+        }
+
+        if (min_score == max_score || min_score >= beta || max_score <= alpha)
+        {
+            bound_cut_count++;
+            return min_score >= beta || min_score == max_score ? min_score : max_score;
+        }
+    }
+
+    // symmetric states share their entry, the root hero is keyed by its
+    // place in the turn order so that it follows the relabeled heroes
+    const CanonicalKey key = symmetries.get_canonical_key(state);
+    Hash hash = key.hash;
+    boost::hash_combine(hash, turns_left);
+    boost::hash_combine(hash, (root_hero_index-state.next_hero_index+4)%4);
+
+    // entries are searched to the end, any of them is deep enough
+    TranspositionEntry entry;
+    Direction table_direction = no_direction;
+    if (table.probe(hash, entry))
+    {
+        table_direction = symmetries.from_canonical(entry.direction, key.symmetry_index);
+        if (!is_root)
+        {
+            if (entry.bound == BOUND_EXACT) return entry.value;
+            if (entry.bound == BOUND_LOWER && entry.value >= beta) return entry.value;
+            if (entry.bound == BOUND_UPPER && entry.value <= alpha) return entry.value;
+        }
+    }
+
+    LegalDirections legal = get_legal_directions(grid, grid.get_index(state.heroes[state.next_hero_index].position));
+    for (int kk=1; kk<legal.size; kk++)
+        if (legal.directions[kk] == table_direction) std::swap(legal.directions[0], legal.directions[kk]);
+
+    const bool is_max = state.next_hero_index == root_hero_index;
+    const int alpha_start = alpha;
+    const int beta_start = beta;
+    int best = is_max ? -1 : 7;
+    Direction best_move = legal.directions[0];
+    for (int kk=0; kk<legal.size; kk++)
+    {
+        State state_prime(state);
+        state_prime.update(legal.directions[kk]);
+        const int value = search(state_prime, turns_left-1, alpha, beta);
+        if (aborted) return 0;
+
+        if (is_max ? value > best : value < best)
+        {
+            best = value;
+            best_move = legal.directions[kk];
+        }
+        if (is_max) alpha = std::max(alpha, value);
+        else beta = std::min(beta, value);
+        if (alpha >= beta) break;
+    }
+
+    entry.value = best;
+    entry.depth = turns_left;
+    entry.bound = best <= alpha_start ? BOUND_UPPER : best >= beta_start ? BOUND_LOWER : BOUND_EXACT;
+    entry.direction = symmetries.to_canonical(best_move, key.symmetry_index);
+    table.store(hash, entry);
+
+    if (is_root) root_direction = best_move;
+    return best;
+}
+
+EndgameResult
+EndgameSolver::solve(const State& state, const int& turns_left, const CancellationToken& token)
+{
+    assert( turns_left > 0 && turns_left < 256 );
+
+    this->token = &token;
+    root_hero_index = state.next_hero_index;
+    root_turns_left = turns_left;
+    root_direction = STAY;
+    aborted = false;
+    node_count = 0;
+    bound_cut_count = 0;
+
+    EndgameResult result;
+    result.score = search(state, turns_left, -1, 7);
+    result.proven = !aborted;
+    result.direction = root_direction;
+    if (aborted) result.score = 0;
+    return result;
+}
+
+static
+int
+get_paranoid_score(const Grid& grid, const State& state, const int& turns_left, const int& hero_index)
+{
+    if (turns_left == 0) return get_rank_score(state, hero_index);
+
+    const bool is_max = state.next_hero_index == hero_index;
+    const LegalDirections legal = get_legal_directions(grid, grid.get_index(state.heroes[state.next_hero_index].position));
+    int best = is_max ? -1 : 7;
+    for (int kk=0; kk<legal.size; kk++)
+    {
+        State state_prime(state);
+        state_prime.update(legal.directions[kk]);
+        const int value = get_paranoid_score(grid, state_prime, turns_left-1, hero_index);
+        best = is_max ? std::max(best, value) : std::min(best, value);
+    }
+    return best;
+}
+
+static
+bool
+is_free_cell(const State& state, const Position& position)
+{
+    for (int kk=0; kk<4; kk++)
+        if (state.heroes[kk].position == position) return false;
+    return true;
+}
+
+void
+test_endgame()
+{
+    std::cout << "Doing endgame solver test...\n";
+
+    Rng rng(42);
+
+    const Tiles tiles = make_benchmark_tiles(18);
+    const PTree root = make_initial_state_json(tiles, 1200);
+    const Tiles background_tiles = neutralize_tiles(tiles);
+    const HashedPair<Tiles> hashed_background_tiles(background_tiles);
+    const Grid grid(background_tiles);
+    const RandomPolicy policy(grid);
+    const SymmetryGroup symmetries(grid, State(root, hashed_background_tiles, grid));
+
+    // states along a random game
+    typedef std::vector<State> States;
+    States states;
+    {
+        State state(root, hashed_background_tiles, grid);
+        for (int turn=0; turn<1200; turn++)
+        {
+            state.update(policy(state, rng));
+            if (turn%100 == 99) states.push_back(state);
+        }
+    }
+
+    CancellationToken token;
+    TranspositionTable table(16*1024*1024);
+    EndgameSolver solver(grid, symmetries, table);
+
+    // scores match plain paranoid minimax
+    for (States::const_iterator si=states.begin(), sie=states.end(); si!=sie; si++)
+    {
+        const EndgameResult result = solver.solve(*si, 6, token);
+        assert( result.proven );
+        assert( result.score == get_paranoid_score(grid, *si, 6, si->next_hero_index) );
+
+        State state_prime(*si);
+        state_prime.update(result.direction);
+        assert( get_paranoid_score(grid, state_prime, 5, si->next_hero_index) == result.score );
+    }
+
+    // a lead the last moves can't change is proven at the root
+    {
+        State state(states.back());
+        state.heroes[state.next_hero_index].gold += 1000;
+        const EndgameResult result = solver.solve(state, 40, token);
+        assert( result.proven );
+        assert( result.score == 6 );
+        assert( solver.node_count <= 6 );
+    }
+
+    // a kill hands over every mine of the victim, the gold bounds must not
+    // cut it away: the next hero overtakes the root one by killing a weak
+    // hero next to it on its first move
+    {
+        State state(states.back());
+        const int hero_index = state.next_hero_index;
+        const int killer_index = (hero_index+1)%4;
+        const int victim_index = (hero_index+2)%4;
+        for (int kk=0; kk<4; kk++)
+        {
+            state.heroes[kk].mines.clear();
+            state.heroes[kk].gold = 0;
+            state.heroes[kk].life = 100;
+        }
+        for (int kk=0; kk<12; kk++)
+            state.heroes[victim_index].mines.insert(kk);
+        state.heroes[victim_index].life = 10;
+        state.heroes[hero_index].gold = 110;
+        state.heroes[killer_index].gold = 100;
+
+        // the killer next to the victim, the root hero out of reach of both
+        const Position victim_position = state.heroes[victim_index].position;
+        bool is_placed = false;
+        for (int direction=NORTH; direction<=WEST && !is_placed; direction++)
+        {
+            const PositionIndex index = grid.get_neighbor(grid.get_index(victim_position), static_cast<Direction>(direction));
+            if (grid.get_tile(index) != EMPTY || !is_free_cell(state, grid.get_position(index))) continue;
+            state.heroes[killer_index].position = grid.get_position(index);
+            is_placed = true;
+        }
+        assert( is_placed );
+        is_placed = false;
+        for (int index=0; index<static_cast<int>(grid.cells.size()) && !is_placed; index++)
+        {
+            const Position position = grid.get_position(index);
+            if (grid.get_tile(index) != EMPTY || !is_free_cell(state, position)) continue;
+            if (get_manhattan_distance(position, victim_position) < 8) continue;
+            state.heroes[hero_index].position = position;
+            is_placed = true;
+        }
+        assert( is_placed );
+
+        for (int turns_left=2; turns_left<=5; turns_left++)
+        {
+            TranspositionTable table_prime(16*1024*1024);
+            EndgameSolver solver_prime(grid, symmetries, table_prime);
+            const EndgameResult result = solver_prime.solve(state, turns_left, token);
+            assert( result.proven );
+            assert( result.score == get_paranoid_score(grid, state, turns_left, hero_index) );
+        }
+
+        // without the kill the root hero keeps its lead
+        State state_prime(state);
+        state_prime.heroes[victim_index].life = 100;
+        assert( get_paranoid_score(grid, state_prime, 2, hero_index) > get_paranoid_score(grid, state, 2, hero_index) );
+    }
+
+    // proof rate and cost over the last half turns
+    for (int turns_left=8; turns_left<=32; turns_left*=2)
+    {
+        int proven_count = 0;
+        uint64_t node_count = 0;
+        uint64_t bound_cut_count = 0;
+        double total_time = 0;
+        for (States::const_iterator si=states.begin(), sie=states.end(); si!=sie; si++)
+        {
+            TranspositionTable table_prime(16*1024*1024);
+            EndgameSolver solver_prime(grid, symmetries, table_prime);
+            CancellationToken token_prime;
+            const double start_time = get_double_time();
+            token_prime.set_deadline(start_time+.1);
+            const EndgameResult result = solver_prime.solve(*si, turns_left, token_prime);
+            total_time += get_double_time()-start_time;
+            proven_count += result.proven;
+            node_count += solver_prime.node_count;
+            bound_cut_count += solver_prime.bound_cut_count;
+        }
+        std::cout << "endgame " << turns_left << " half turns " << proven_count << "/" << states.size() << " proven " << node_count/states.size() << " nodes " << 100.*bound_cut_count/node_count << "% bound cuts " << 1e3*total_time/states.size() << "ms per solve" << std::endl;
+    }
+
+    std::cout << "...done!\n";
+}
+
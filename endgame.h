@@ -0,0 +1,71 @@
+#pragma once
+
+#include "alphabeta.h"
+
+/// Twice the opponents hero_index has less gold than plus the ones it ties,
+/// in [0,6]. Final rank score when the game is over.
+int
+get_rank_score(const State& state, const int& hero_index);
+
+struct GoldBounds
+{
+    int lower;
+    int upper;
+};
+
+/// Final gold range of a hero playing moves_left more moves. Gold only goes
+/// down by 2 at a tavern and each move captures at most one more mine. A
+/// kill hands over every mine of the victim, so a hero that may kill can
+/// hold any of the owned_mine_count mines owned now plus the ones captured
+/// since, at most one per half turn.
+GoldBounds
+get_gold_bounds(const State::Hero& hero, const int& moves_left, const int& mine_count, const int& owned_mine_count, const bool& may_kill);
+
+/// Whether hero_index can take the mines of another hero in the next
+/// turns_left half turns, by ending a move next to a hero it kills or by
+/// respawning onto one. moves_lefts holds the moves each hero still plays.
+bool
+may_kill(const State& state, const int& turns_left, const boost::array<int, 4>& moves_lefts, const int& hero_index);
+
+struct EndgameResult
+{
+    Direction direction;
+    int score; // rank score the hero to play gets against any opponent moves
+    bool proven; // false when the deadline came first, direction is then meaningless
+};
+
+// Exact paranoid search to the end of the game over single hero moves: the
+// hero to play at the root maximizes its final rank score and the others
+// minimize it. Before expanding a state, the rank score bounds given by the
+// gold bounds of every hero are checked against the window, which cuts most
+// of the tree once the gold gaps exceed what the last moves can change.
+// Values are exact and keys hold the whole state, so the dedicated table is
+// kept between turns and games.
+struct EndgameSolver
+{
+    EndgameSolver(const Grid& grid, const SymmetryGroup& symmetries, TranspositionTable& table);
+
+    EndgameResult
+    solve(const State& state, const int& turns_left, const CancellationToken& token);
+
+    uint64_t node_count; // of the last solve
+    uint64_t bound_cut_count; // states decided by the gold bounds alone
+
+private:
+
+    int
+    search(const State& state, const int& turns_left, int alpha, int beta);
+
+    const Grid& grid;
+    const SymmetryGroup& symmetries;
+    TranspositionTable& table;
+    const CancellationToken* token;
+    int root_hero_index;
+    int root_turns_left;
+    Direction root_direction;
+    bool aborted;
+};
+
+void
+test_endgame();
+
@@ -0,0 +1,519 @@
+#include "engine.h"
+
+#include "snapshot.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <chrono>
+#include <iterator>
+#include <functional>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+ByteWriter::ByteWriter(Bytes& bytes) :
+    bytes(bytes)
+{
+}
+
+void
+ByteWriter::put_string(const std::string& value)
+{
+    put<uint32_t>(value.size());
+    bytes.insert(bytes.end(), value.begin(), value.end());
+}
+
+ByteReader::ByteReader(const Bytes& bytes) :
+    bytes(bytes),
+    offset(0)
+{
+}
+
+void
+ByteReader::read(void* data, const size_t& size)
+{
+    if (offset+size > bytes.size()) throw std::runtime_error("truncated engine message");
+    std::memcpy(data, &bytes[offset], size);
+    offset += size;
+}
+
+std::string
+ByteReader::get_string()
+{
+    const uint32_t size = get<uint32_t>();
+    if (offset+size > bytes.size()) throw std::runtime_error("truncated engine message");
+    const std::string value(bytes.begin()+offset, bytes.begin()+offset+size);
+    offset += size;
+    return value;
+}
+
+bool
+ByteReader::is_finished() const
+{
+    return offset == bytes.size();
+}
+
+/****************************************/
+
+static
+void
+put_position(ByteWriter& writer, const Position& position)
+{
+    writer.put<int16_t>(position.x);
+    writer.put<int16_t>(position.y);
+}
+
+static
+Position
+get_position(ByteReader& reader)
+{
+    const int16_t x = reader.get<int16_t>();
+    const int16_t y = reader.get<int16_t>();
+    return Position(x, y);
+}
+
+void
+encode_new_game(Bytes& payload, const Game& game)
+{
+    payload.clear();
+    ByteWriter writer(payload);
+    writer.put<int32_t>(game.turn_max);
+    writer.put<uint8_t>(game.background_grid.size);
+    writer.put_string(serialize_tiles(game.background_tiles));
+    for (int kk=0; kk<4; kk++)
+        put_position(writer, game.state.heroes[kk].spawn_position);
+}
+
+// Boards sent by clients only hold the background tiles serialize_tiles
+// writes: empty tiles, woods, taverns and neutral mines.
+static
+bool
+is_background_tiles_string(const std::string& tiles_string)
+{
+    for (size_t kk=0; kk+1<tiles_string.size(); kk+=2)
+    {
+        const std::string name = tiles_string.substr(kk, 2);
+        if (name != "  " && name != "##" && name != "[]" && name != "$-") return false;
+    }
+    return true;
+}
+
+PTree
+decode_new_game(const Bytes& payload)
+{
+    static const Tile hero_tiles[4] = {HERO1, HERO2, HERO3, HERO4};
+
+    ByteReader reader(payload);
+    const int turn_max = reader.get<int32_t>();
+    const int size = reader.get<uint8_t>();
+    if (size < 1 || size > Grid::max_size) throw std::runtime_error("bad engine board size");
+    const std::string tiles_string = reader.get_string();
+    if (static_cast<int>(tiles_string.size()) != 2*size*size) throw std::runtime_error("bad engine board");
+    if (!is_background_tiles_string(tiles_string)) throw std::runtime_error("bad engine board tile");
+
+    Tiles tiles = parse_tiles(size, tiles_string);
+    for (int kk=0; kk<4; kk++)
+    {
+        const Position position = get_position(reader);
+        if (get_tile_border_check(tiles, position) != EMPTY) throw std::runtime_error("bad engine spawn position");
+        get_tile(tiles, position) = hero_tiles[kk];
+    }
+    if (!reader.is_finished()) throw std::runtime_error("oversized engine message");
+
+    return make_initial_state_json(tiles, turn_max);
+}
+
+void
+encode_move(Bytes& payload, const Game& game, const double& budget)
+{
+    payload.clear();
+    ByteWriter writer(payload);
+    writer.put<uint32_t>(std::max(0., budget*1e6));
+    StateSnapshot snapshot;
+    encode_snapshot(game.state, game.turn, snapshot);
+    writer.put(snapshot);
+}
+
+double
+decode_move(const Bytes& payload, Game& game)
+{
+    ByteReader reader(payload);
+    const double budget = reader.get<uint32_t>()*1e-6;
+    decode_snapshot(reader.get<StateSnapshot>(), game.state, game.turn);
+    if (!reader.is_finished()) throw std::runtime_error("oversized engine message");
+    return budget;
+}
+
+/****************************************/
+
+static
+sockaddr_un
+make_socket_address(const std::string& path)
+{
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) throw std::runtime_error("engine socket path too long");
+    std::strcpy(address.sun_path, path.c_str());
+    return address;
+}
+
+int
+listen_engine_socket(const std::string& path)
+{
+    const sockaddr_un address = make_socket_address(path);
+    const int socket_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (socket_fd < 0) throw std::runtime_error("can't create engine socket");
+
+    unlink(path.c_str()); // stale socket from a previous daemon
+    if (bind(socket_fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0 || listen(socket_fd, 64) < 0)
+    {
+        close(socket_fd);
+        throw std::runtime_error("can't listen on engine socket " + path);
+    }
+
+    return socket_fd;
+}
+
+int
+connect_engine_socket(const std::string& path)
+{
+    const sockaddr_un address = make_socket_address(path);
+    const int socket_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (socket_fd < 0) throw std::runtime_error("can't create engine socket");
+
+    if (connect(socket_fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0)
+    {
+        close(socket_fd);
+        throw std::runtime_error("can't connect to engine socket " + path);
+    }
+
+    return socket_fd;
+}
+
+// Frame header, packed by hand to avoid padding.
+typedef boost::array<uint8_t, 5> EngineHeader;
+
+void
+write_engine_message(const int& socket_fd, const EngineMessageType& type, const Bytes& payload)
+{
+    EngineHeader header;
+    const uint32_t size = payload.size();
+    std::memcpy(header.data(), &size, sizeof(size));
+    header[4] = type;
+
+    // header and payload in a single system call
+    iovec buffers[2];
+    buffers[0].iov_base = header.data();
+    buffers[0].iov_len = header.size();
+    buffers[1].iov_base = const_cast<uint8_t*>(payload.data());
+    buffers[1].iov_len = payload.size();
+
+    iovec* buffer = buffers;
+    int buffer_count = payload.empty() ? 1 : 2;
+    while (buffer_count > 0)
+    {
+        const ssize_t written = writev(socket_fd, buffer, buffer_count);
+        if (written < 0)
+        {
+            if (errno == EINTR) continue;
+            throw std::runtime_error("engine socket write failed");
+        }
+
+        size_t remaining = written;
+        while (buffer_count > 0 && remaining >= buffer->iov_len)
+        {
+            remaining -= buffer->iov_len;
+            buffer++;
+            buffer_count--;
+        }
+        if (buffer_count > 0)
+        {
+            buffer->iov_base = static_cast<uint8_t*>(buffer->iov_base) + remaining;
+            buffer->iov_len -= remaining;
+        }
+    }
+}
+
+static
+bool
+read_exactly(const int& socket_fd, uint8_t* data, size_t size)
+{
+    while (size > 0)
+    {
+        const ssize_t count = read(socket_fd, data, size);
+        if (count == 0) return false;
+        if (count < 0)
+        {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += count;
+        size -= count;
+    }
+    return true;
+}
+
+bool
+read_engine_message(const int& socket_fd, EngineMessageType& type, Bytes& payload)
+{
+    static const uint32_t max_size = 1 << 20;
+
+    EngineHeader header;
+    if (!read_exactly(socket_fd, header.data(), header.size())) return false;
+
+    uint32_t size;
+    std::memcpy(&size, header.data(), sizeof(size));
+    if (size > max_size) throw std::runtime_error("oversized engine message");
+    type = static_cast<EngineMessageType>(header[4]);
+
+    payload.resize(size);
+    return size == 0 || read_exactly(socket_fd, payload.data(), size);
+}
+
+/****************************************/
+
+EngineClient::EngineClient(const std::string& socket_path) :
+    socket_fd(connect_engine_socket(socket_path)),
+    payload()
+{
+}
+
+EngineClient::EngineClient(const int& socket_fd) :
+    socket_fd(socket_fd),
+    payload()
+{
+}
+
+EngineClient::~EngineClient()
+{
+    close(socket_fd);
+}
+
+void
+EngineClient::request(const EngineMessageType& type, const EngineMessageType& expected_type)
+{
+    write_engine_message(socket_fd, type, payload);
+
+    EngineMessageType answer_type;
+    if (!read_engine_message(socket_fd, answer_type, payload)) throw std::runtime_error("engine daemon disconnected");
+    if (answer_type == ENGINE_FAILURE) throw std::runtime_error("engine daemon failure: " + std::string(payload.begin(), payload.end()));
+    if (answer_type != expected_type) throw std::runtime_error("unexpected engine answer");
+}
+
+double
+EngineClient::ping()
+{
+    const double start_time = get_double_time();
+    payload.clear();
+    request(ENGINE_PING, ENGINE_PONG);
+    return get_double_time()-start_time;
+}
+
+void
+EngineClient::start_game(const Game& game)
+{
+    encode_new_game(payload, game);
+    request(ENGINE_NEW_GAME, ENGINE_GAME_READY);
+}
+
+Direction
+EngineClient::get_move(const Game& game, const double& deadline)
+{
+    encode_move(payload, game, deadline-get_double_time());
+    request(ENGINE_MOVE, ENGINE_DIRECTION);
+    if (payload.size() != 1 || payload[0] > WEST) throw std::runtime_error("bad engine direction");
+    return static_cast<Direction>(payload[0]);
+}
+
+DeadlineQueue::DeadlineQueue() :
+    mutex(),
+    turn_changed(),
+    pending(),
+    next_ticket(0),
+    running_token(NULL)
+{
+}
+
+void
+DeadlineQueue::acquire(const double& deadline, CancellationToken& token)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    const Request request(deadline, next_ticket++);
+    pending.insert(request);
+
+    // the running search, the requests due first and this one share the
+    // time left before this deadline
+    if (running_token)
+    {
+        const double now = get_double_time();
+        const int sharing_count = std::distance(pending.begin(), pending.find(request))+2;
+        const double share_deadline = now + std::max(0., deadline-now)/sharing_count;
+        if (share_deadline < running_token->get_deadline()) running_token->set_deadline(share_deadline);
+    }
+
+    while (running_token || *pending.begin() != request)
+        turn_changed.wait(lock);
+
+    const double now = get_double_time();
+    const int sharing_count = pending.size();
+    pending.erase(pending.begin());
+    running_token = &token;
+
+    token.reset();
+    token.set_deadline(std::min(deadline, now + std::max(0., deadline-now)/sharing_count));
+}
+
+void
+DeadlineQueue::release()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running_token = NULL;
+    }
+    turn_changed.notify_all();
+}
+
+/****************************************/
+
+static
+void
+run_queued_search(DeadlineQueue& deadlines, const double& deadline, CancellationToken& token, const int& search_id, std::vector<int>& search_ids)
+{
+    deadlines.acquire(deadline, token);
+    search_ids.push_back(search_id); // searches are serialized by the queue
+    deadlines.release();
+}
+
+static
+void
+answer_pings(const int& socket_fd)
+{
+    EngineMessageType type;
+    Bytes payload;
+    while (read_engine_message(socket_fd, type, payload))
+    {
+        assert( type == ENGINE_PING );
+        write_engine_message(socket_fd, ENGINE_PONG, payload);
+    }
+    close(socket_fd);
+}
+
+void
+test_engine()
+{
+    std::cout << "Doing engine protocol test...\n";
+
+    const Tiles tiles = make_benchmark_tiles(18);
+    Game game(make_initial_state_json(tiles, 1200));
+    game.state.heroes[1].mines.insert(2);
+    game.state.heroes[2].gold = 123;
+    game.state.heroes[3].life = 42;
+
+    { // new game round trip
+        Bytes payload;
+        encode_new_game(payload, game);
+        const Game game_prime(decode_new_game(payload));
+        assert( game_prime.turn_max == game.turn_max );
+        assert( game_prime.background_tiles == game.background_tiles );
+        for (int kk=0; kk<4; kk++)
+            assert( game_prime.state.heroes[kk].spawn_position == game.state.heroes[kk].spawn_position );
+
+        // malformed boards are rejected before reaching parse_tiles
+        const Bytes valid_payload(payload);
+        const std::string tiles_string = serialize_tiles(game.background_tiles);
+        const size_t tiles_offset = std::search(payload.begin(), payload.end(), tiles_string.begin(), tiles_string.end())-payload.begin();
+        assert( tiles_offset < payload.size() );
+        for (int kk=0; kk<3; kk++)
+        {
+            payload = valid_payload;
+            if (kk == 0) payload[tiles_offset] = 'x'; // unknown tile
+            if (kk == 1) payload[tiles_offset] = '@'; // hero tile in a background board
+            if (kk == 2) payload[4] = Grid::max_size+1; // too large for a grid
+            bool is_rejected = false;
+            try { decode_new_game(payload); } catch (std::runtime_error&) { is_rejected = true; }
+            assert( is_rejected );
+        }
+    }
+
+    { // move round trip
+        for (int kk=0; kk<7; kk++)
+        {
+            game.state.update(static_cast<Direction>(kk%5));
+            game.turn++;
+        }
+
+        Bytes payload;
+        encode_move(payload, game, .25);
+        Game game_prime(make_initial_state_json(tiles, 1200));
+        const double budget = decode_move(payload, game_prime);
+        assert( std::abs(budget-.25) < 1e-6 );
+        assert( game_prime.turn == game.turn );
+        assert( game_prime.state == game.state );
+        assert( hash_value(game_prime.state) == hash_value(game.state) );
+        std::cout << "move " << payload.size() << "B" << std::endl;
+
+        payload.pop_back();
+        bool truncated_rejected = false;
+        try { decode_move(payload, game_prime); }
+        catch (std::runtime_error& error) { truncated_rejected = true; }
+        assert( truncated_rejected );
+    }
+
+    { // a request due before the running search cuts it to its share
+        DeadlineQueue deadlines;
+        const double start_time = get_double_time();
+        CancellationToken token;
+        deadlines.acquire(start_time+10, token);
+        assert( std::abs(token.get_deadline()-(start_time+10)) < 1e-3 );
+
+        std::vector<int> search_ids;
+        CancellationToken late_token;
+        std::thread late_search(run_queued_search, std::ref(deadlines), start_time+20, std::ref(late_token), 2, std::ref(search_ids));
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        assert( token.get_deadline() == start_time+10 ); // enough time left for both
+
+        CancellationToken early_token;
+        std::thread early_search(run_queued_search, std::ref(deadlines), start_time+1, std::ref(early_token), 1, std::ref(search_ids));
+        while (token.get_deadline() >= start_time+10) std::this_thread::yield();
+        assert( token.get_deadline() < start_time+.6 );
+        assert( !token.is_cancelled() );
+
+        deadlines.release();
+        early_search.join();
+        late_search.join();
+        assert( search_ids.size() == 2 && search_ids[0] == 1 && search_ids[1] == 2 );
+        assert( early_token.get_deadline() > start_time && early_token.get_deadline() <= start_time+1 );
+        assert( late_token.get_deadline() > start_time && late_token.get_deadline() <= start_time+20 );
+    }
+
+    { // round trip latency over a local socket pair
+        int socket_fds[2];
+        const int result = socketpair(AF_UNIX, SOCK_STREAM, 0, socket_fds);
+        assert( result == 0 );
+        std::thread server(answer_pings, socket_fds[1]);
+
+        double total = 0;
+        double best = 1;
+        const int ping_count = 10000;
+        {
+            EngineClient client(socket_fds[0]);
+            for (int kk=0; kk<ping_count; kk++)
+            {
+                const double round_trip = client.ping();
+                total += round_trip;
+                best = std::min(best, round_trip);
+            }
+        }
+        server.join();
+
+        std::cout << "ping " << 1e6*total/ping_count << "us mean " << 1e6*best << "us best" << std::endl;
+    }
+
+    std::cout << "...done!\n";
+}
+
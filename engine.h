@@ -0,0 +1,158 @@
+#pragma once
+
+#include "game.h"
+#include "scheduler.h"
+#include <vector>
+#include <string>
+#include <set>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+
+// Binary protocol between clients and a shared engine daemon over a Unix
+// domain socket. Each frame is a uint32 payload size, a uint8 message type
+// and the payload. Integers are sent in host order since both ends run on
+// the same machine.
+
+enum EngineMessageType
+{
+    ENGINE_PING = 1,
+    ENGINE_PONG,
+    ENGINE_NEW_GAME, // turn_max, board, spawn positions
+    ENGINE_GAME_READY,
+    ENGINE_MOVE, // budget and state snapshot, see snapshot.h
+    ENGINE_DIRECTION,
+    ENGINE_FAILURE // error text
+};
+
+typedef std::vector<uint8_t> Bytes;
+
+struct ByteWriter
+{
+    ByteWriter(Bytes& bytes);
+
+    template <typename T>
+    void
+    put(const T& value)
+    {
+        const uint8_t* data = reinterpret_cast<const uint8_t*>(&value);
+        bytes.insert(bytes.end(), data, data+sizeof(T));
+    }
+
+    void
+    put_string(const std::string& value);
+
+    Bytes& bytes;
+};
+
+struct ByteReader
+{
+    ByteReader(const Bytes& bytes);
+
+    template <typename T>
+    T
+    get()
+    {
+        T value;
+        read(&value, sizeof(T));
+        return value;
+    }
+
+    std::string
+    get_string();
+
+    bool
+    is_finished() const;
+
+private:
+
+    void
+    read(void* data, const size_t& size);
+
+    const Bytes& bytes;
+    size_t offset;
+};
+
+void
+encode_new_game(Bytes& payload, const Game& game);
+
+PTree
+decode_new_game(const Bytes& payload); // initial state json of the game
+
+void
+encode_move(Bytes& payload, const Game& game, const double& budget);
+
+double
+decode_move(const Bytes& payload, Game& game); // return the budget in seconds
+
+int
+listen_engine_socket(const std::string& path);
+
+int
+connect_engine_socket(const std::string& path);
+
+void
+write_engine_message(const int& socket_fd, const EngineMessageType& type, const Bytes& payload);
+
+bool
+read_engine_message(const int& socket_fd, EngineMessageType& type, Bytes& payload); // false on disconnection
+
+// Blocking client side of a daemon connection, one game at a time.
+struct EngineClient
+{
+    EngineClient(const std::string& socket_path);
+    explicit EngineClient(const int& socket_fd);
+    ~EngineClient();
+
+    double
+    ping(); // round trip in seconds
+
+    void
+    start_game(const Game& game);
+
+    Direction
+    get_move(const Game& game, const double& deadline);
+
+private:
+
+    EngineClient(const EngineClient& client); // no copy
+
+    void
+    request(const EngineMessageType& type, const EngineMessageType& expected_type);
+
+    int socket_fd;
+    Bytes payload;
+};
+
+// Searches of the daemon run one at a time on the whole worker pool,
+// earliest deadline first. Each search gets an equal share of its remaining
+// time with the requests queued when it starts, and a request queued later
+// with an earlier deadline cuts the running search to its share of the time
+// left before that deadline, so a burst of clients all get answered in time.
+struct DeadlineQueue
+{
+    DeadlineQueue();
+
+    /// Wait for the turn of a search due at deadline, then reset token to
+    /// its share. The token may be cut until release.
+    void
+    acquire(const double& deadline, CancellationToken& token);
+
+    void
+    release();
+
+private:
+
+    typedef std::pair<double, int> Request;
+    typedef std::set<Request> Requests;
+
+    std::mutex mutex;
+    std::condition_variable turn_changed;
+    Requests pending;
+    int next_ticket;
+    CancellationToken* running_token; // NULL when no search runs
+};
+
+void
+test_engine();
+
@@ -0,0 +1,181 @@
+#include "game.h"
+#include BOTINCLUDE
+#include "engine.h"
+#include "inference.h"
+#include "options.h"
+#include "logger.h"
+#include "scheduler.h"
+
+#include <thread>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <boost/scoped_ptr.hpp>
+
+#define ANSWER_MARGIN 1e-3
+
+struct Connection
+{
+    Connection(const int& socket_fd, const Options& options, const Rng& rng, BotTables& tables, DeadlineQueue& deadlines) :
+        socket_fd(socket_fd),
+        options(options),
+        rng(rng),
+        tables(tables),
+        deadlines(deadlines),
+        search_token(),
+        previous_turn(0),
+        previous_direction(STAY)
+    {
+    }
+
+    ~Connection()
+    {
+        close(socket_fd);
+    }
+
+    void
+    serve()
+    {
+        EngineMessageType type;
+        Bytes payload;
+        while (read_engine_message(socket_fd, type, payload))
+        {
+            try
+            {
+                answer(type, payload);
+            }
+            catch (std::exception& error)
+            {
+                LogLine(LOG_WARNING) << "engine request failed: " << error.what();
+                const std::string text = error.what();
+                write_engine_message(socket_fd, ENGINE_FAILURE, Bytes(text.begin(), text.end()));
+            }
+        }
+    }
+
+private:
+
+    void
+    answer(const EngineMessageType& type, Bytes& payload)
+    {
+        switch (type)
+        {
+        case ENGINE_PING:
+            write_engine_message(socket_fd, ENGINE_PONG, payload);
+            return;
+        case ENGINE_NEW_GAME:
+            bot.reset();
+            game.reset(new Game(decode_new_game(payload)));
+            bot.reset(new Bot(options, *game, rng, tables));
+            previous_state.reset();
+            payload.clear();
+            write_engine_message(socket_fd, ENGINE_GAME_READY, payload);
+            return;
+        case ENGINE_MOVE:
+        {
+            if (!game) throw std::runtime_error("no game started");
+            const double start_time = get_double_time();
+            const double budget = decode_move(payload, *game);
+            if (game->is_finished()) throw std::runtime_error("game is finished");
+
+            // the bot tables are only touched by the running search
+            deadlines.acquire(start_time + budget - ANSWER_MARGIN, search_token);
+            Direction direction = STAY;
+            try
+            {
+                advance_opponents();
+                direction = bot->get_move(*game, search_token);
+                bot->advance_game(*game, direction);
+            }
+            catch (...)
+            {
+                deadlines.release();
+                throw;
+            }
+            deadlines.release();
+
+            previous_state.reset(new State(game->state));
+            previous_turn = game->turn;
+            previous_direction = direction;
+
+            payload.assign(1, direction);
+            write_engine_message(socket_fd, ENGINE_DIRECTION, payload);
+            LogLine(LOG_INFO) << "turn " << game->turn << " direction " << direction << " answered in " << clock_it(get_double_time()-start_time);
+            return;
+        }
+        default:
+            throw std::runtime_error("unexpected engine message");
+        }
+    }
+
+    // replay on the bot the opponent moves since our last answer
+    void
+    advance_opponents()
+    {
+        if (!previous_state) return;
+        const int opponent_count = game->turn-previous_turn-1;
+        if (opponent_count < 0 || opponent_count > 3) return;
+        const MoveInference inference = infer_opponent_moves(game->background_grid, *previous_state, previous_direction, game->state, opponent_count);
+        if (inference.match_count == 0) return;
+        for (int kk=0; kk<opponent_count; kk++)
+            bot->advance_game(*game, inference.directions[kk]);
+    }
+
+    const int socket_fd;
+    const Options& options;
+    Rng rng;
+    BotTables& tables; // shared by every connection
+    DeadlineQueue& deadlines;
+    CancellationToken search_token; // cut by the queue when an earlier deadline comes in
+    boost::scoped_ptr<Game> game;
+    boost::scoped_ptr<Bot> bot;
+    boost::scoped_ptr<State> previous_state; // state our last answer was played from
+    int previous_turn;
+    Direction previous_direction;
+};
+
+static
+void
+serve_connection(Connection* connection)
+{
+    boost::scoped_ptr<Connection> owned_connection(connection);
+    try
+    {
+        owned_connection->serve();
+    }
+    catch (std::exception& error)
+    {
+        LogLine(LOG_WARNING) << "engine connection dropped: " << error.what();
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    signal(SIGPIPE, SIG_IGN); // clients may disconnect mid answer
+
+    const Options options = parse_options(argc, argv, true);
+
+    init_scheduler(options.threads, options.pin_threads);
+    get_logger().add_sink(new TextLogSink(std::cout, options.quiet ? LOG_WARNING : LOG_INFO));
+
+    const uint64_t seed = options.seed == 0 ? static_cast<uint64_t>(get_double_time()*1e6) : options.seed;
+    LogLine(LOG_WARNING) << "engine listening on " << options.engine_socket << " with " << get_scheduler().get_worker_count() << " workers, seed " << seed;
+
+    const int listen_fd = listen_engine_socket(options.engine_socket);
+    BotTables tables(options);
+    DeadlineQueue deadlines;
+    StreamRng master_rng(seed);
+
+    for (int connection_index=0; true; connection_index++)
+    {
+        const int socket_fd = accept(listen_fd, NULL, NULL);
+        if (socket_fd < 0) continue;
+
+        // each connection gets its own stream so games replay from the seed
+        Connection* connection = new Connection(socket_fd, options, master_rng.get_stream(connection_index), tables, deadlines);
+        std::thread(serve_connection, connection).detach();
+    }
+
+    return 0;
+}
+
@@ -0,0 +1,247 @@
+#include "evaluation.h"
+
+#include "alphabeta.h"
+#include "game.h"
+#include "policy.h"
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+
+Utilities
+get_utilities(const State& state, const int& turns_left)
+{
+    boost::array<int, 4> scores;
+    for (int kk=0; kk<4; kk++)
+    {
+        const State::Hero& hero = state.heroes[kk];
+        scores[kk] = 10*(hero.gold + hero.mines.size()*get_moves_left(state, turns_left, kk));
+        if (turns_left > 0) scores[kk] += hero.life/10;
+    }
+
+    Utilities utilities;
+    for (int kk=0; kk<4; kk++)
+    {
+        int best_other = scores[(kk+1)%4];
+        for (int ll=0; ll<4; ll++)
+            if (ll != kk) best_other = std::max(best_other, scores[ll]);
+        utilities[kk] = scores[kk]-best_other;
+    }
+
+    return utilities;
+}
+
+EvaluationWeights
+load_evaluation_weights(const std::string& path)
+{
+    std::ifstream handle(path.c_str());
+    if (!handle) throw std::runtime_error("can't read evaluation weights " + path);
+
+    EvaluationWeights weights;
+    std::string line;
+    for (int line_number=1; std::getline(handle, line); line_number++)
+    {
+        const size_t comment = line.find('#');
+        if (comment != std::string::npos) line.erase(comment);
+
+        std::stringstream stream(line);
+        std::string name;
+        if (!(stream >> name)) continue;
+
+        float weight;
+        std::string rest;
+        if (!(stream >> weight) || stream >> rest)
+        {
+            std::stringstream message;
+            message << "malformed evaluation weight " << path << ":" << line_number;
+            throw std::runtime_error(message.str());
+        }
+        weights[name] = weight;
+    }
+
+    return weights;
+}
+
+Utilities
+get_margins(const boost::array<float, 4>& scores)
+{
+    Utilities utilities;
+    for (int kk=0; kk<4; kk++)
+    {
+        float best_other = scores[(kk+1)%4];
+        for (int ll=0; ll<4; ll++)
+            if (ll != kk) best_other = std::max(best_other, scores[ll]);
+        utilities[kk] = static_cast<int>(std::floor(scores[kk]-best_other+.5f));
+    }
+    return utilities;
+}
+
+DefaultEvaluator
+make_default_evaluator(const Grid& grid, const std::string& path)
+{
+    // projected gold and a tenth of life as get_utilities, the other
+    // features only count when a weights file sets them
+    DefaultEvaluator::Weights weights = {{10, .1, 0, 0}};
+    if (path.empty()) return DefaultEvaluator(grid, weights);
+    return DefaultEvaluator(grid, weights, load_evaluation_weights(path));
+}
+
+// Feature types are not used by value, so a whole list of them costs nothing.
+struct CountedFeature
+{
+    static const char* get_name() { return "counted"; }
+
+    static
+    int
+    get_value(const Grid& grid, const State& state, const int& turns_left, const int& hero_index)
+    {
+        return hero_index+1;
+    }
+};
+
+void
+test_evaluation()
+{
+    std::cout << "Doing leaf evaluation test...\n";
+
+    assert( DefaultFeatures::size == 4 );
+    assert( (FeatureList<CountedFeature, FeatureList<CountedFeature> >::size) == 2 );
+
+    // weights files override the defaults by name
+    {
+        char path[] = "/tmp/vindinium_weights_XXXXXX";
+        const int fd = mkstemp(path);
+        assert( fd >= 0 );
+        close(fd);
+        {
+            std::ofstream handle(path);
+            handle << "# tuned offline\n\nlife .5\ncontested_mines -40 # a mine is worth more\n";
+        }
+        const EvaluationWeights weights = load_evaluation_weights(path);
+        assert( weights.size() == 2 );
+        assert( weights.find("life")->second == .5f );
+
+        {
+            std::ofstream handle(path);
+            handle << "life .5 1\n";
+        }
+        bool is_rejected = false;
+        try { load_evaluation_weights(path); } catch (std::runtime_error&) { is_rejected = true; }
+        assert( is_rejected );
+
+        {
+            std::ofstream handle(path);
+            handle << "lives .5\n";
+        }
+        const Grid grid(neutralize_tiles(make_benchmark_tiles(12)));
+        is_rejected = false;
+        try { make_default_evaluator(grid, path); } catch (std::runtime_error&) { is_rejected = true; }
+        assert( is_rejected );
+        std::remove(path);
+
+        const DefaultEvaluator evaluator(grid, make_default_evaluator(grid).weights, weights);
+        assert( evaluator.weights[0] == 10 && evaluator.weights[1] == .5f && evaluator.weights[3] == -40 );
+    }
+
+    // states along a game of the mixed policy, so heroes hold and fight for mines
+    const Game game(make_initial_state_json(make_benchmark_tiles(18), 1200));
+    const Grid& grid = game.background_grid;
+    const PathCache cache(grid);
+    const MixedPolicy policy = make_mixed_policy(cache);
+    Rng rng(42);
+    std::vector<State> states;
+    std::vector<int> turns_lefts;
+    State state(game.state);
+    for (int turn=0; turn<1024; turn++)
+    {
+        states.push_back(state);
+        turns_lefts.push_back(1200-turn);
+        state.update(policy(state, rng));
+    }
+
+    // the defaults are get_utilities up to the rounding of life
+    const DefaultEvaluator evaluator = make_default_evaluator(grid);
+    int contested_count = 0;
+    for (int kk=0; kk<static_cast<int>(states.size()); kk++)
+    {
+        const Utilities utilities = get_utilities(states[kk], turns_lefts[kk]);
+        const Utilities utilities_prime = evaluator.get_utilities(states[kk], turns_lefts[kk]);
+        for (int ll=0; ll<4; ll++)
+        {
+            assert( std::abs(utilities[ll]-utilities_prime[ll]) <= 2 );
+            contested_count += ContestedMinesFeature::get_value(grid, states[kk], turns_lefts[kk], ll);
+        }
+    }
+
+    // batches score like single states
+    std::vector<float> values;
+    std::vector<float> scores;
+    evaluator.get_scores(states, turns_lefts, values, scores);
+    assert( scores.size() == 4*states.size() );
+    for (int kk=0; kk<static_cast<int>(states.size()); kk++)
+        for (int ll=0; ll<4; ll++)
+            assert( std::abs(scores[4*kk+ll]-evaluator.get_score(states[kk], turns_lefts[kk], ll)) < 1e-2 );
+
+    const int repeat = 200;
+    double checksum = 0;
+
+    double start_time = get_double_time();
+    for (int kk=0; kk<repeat; kk++)
+        for (int ll=0; ll<static_cast<int>(states.size()); ll++)
+            checksum += get_utilities(states[ll], turns_lefts[ll])[0];
+    const double reference_time = get_double_time()-start_time;
+
+    start_time = get_double_time();
+    for (int kk=0; kk<repeat; kk++)
+        for (int ll=0; ll<static_cast<int>(states.size()); ll++)
+            checksum += evaluator.get_utilities(states[ll], turns_lefts[ll])[0];
+    const double single_time = get_double_time()-start_time;
+
+    // only the features of the list are paid for
+    typedef LeafEvaluator<FeatureList<ProjectedGoldFeature, FeatureList<LifeFeature> > > GoldLifeEvaluator;
+    const GoldLifeEvaluator::Weights gold_life_weights = {{10, .1}};
+    const GoldLifeEvaluator gold_life_evaluator(grid, gold_life_weights);
+    start_time = get_double_time();
+    for (int kk=0; kk<repeat; kk++)
+        for (int ll=0; ll<static_cast<int>(states.size()); ll++)
+            checksum += gold_life_evaluator.get_utilities(states[ll], turns_lefts[ll])[0];
+    const double gold_life_time = get_double_time()-start_time;
+
+    start_time = get_double_time();
+    for (int kk=0; kk<repeat; kk++)
+    {
+        evaluator.get_scores(states, turns_lefts, values, scores);
+        checksum += scores[0];
+    }
+    const double batch_time = get_double_time()-start_time;
+
+    start_time = get_double_time();
+    for (int kk=0; kk<repeat; kk++)
+        for (int ll=0; ll<static_cast<int>(states.size()); ll++)
+            checksum += states[ll].get_ranks()[0];
+    const double ranks_time = get_double_time()-start_time;
+
+    // searches pay for the extra features in nodes per second
+    for (int weighted=0; weighted<2; weighted++)
+    {
+        DefaultEvaluator::Weights weights = evaluator.weights;
+        weights[2] = -2;
+        weights[3] = -100;
+        const DefaultEvaluator search_evaluator(grid, weights);
+        TranspositionTable table(16*1024*1024);
+        CancellationToken token;
+        AlphaBetaSearch search(grid, game.symmetries, table, false, weighted ? &search_evaluator : NULL);
+        const double search_start_time = get_double_time();
+        search.run(states[512], turns_lefts[512], token, 1, 8);
+        const double search_end_time = get_double_time();
+        assert( search.completed_depth == 8 );
+        std::cout << (weighted ? "evaluator" : "get_utilities") << " leaves depth 8 " << search.node_count << " nodes " << static_cast<int>(1e-3*search.node_count/(search_end_time-search_start_time)) << "knode/s" << std::endl;
+    }
+
+    const double payload = static_cast<double>(repeat)*states.size();
+    std::cout << contested_count << " contested mines get_utilities " << static_cast<int>(1e-3*payload/reference_time) << "keval/s evaluator " << static_cast<int>(1e-3*payload/single_time) << "keval/s gold and life only " << static_cast<int>(1e-3*payload/gold_life_time) << "keval/s batch " << static_cast<int>(1e-3*payload/batch_time) << "keval/s get_ranks " << static_cast<int>(1e-3*payload/ranks_time) << "keval/s (" << static_cast<int64_t>(checksum)%1000 << ")" << std::endl;
+
+    std::cout << "...done!\n";
+}
+
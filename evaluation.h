@@ -0,0 +1,250 @@
+#pragma once
+
+#include "state.h"
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <boost/array.hpp>
+
+// Leaf evaluation built from features. A feature is a stateless type scoring
+// one hero of a state:
+//
+//     static const char* get_name();
+//     static int get_value(const Grid& grid, const State& state, const int& turns_left, const int& hero_index);
+//
+// Features are chained at compile time with FeatureList, so the evaluator
+// of a list is one inlined weighted sum. Weights are in tenths of gold, the
+// unit of get_utilities.
+
+typedef boost::array<int, 4> Utilities;
+
+/// Projected gold margin of each hero over its best opponent, in tenths of
+/// gold with life as a tie break. Exact final margins when turns_left is 0.
+Utilities
+get_utilities(const State& state, const int& turns_left);
+
+/// Moves hero_index still plays when turns_left half turns remain.
+inline
+int
+get_moves_left(const State& state, const int& turns_left, const int& hero_index)
+{
+    const int offset = (hero_index-state.next_hero_index+4) % 4;
+    return std::max(0, (turns_left-offset+3) / 4);
+}
+
+// Gold at the end of the game if the hero keeps its mines.
+struct ProjectedGoldFeature
+{
+    static const char* get_name() { return "projected_gold"; }
+
+    static
+    int
+    get_value(const Grid& grid, const State& state, const int& turns_left, const int& hero_index)
+    {
+        const State::Hero& hero = state.heroes[hero_index];
+        return hero.gold + hero.mines.size()*get_moves_left(state, turns_left, hero_index);
+    }
+};
+
+struct LifeFeature
+{
+    static const char* get_name() { return "life"; }
+
+    static
+    int
+    get_value(const Grid& grid, const State& state, const int& turns_left, const int& hero_index)
+    {
+        return state.heroes[hero_index].life;
+    }
+};
+
+// Moves to the closest tavern, 0 when none is reachable.
+struct TavernDistanceFeature
+{
+    static const char* get_name() { return "tavern_distance"; }
+
+    static
+    int
+    get_value(const Grid& grid, const State& state, const int& turns_left, const int& hero_index)
+    {
+        return std::max<int>(0, grid.tavern_distances[grid.get_index(state.heroes[hero_index].position)]);
+    }
+};
+
+// Mines of the hero an opponent can take with its next move.
+struct ContestedMinesFeature
+{
+    static const char* get_name() { return "contested_mines"; }
+
+    static
+    int
+    get_value(const Grid& grid, const State& state, const int& turns_left, const int& hero_index)
+    {
+        const State::Hero& hero = state.heroes[hero_index];
+        if (hero.mines.size() == 0) return 0;
+
+        // an opponent next to a mine of the hero, the same mine only counts once
+        boost::array<MineId, 12> contested;
+        int contested_count = 0;
+        for (int kk=0; kk<4; kk++)
+        {
+            if (kk == hero_index) continue;
+            const PositionIndex index = grid.get_index(state.heroes[kk].position);
+            for (int direction=NORTH; direction<=WEST; direction++)
+            {
+                const MineId mine_id = grid.get_mine_id(grid.get_neighbor(index, static_cast<Direction>(direction)));
+                if (mine_id == Grid::no_mine || !hero.mines.contains(mine_id)) continue;
+                if (std::find(contested.begin(), contested.begin()+contested_count, mine_id) != contested.begin()+contested_count) continue;
+                contested[contested_count++] = mine_id;
+            }
+        }
+        return contested_count;
+    }
+};
+
+struct NoFeature
+{
+    static const int size = 0;
+
+    static
+    float
+    accumulate(const Grid& grid, const State& state, const int& turns_left, const int& hero_index, const float* weights)
+    {
+        return 0;
+    }
+
+    static
+    void
+    fill_values(const Grid& grid, const State& state, const int& turns_left, const int& hero_index, float* values, const int& stride)
+    {
+    }
+
+    static
+    void
+    get_names(std::vector<std::string>& names)
+    {
+    }
+};
+
+// Compile time list of features, Feature first then the ones of Next.
+template <typename Feature, typename Next=NoFeature>
+struct FeatureList
+{
+    static const int size = 1+Next::size;
+
+    static
+    float
+    accumulate(const Grid& grid, const State& state, const int& turns_left, const int& hero_index, const float* weights)
+    {
+        return weights[0]*Feature::get_value(grid, state, turns_left, hero_index) + Next::accumulate(grid, state, turns_left, hero_index, weights+1);
+    }
+
+    // Value of each feature, stride floats apart.
+    static
+    void
+    fill_values(const Grid& grid, const State& state, const int& turns_left, const int& hero_index, float* values, const int& stride)
+    {
+        values[0] = Feature::get_value(grid, state, turns_left, hero_index);
+        Next::fill_values(grid, state, turns_left, hero_index, values+stride, stride);
+    }
+
+    static
+    void
+    get_names(std::vector<std::string>& names)
+    {
+        names.push_back(Feature::get_name());
+        Next::get_names(names);
+    }
+};
+
+typedef std::map<std::string, float> EvaluationWeights;
+
+/// Feature weights from a text file, one "name weight" pair per line, '#'
+/// starting a comment. Throws std::runtime_error on unreadable files and
+/// malformed lines.
+EvaluationWeights
+load_evaluation_weights(const std::string& path);
+
+/// Margin of each hero over its best opponent.
+Utilities
+get_margins(const boost::array<float, 4>& scores);
+
+template <typename Features>
+struct LeafEvaluator
+{
+    typedef boost::array<float, Features::size> Weights;
+
+    /// Weights missing from the map keep their default, names that are not
+    /// features of the list throw std::runtime_error.
+    LeafEvaluator(const Grid& grid, const Weights& default_weights, const EvaluationWeights& overrides=EvaluationWeights()) :
+        grid(grid),
+        weights(default_weights)
+    {
+        std::vector<std::string> names;
+        Features::get_names(names);
+        for (EvaluationWeights::const_iterator wi=overrides.begin(), wie=overrides.end(); wi!=wie; wi++)
+        {
+            const std::vector<std::string>::const_iterator ni = std::find(names.begin(), names.end(), wi->first);
+            if (ni == names.end()) throw std::runtime_error("unknown evaluation feature " + wi->first);
+            weights[ni-names.begin()] = wi->second;
+        }
+    }
+
+    float
+    get_score(const State& state, const int& turns_left, const int& hero_index) const
+    {
+        return Features::accumulate(grid, state, turns_left, hero_index, weights.data());
+    }
+
+    /// Same units and sign as get_utilities.
+    Utilities
+    get_utilities(const State& state, const int& turns_left) const
+    {
+        boost::array<float, 4> scores;
+        for (int kk=0; kk<4; kk++)
+            scores[kk] = get_score(state, turns_left, kk);
+        return get_margins(scores);
+    }
+
+    /// Scores of every hero of every state, 4 per state. Feature values are
+    /// gathered in one pass over the states into a column per feature, then
+    /// weighted in straight loops the compiler vectorizes.
+    void
+    get_scores(const std::vector<State>& states, const std::vector<int>& turns_lefts, std::vector<float>& values, std::vector<float>& scores) const
+    {
+        assert( states.size() == turns_lefts.size() );
+        const int column_size = 4*states.size();
+        values.resize(Features::size*column_size);
+        for (int kk=0; kk<static_cast<int>(states.size()); kk++)
+            for (int ll=0; ll<4; ll++)
+                Features::fill_values(grid, states[kk], turns_lefts[kk], ll, values.data()+4*kk+ll, column_size);
+
+        scores.assign(column_size, 0);
+        float* scores_data = scores.data();
+        for (int kk=0; kk<Features::size; kk++)
+        {
+            const float weight = weights[kk];
+            const float* column = values.data() + kk*column_size;
+            for (int ll=0; ll<column_size; ll++)
+                scores_data[ll] += weight*column[ll];
+        }
+    }
+
+    const Grid& grid;
+    Weights weights;
+};
+
+typedef FeatureList<ProjectedGoldFeature, FeatureList<LifeFeature, FeatureList<TavernDistanceFeature, FeatureList<ContestedMinesFeature> > > > DefaultFeatures;
+
+typedef LeafEvaluator<DefaultFeatures> DefaultEvaluator;
+
+/// get_utilities as a DefaultEvaluator, then weights of the file at path
+/// when not empty.
+DefaultEvaluator
+make_default_evaluator(const Grid& grid, const std::string& path="");
+
+void
+test_evaluation();
+
@@ -1,13 +1,16 @@
 #include "game.h"
 
 #include <boost/regex.hpp>
+#include <boost/functional/hash.hpp>
 
 Game::Game(const PTree& root) :
     background_tiles(get_background_tiles(root.get_child("game.board"))),
     hashed_background_tiles(make_hashed_pair(background_tiles)),
+    background_grid(background_tiles),
     turn_max(root.get<int>("game.maxTurns")),
     turn(root.get<int>("game.turn")),
-    state(root, hashed_background_tiles)
+    state(root, hashed_background_tiles, background_grid),
+    symmetries(background_grid, state)
 {
     assert( state == state );
     assert( hash_value(state) == hash_value(state) );
@@ -31,9 +34,15 @@ Game::Game(const PTree& root) :
 
 void
 Game::status(std::ostream& os) const
+{
+    status(os, state, turn);
+}
+
+void
+Game::status(std::ostream& os, const State& state, const int& turn) const
 {
     os << "turn " << turn << "/" << turn_max;
-    if (is_finished()) os << " finished";
+    if (turn >= turn_max) os << " finished";
     os << std::endl;
 
     const int winner_id = state.get_winner();
@@ -49,7 +58,7 @@ Game::status(std::ostream& os) const
         os << "\033[" << colors[kk] << "m" << hero_info.name << "\033[0m";
         if (hero_info.is_real_bot()) os << "(" << hero_info.elo << ")";
         if (hero_info.crashed) {
-            std::cout << " (crashed)";
+            os << " (crashed)";
         }
         os << std::endl;
     }
@@ -63,6 +72,15 @@ Game::is_finished() const
     return turn >= turn_max;
 }
 
+Hash
+Game::get_map_key() const
+{
+    Hash seed = hashed_background_tiles.hash;
+    for (int kk=0; kk<4; kk++)
+        boost::hash_combine(seed, state.heroes[kk].spawn_position);
+    return seed;
+}
+
 void
 Game::update(const PTree& root)
 {
@@ -2,6 +2,7 @@
 
 #include "hashed.h"
 #include "state.h"
+#include "symmetry.h"
 
 struct Game
 {
@@ -26,6 +27,10 @@ struct Game
     bool
     is_finished() const;
 
+    /// Same for every game on this board with these spawns.
+    Hash
+    get_map_key() const;
+
     void
     update(const Direction& direction);
 
@@ -35,8 +40,12 @@ struct Game
     void
     status(std::ostream& os) const;
 
+    void
+    status(std::ostream& os, const State& state, const int& turn) const;
+
     const Tiles background_tiles;
     const HashedPair<Tiles> hashed_background_tiles;
+    const Grid background_grid;
     const HeroInfos hero_infos;
 
     const int turn_max;
@@ -44,6 +53,8 @@ struct Game
 
     State state;
 
+    const SymmetryGroup symmetries; // of the board and the spawns
+
 private:
 
     Game&
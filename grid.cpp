@@ -0,0 +1,344 @@
+#include "grid.h"
+
+#include <cassert>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <boost/functional/hash.hpp>
+
+const int MineSet::capacity;
+const MineId Grid::no_mine;
+const int Grid::max_size;
+
+static_assert( (Grid::max_size+2)*(Grid::max_size+2) <= Bitboard::capacity, "boards up to max_size fit a Bitboard" );
+
+MineSet::MineSet()
+{
+    clear();
+}
+
+void
+MineSet::merge(const MineSet& mine_set)
+{
+    for (size_t kk=0; kk<words.size(); kk++)
+        words[kk] |= mine_set.words[kk];
+}
+
+void
+MineSet::clear()
+{
+    std::fill(words.begin(), words.end(), 0);
+}
+
+int
+MineSet::size() const
+{
+    int count = 0;
+    for (size_t kk=0; kk<words.size(); kk++)
+        count += __builtin_popcountll(words[kk]);
+    return count;
+}
+
+bool
+operator==(const MineSet& mine_set_aa, const MineSet& mine_set_bb)
+{
+    return mine_set_aa.words == mine_set_bb.words;
+}
+
+bool
+operator!=(const MineSet& mine_set_aa, const MineSet& mine_set_bb)
+{
+    return mine_set_aa.words != mine_set_bb.words;
+}
+
+Hash
+hash_value(const MineSet& mine_set)
+{
+    return boost::hash_range(mine_set.words.begin(), mine_set.words.end());
+}
+
+template <typename Dimension>
+static
+void
+fill_distances_kernel(const Grid& grid, const PositionIndex& source, Distances& distances)
+{
+    distances.assign(Dimension::get_cell_count(grid), -1);
+
+    typename Dimension::IndexBuffer queue;
+    Dimension::init_buffer(grid, queue);
+
+    int head = 0;
+    int tail = 0;
+    distances[source] = 0;
+    queue[tail++] = source;
+
+    while (head < tail)
+    {
+        const PositionIndex current = queue[head++];
+        const Distance next_distance = distances[current]+1;
+
+        for (int direction=NORTH; direction<=WEST; direction++)
+        {
+            const PositionIndex neighbor = current + Dimension::get_offset(grid, static_cast<Direction>(direction));
+            if (distances[neighbor] >= 0) continue;
+
+            const Tile tile = grid.get_tile(neighbor);
+            if (tile == UNKNOWN || tile == WOOD) continue;
+
+            distances[neighbor] = next_distance;
+            if (tile == EMPTY) queue[tail++] = neighbor;
+        }
+    }
+}
+
+// Reversed BFS from every tavern at once. A hero walks empty cells then
+// steps into the tavern, so only empty cells are expanded.
+static
+void
+fill_tavern_distances(const Grid& grid, Distances& distances)
+{
+    distances.assign(grid.cells.size(), -1);
+
+    std::vector<PositionIndex> queue;
+    queue.reserve(grid.cells.size());
+    for (int index=0; index<static_cast<int>(grid.cells.size()); index++)
+        if (grid.get_tile(index) == TAVERN)
+        {
+            distances[index] = 0;
+            queue.push_back(index);
+        }
+
+    for (size_t head=0; head<queue.size(); head++)
+    {
+        const PositionIndex current = queue[head];
+        for (int direction=NORTH; direction<=WEST; direction++)
+        {
+            const PositionIndex neighbor = grid.get_neighbor(current, static_cast<Direction>(direction));
+            if (distances[neighbor] >= 0 || !grid.passable.test(neighbor)) continue;
+            distances[neighbor] = distances[current]+1;
+            queue.push_back(neighbor);
+        }
+    }
+}
+
+static
+GridKernels
+select_grid_kernels(const int& dimension)
+{
+    GridKernels kernels;
+    kernels.fill_distances = fill_distances_kernel<GenericDimension>;
+
+#define GRID_SELECT_KERNELS(size) \
+    case size: \
+        kernels.fill_distances = fill_distances_kernel<FixedDimension<size> >; \
+        break;
+
+    switch (dimension)
+    {
+    GRID_FOR_EACH_DIMENSION(GRID_SELECT_KERNELS)
+    }
+
+#undef GRID_SELECT_KERNELS
+
+    return kernels;
+}
+
+bool
+is_specialized_dimension(const int& size)
+{
+#define GRID_IS_DIMENSION(dimension_size) if (size == dimension_size) return true;
+    GRID_FOR_EACH_DIMENSION(GRID_IS_DIMENSION)
+#undef GRID_IS_DIMENSION
+    return false;
+}
+
+Grid::Grid(const Tiles& tiles, const bool& specialize) :
+    size(tiles.shape()[0]),
+    stride(size+2),
+    dimension(specialize && is_specialized_dimension(size) ? size : 0),
+    cells(stride*stride, static_cast<Cell>(UNKNOWN)),
+    mines(),
+    mine_ids(stride*stride, no_mine),
+    passable(),
+    taverns(),
+    mine_cells(),
+    tavern_distances(),
+    symmetries(detect_symmetries(tiles)),
+    kernels(select_grid_kernels(dimension))
+{
+    assert( tiles.shape()[0] == tiles.shape()[1] );
+    if (size > max_size)
+    {
+        std::stringstream message;
+        message << size << "x" << size << " board past the " << max_size << "x" << max_size << " grid";
+        throw std::runtime_error(message.str());
+    }
+    assert( cells.size() <= static_cast<size_t>(std::numeric_limits<PositionIndex>::max())+1 );
+    assert( cells.size() <= static_cast<size_t>(Bitboard::capacity) );
+
+    offsets[STAY] = 0;
+    offsets[NORTH] = -stride;
+    offsets[SOUTH] = stride;
+    offsets[EAST] = 1;
+    offsets[WEST] = -1;
+
+    for (int ii=0; ii<size; ii++)
+        for (int jj=0; jj<size; jj++)
+            cells[get_index(Position(ii,jj))] = static_cast<Cell>(tiles[ii][jj]);
+
+    for (int index=0; index<static_cast<int>(cells.size()); index++)
+    {
+        const Tile tile = get_tile(index);
+        if (tile == EMPTY || tile == HERO1 || tile == HERO2 || tile == HERO3 || tile == HERO4) passable.set(index);
+        if (tile == TAVERN) taverns.set(index);
+        if (tile != MINE && tile != MINE1 && tile != MINE2 && tile != MINE3 && tile != MINE4) continue;
+        assert( mines.size() < static_cast<size_t>(MineSet::capacity) );
+        mine_ids[index] = mines.size();
+        mines.push_back(index);
+        mine_cells.set(index);
+    }
+
+    fill_tavern_distances(*this, tavern_distances);
+}
+
+bool
+Grid::in_board(const Position& position) const
+{
+    return position.x >= 0 && position.y >= 0 && position.x < size && position.y < size;
+}
+
+bool
+Grid::in_padded_board(const Position& position) const
+{
+    return position.x >= -1 && position.y >= -1 && position.x <= size && position.y <= size;
+}
+
+Grid
+parse_grid(const int& tiles_size, const std::string& tiles_string)
+{
+    return Grid(parse_tiles(tiles_size, tiles_string));
+}
+
+Tiles
+to_tiles(const Grid& grid)
+{
+    Tiles tiles(boost::extents[grid.size][grid.size]);
+
+    for (int ii=0; ii<grid.size; ii++)
+        for (int jj=0; jj<grid.size; jj++)
+            tiles[ii][jj] = grid.get_tile(grid.get_index(Position(ii,jj)));
+
+    return tiles;
+}
+
+MineSet
+make_mine_set(const Grid& grid, const PositionsSet& mine_positions)
+{
+    MineSet mine_set;
+    for (PositionsSet::const_iterator mi=mine_positions.begin(), mie=mine_positions.end(); mi!=mie; mi++)
+    {
+        const MineId mine_id = grid.get_mine_id(grid.get_index(*mi));
+        assert( mine_id != Grid::no_mine );
+        mine_set.insert(mine_id);
+    }
+    return mine_set;
+}
+
+Hash
+hash_value(const Grid& grid)
+{
+    return hash_value(to_tiles(grid));
+}
+
+Tile
+get_tile(const Grid& grid, const Position& position)
+{
+    assert( grid.in_board(position) );
+    return grid.get_tile(grid.get_index(position));
+}
+
+Tile
+get_tile_border_check(const Grid& grid, const Position& position)
+{
+    if (!grid.in_padded_board(position)) return UNKNOWN;
+    return grid.get_tile(grid.get_index(position));
+}
+
+void
+fill_distances(const Grid& grid, const PositionIndex& source, Distances& distances)
+{
+    grid.kernels.fill_distances(grid, source, distances);
+}
+
+std::ostream&
+operator<<(std::ostream& os, const Grid& grid)
+{
+    return os << to_tiles(grid);
+}
+
+void
+test_grid()
+{
+    std::cout << "Doing grid test...\n";
+
+    { // boards up to max_size fit the bitboards, larger ones are rejected
+        const Grid largest_grid(neutralize_tiles(make_benchmark_tiles(Grid::max_size)));
+        assert( largest_grid.size == Grid::max_size );
+        bool is_rejected = false;
+        try { Grid(neutralize_tiles(make_benchmark_tiles(Grid::max_size+2))); } catch (std::runtime_error&) { is_rejected = true; }
+        assert( is_rejected );
+    }
+
+    for (int size=10; size<=28; size+=2)
+    {
+        const Tiles tiles = neutralize_tiles(make_benchmark_tiles(size));
+        const Grid fixed_grid(tiles);
+        const Grid generic_grid(tiles, false);
+        assert( fixed_grid.dimension == size );
+        assert( generic_grid.dimension == 0 );
+        assert( to_tiles(fixed_grid) == tiles );
+        assert( hash_value(fixed_grid) == hash_value(tiles) );
+        assert( fixed_grid.cells.size() < 1024 );
+
+        for (int ii=-1; ii<=size; ii++)
+            for (int jj=-1; jj<=size; jj++)
+            {
+                const Position position(ii,jj);
+                assert( fixed_grid.get_position(fixed_grid.get_index(position)) == position );
+                assert( get_tile_border_check(fixed_grid, position) == get_tile_border_check(tiles, position) );
+            }
+
+        const PositionIndex source = fixed_grid.get_index(Position(0,0));
+        Distances fixed_distances;
+        Distances generic_distances;
+        fill_distances(fixed_grid, source, fixed_distances);
+        fill_distances(generic_grid, source, generic_distances);
+        assert( fixed_distances == generic_distances );
+        assert( fixed_distances[source] == 0 );
+        assert( fixed_distances[fixed_grid.get_index(Position(0,1))] == 1 );
+        assert( fixed_distances[fixed_grid.get_index(Position(-1,0))] == -1 );
+
+        const int payload = 200000/size;
+        double fixed_delta = 0;
+        double generic_delta = 0;
+        for (int pass=0; pass<2; pass++)
+        {
+            const Grid& grid = pass == 0 ? fixed_grid : generic_grid;
+            Distances distances;
+            const double start_time = get_double_time();
+            for (int kk=0; kk<payload; kk++)
+                fill_distances(grid, grid.get_index(Position(kk%size, 0)), distances);
+            const double end_time = get_double_time();
+            (pass == 0 ? fixed_delta : generic_delta) = end_time-start_time;
+        }
+
+        std::cout << "bfs " << size << "x" << size;
+        std::cout << " fixed " << static_cast<int>(1e-3*payload/fixed_delta) << "kbfs/s";
+        std::cout << " generic " << static_cast<int>(1e-3*payload/generic_delta) << "kbfs/s";
+        std::cout << " speedup " << generic_delta/fixed_delta << std::endl;
+    }
+
+    std::cout << "...done!\n";
+}
+
@@ -0,0 +1,217 @@
+#pragma once
+
+#include "tiles.h"
+#include "bitboard.h"
+#include <vector>
+#include <boost/array.hpp>
+
+typedef int16_t Distance;
+typedef std::vector<Distance> Distances;
+
+typedef uint8_t MineId;
+
+// Fixed capacity set of mine ids, copied and hashed without allocating.
+struct MineSet
+{
+    typedef boost::array<uint64_t, 4> Words;
+
+    static const int capacity = 255;
+
+    MineSet();
+
+    bool
+    contains(const MineId& mine_id) const
+    {
+        return (words[mine_id >> 6] >> (mine_id & 63)) & 1;
+    }
+
+    void
+    insert(const MineId& mine_id)
+    {
+        words[mine_id >> 6] |= static_cast<uint64_t>(1) << (mine_id & 63);
+    }
+
+    void
+    erase(const MineId& mine_id)
+    {
+        words[mine_id >> 6] &= ~(static_cast<uint64_t>(1) << (mine_id & 63));
+    }
+
+    void
+    merge(const MineSet& mine_set);
+
+    void
+    clear();
+
+    int
+    size() const;
+
+    Words words;
+};
+
+bool
+operator==(const MineSet& mine_set_aa, const MineSet& mine_set_bb);
+
+bool
+operator!=(const MineSet& mine_set_aa, const MineSet& mine_set_bb);
+
+Hash
+hash_value(const MineSet& mine_set);
+
+struct Grid;
+
+struct GridKernels
+{
+    void (*fill_distances)(const Grid& grid, const PositionIndex& source, Distances& distances);
+};
+
+// Flat byte copy of a square Tiles board padded with a one tile UNKNOWN border.
+// Cells are addressed by PositionIndex, neighbors are index+offsets[direction]
+// and never need a bounds check. A 28x28 board takes (28+2)^2 = 900 bytes.
+// Boards past max_size throw std::runtime_error, their padded cells would
+// not fit the bitboards.
+struct Grid
+{
+    typedef uint8_t Cell;
+    typedef std::vector<Cell> Cells;
+    typedef boost::array<int, 5> Offsets;
+    typedef std::vector<PositionIndex> Mines;
+    typedef std::vector<MineId> MineIds;
+
+    static const MineId no_mine = 255;
+    static const int max_size = 30; // padded cells fill a Bitboard
+
+    Grid(const Tiles& tiles, const bool& specialize=true);
+
+    Tile
+    get_tile(const PositionIndex& index) const
+    {
+        return static_cast<Tile>(cells[index]);
+    }
+
+    MineId
+    get_mine_id(const PositionIndex& index) const
+    {
+        return mine_ids[index];
+    }
+
+    PositionIndex
+    get_neighbor(const PositionIndex& index, const Direction& direction) const
+    {
+        return index + offsets[direction];
+    }
+
+    PositionIndex
+    get_index(const Position& position) const
+    {
+        return position.to_index(stride);
+    }
+
+    Position
+    get_position(const PositionIndex& index) const
+    {
+        return Position::from_index(index, stride);
+    }
+
+    PositionIndex
+    transform_index(const PositionIndex& index, const Transform& transform) const
+    {
+        return get_index(transform_position(get_position(index), transform, size));
+    }
+
+    bool
+    in_board(const Position& position) const;
+
+    bool
+    in_padded_board(const Position& position) const;
+
+    int size;
+    int stride;
+    int dimension; // size of the compiled kernels, 0 for the generic ones
+    Offsets offsets;
+    Cells cells;
+    Mines mines; // mine cells ordered by mine id
+    MineIds mine_ids; // mine id of each cell or no_mine
+    Bitboard passable; // cells a hero can walk through
+    Bitboard taverns;
+    Bitboard mine_cells;
+    Distances tavern_distances; // steps from each cell to the nearest tavern, -1 when none is reachable
+    Transforms symmetries; // of the board, see detect_symmetries
+    GridKernels kernels;
+};
+
+// Vindinium boards sizes with a dedicated kernel instantiation.
+#define GRID_FOR_EACH_DIMENSION(apply) \
+    apply(10) apply(12) apply(14) apply(16) apply(18) \
+    apply(20) apply(22) apply(24) apply(26) apply(28)
+
+template <int Size>
+struct FixedDimension
+{
+    static const int size = Size;
+    static const int stride = Size+2;
+    static const int cell_count = stride*stride;
+
+    typedef boost::array<PositionIndex, cell_count> IndexBuffer;
+
+    static int get_stride(const Grid&) { return stride; }
+    static int get_cell_count(const Grid&) { return cell_count; }
+    static void init_buffer(const Grid&, IndexBuffer&) {}
+
+    static
+    int
+    get_offset(const Grid&, const Direction& direction)
+    {
+        static const int offsets[5] = {0, -stride, stride, 1, -1};
+        return offsets[direction];
+    }
+};
+
+struct GenericDimension
+{
+    typedef std::vector<PositionIndex> IndexBuffer;
+
+    static int get_stride(const Grid& grid) { return grid.stride; }
+    static int get_cell_count(const Grid& grid) { return grid.cells.size(); }
+    static void init_buffer(const Grid& grid, IndexBuffer& buffer) { buffer.resize(grid.cells.size()); }
+
+    static
+    int
+    get_offset(const Grid& grid, const Direction& direction)
+    {
+        return grid.offsets[direction];
+    }
+};
+
+bool
+is_specialized_dimension(const int& size);
+
+Grid
+parse_grid(const int& tiles_size, const std::string& tiles_string);
+
+Tiles
+to_tiles(const Grid& grid);
+
+MineSet
+make_mine_set(const Grid& grid, const PositionsSet& mine_positions);
+
+Hash
+hash_value(const Grid& grid);
+
+Tile
+get_tile(const Grid& grid, const Position& position);
+
+Tile
+get_tile_border_check(const Grid& grid, const Position& position);
+
+/// Shortest path length from source to every cell, -1 when unreachable.
+/// Mines and taverns are reached but never walked through.
+void
+fill_distances(const Grid& grid, const PositionIndex& source, Distances& distances);
+
+std::ostream&
+operator<<(std::ostream& os, const Grid& grid);
+
+void
+test_grid();
+
@@ -0,0 +1,516 @@
+#include "hierarchy.h"
+
+#include "grid.h"
+#include "macro.h"
+#include "map_generator.h"
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+
+HierarchicalPaths::Scratch::Scratch() :
+    costs(),
+    parents(),
+    stamps(),
+    stamp(0),
+    local_costs(),
+    first_moves(),
+    goal_costs(),
+    goal_stamps(),
+    queue(),
+    heap()
+{
+}
+
+// Row major index of the neighbor of cell, -1 off the board.
+static
+int
+get_neighbor(const int& cell, const Direction& direction, const int& size)
+{
+    const int x = cell/size;
+    const int y = cell%size;
+    switch (direction)
+    {
+        case NORTH:
+            return x > 0 ? cell-size : -1;
+        case SOUTH:
+            return x < size-1 ? cell+size : -1;
+        case EAST:
+            return y < size-1 ? cell+1 : -1;
+        case WEST:
+            return y > 0 ? cell-1 : -1;
+        default:
+            return cell;
+    }
+}
+
+static
+bool
+is_walkable(const Tile& tile)
+{
+    return tile == EMPTY || tile == HERO1 || tile == HERO2 || tile == HERO3 || tile == HERO4;
+}
+
+HierarchicalPaths::HierarchicalPaths(const Tiles& background_tiles, const int& cluster_size, const int& portal_gap) :
+    size(background_tiles.shape()[0]),
+    cluster_size(cluster_size),
+    portal_gap(portal_gap),
+    cluster_columns((size+cluster_size-1)/cluster_size),
+    walkable(size*size, false),
+    enterable(size*size, false),
+    cluster_nodes(cluster_columns*cluster_columns),
+    nodes(),
+    edges()
+{
+    assert( cluster_size >= 2 );
+    assert( portal_gap >= 1 );
+
+    for (int ii=0; ii<size; ii++)
+        for (int jj=0; jj<size; jj++)
+        {
+            const Tile tile = background_tiles[ii][jj];
+            walkable[ii*size+jj] = is_walkable(tile);
+            enterable[ii*size+jj] = is_walkable(tile) || tile == MINE || tile == TAVERN;
+        }
+
+    NodeIds cell_nodes(size*size, -1);
+    for (int border=cluster_size; border<size; border+=cluster_size)
+    {
+        add_portals(border, true, cell_nodes);
+        add_portals(border, false, cell_nodes);
+    }
+
+    // portals of a cluster are joined by their distance inside it, portals
+    // facing each other across a border by one move
+    std::vector<int> costs;
+    std::vector<int> queue;
+    for (int node_id=0; node_id<static_cast<int>(nodes.size()); node_id++)
+    {
+        Node& node = nodes[node_id];
+        node.first_edge = edges.size();
+
+        fill_local_costs(node.cell, costs, NULL, queue);
+        const NodeIds& siblings = cluster_nodes[node.cluster];
+        for (NodeIds::const_iterator si=siblings.begin(), sie=siblings.end(); si!=sie; si++)
+        {
+            const int cost = costs[get_local_index(nodes[*si].cell)];
+            if (*si == node_id || cost < 0) continue;
+            const Edge edge = {*si, cost};
+            edges.push_back(edge);
+        }
+
+        for (int direction=NORTH; direction<=WEST; direction++)
+        {
+            const int neighbor = get_neighbor(node.cell, static_cast<Direction>(direction), size);
+            if (neighbor < 0 || cell_nodes[neighbor] < 0 || get_cluster(neighbor) == node.cluster) continue;
+            const Edge edge = {cell_nodes[neighbor], 1};
+            edges.push_back(edge);
+        }
+
+        node.edge_count = edges.size()-node.first_edge;
+    }
+}
+
+void
+HierarchicalPaths::add_portals(const int& border, const bool& is_row_border, NodeIds& cell_nodes)
+{
+    // crossings between row border-1 and row border, or the same columns
+    std::vector<int> cells_aa(size);
+    std::vector<int> cells_bb(size);
+    std::vector<bool> open(size);
+    for (int kk=0; kk<size; kk++)
+    {
+        cells_aa[kk] = is_row_border ? (border-1)*size+kk : kk*size+border-1;
+        cells_bb[kk] = is_row_border ? border*size+kk : kk*size+border;
+        open[kk] = walkable[cells_aa[kk]] && walkable[cells_bb[kk]];
+    }
+
+    // every open segment along the border of two clusters gets both of its
+    // ends and a portal every portal_gap crossings in between
+    int start = 0;
+    for (int kk=0; kk<size; kk++)
+    {
+        if (!open[kk]) continue;
+        if (kk%cluster_size == 0 || !open[kk-1]) start = kk;
+        const bool is_end = kk+1 == size || (kk+1)%cluster_size == 0 || !open[kk+1];
+        if ((kk-start)%portal_gap != 0 && !is_end) continue;
+
+        const int cells[2] = {cells_aa[kk], cells_bb[kk]};
+        for (int ll=0; ll<2; ll++)
+        {
+            const int& cell = cells[ll];
+            if (cell_nodes[cell] >= 0) continue;
+            const Node node = {cell, get_cluster(cell), 0, 0};
+            cell_nodes[cell] = nodes.size();
+            cluster_nodes[node.cluster].push_back(nodes.size());
+            nodes.push_back(node);
+        }
+    }
+}
+
+void
+HierarchicalPaths::fill_local_costs(const int& source, std::vector<int>& costs, std::vector<Direction>* first_moves, std::vector<int>& queue) const
+{
+    costs.assign(cluster_size*cluster_size, -1);
+    if (first_moves) first_moves->assign(cluster_size*cluster_size, STAY);
+
+    const int cluster = get_cluster(source);
+    queue.clear();
+    queue.push_back(source);
+    costs[get_local_index(source)] = 0;
+    for (size_t head=0; head<queue.size(); head++)
+    {
+        const int cell = queue[head];
+        const int local_index = get_local_index(cell);
+        for (int direction=NORTH; direction<=WEST; direction++)
+        {
+            const int neighbor = get_neighbor(cell, static_cast<Direction>(direction), size);
+            if (neighbor < 0 || !walkable[neighbor] || get_cluster(neighbor) != cluster) continue;
+            const int neighbor_index = get_local_index(neighbor);
+            if (costs[neighbor_index] >= 0) continue;
+            costs[neighbor_index] = costs[local_index]+1;
+            if (first_moves) (*first_moves)[neighbor_index] = cell == source ? static_cast<Direction>(direction) : (*first_moves)[local_index];
+            queue.push_back(neighbor);
+        }
+    }
+}
+
+// Direction of the move from cell to its neighbor.
+static
+Direction
+get_step_direction(const int& cell, const int& neighbor, const int& size)
+{
+    if (neighbor == cell-size) return NORTH;
+    if (neighbor == cell+size) return SOUTH;
+    if (neighbor == cell+1) return EAST;
+    assert( neighbor == cell-1 );
+    return WEST;
+}
+
+int
+HierarchicalPaths::search(const Position& source, const Position& target, Scratch& scratch, Direction& direction) const
+{
+    assert( source.x >= 0 && source.x < size && source.y >= 0 && source.y < size );
+    assert( target.x >= 0 && target.x < size && target.y >= 0 && target.y < size );
+
+    direction = STAY;
+    const int source_cell = source.x*size+source.y;
+    const int target_cell = target.x*size+target.y;
+    if (source_cell == target_cell) return 0;
+    if (!walkable[source_cell] || !enterable[target_cell]) return -1;
+
+    // paths end on the target, or next to it when heroes walk into it
+    // without standing there
+    int goal_cells[4];
+    int goal_offsets[4];
+    int goal_count = 0;
+    if (walkable[target_cell])
+    {
+        goal_cells[goal_count] = target_cell;
+        goal_offsets[goal_count++] = 0;
+    }
+    else
+        for (int kk=NORTH; kk<=WEST; kk++)
+        {
+            const int neighbor = get_neighbor(target_cell, static_cast<Direction>(kk), size);
+            if (neighbor < 0 || !walkable[neighbor]) continue;
+            goal_cells[goal_count] = neighbor;
+            goal_offsets[goal_count++] = 1;
+        }
+
+    if (scratch.stamps.size() < nodes.size())
+    {
+        scratch.costs.resize(nodes.size());
+        scratch.parents.resize(nodes.size());
+        scratch.stamps.resize(nodes.size(), 0);
+        scratch.goal_costs.resize(nodes.size());
+        scratch.goal_stamps.resize(nodes.size(), 0);
+    }
+    if (++scratch.stamp == 0)
+    {
+        std::fill(scratch.stamps.begin(), scratch.stamps.end(), 0);
+        std::fill(scratch.goal_stamps.begin(), scratch.goal_stamps.end(), 0);
+        scratch.stamp = 1;
+    }
+    const unsigned int stamp = scratch.stamp;
+
+    // paths staying in the cluster of the source
+    const int source_cluster = get_cluster(source_cell);
+    fill_local_costs(source_cell, scratch.local_costs, &scratch.first_moves, scratch.queue);
+    int best_cost = -1;
+    for (int kk=0; kk<goal_count; kk++)
+    {
+        if (goal_cells[kk] == source_cell)
+        {
+            best_cost = goal_offsets[kk];
+            direction = get_step_direction(source_cell, target_cell, size);
+            continue;
+        }
+        if (get_cluster(goal_cells[kk]) != source_cluster) continue;
+        const int cost = scratch.local_costs[get_local_index(goal_cells[kk])];
+        if (cost < 0 || (best_cost >= 0 && cost+goal_offsets[kk] >= best_cost)) continue;
+        best_cost = cost+goal_offsets[kk];
+        direction = scratch.first_moves[get_local_index(goal_cells[kk])];
+    }
+
+    // A* over the portals, from those around the source to those around the
+    // goals, manhattan distances to the target as heuristic
+    typedef std::pair<int, int> Entry; // estimated cost, node
+    std::vector<Entry>& heap = scratch.heap;
+    heap.clear();
+    const NodeIds& source_nodes = cluster_nodes[source_cluster];
+    for (NodeIds::const_iterator ni=source_nodes.begin(), nie=source_nodes.end(); ni!=nie; ni++)
+    {
+        const int cost = scratch.local_costs[get_local_index(nodes[*ni].cell)];
+        if (cost < 0) continue;
+        scratch.costs[*ni] = cost;
+        scratch.parents[*ni] = -1;
+        scratch.stamps[*ni] = stamp;
+        heap.push_back(Entry(cost+get_manhattan_distance(nodes[*ni].cell, target_cell), *ni));
+        std::push_heap(heap.begin(), heap.end(), std::greater<Entry>());
+    }
+    if (heap.empty()) return best_cost;
+
+    for (int kk=0; kk<goal_count; kk++)
+    {
+        const int goal_cluster = get_cluster(goal_cells[kk]);
+        fill_local_costs(goal_cells[kk], scratch.local_costs, NULL, scratch.queue);
+        const NodeIds& goal_nodes = cluster_nodes[goal_cluster];
+        for (NodeIds::const_iterator ni=goal_nodes.begin(), nie=goal_nodes.end(); ni!=nie; ni++)
+        {
+            int cost = scratch.local_costs[get_local_index(nodes[*ni].cell)];
+            if (cost < 0) continue;
+            cost += goal_offsets[kk];
+            if (scratch.goal_stamps[*ni] == stamp && scratch.goal_costs[*ni] <= cost) continue;
+            scratch.goal_costs[*ni] = cost;
+            scratch.goal_stamps[*ni] = stamp;
+        }
+    }
+
+    int best_node = -1;
+    while (!heap.empty())
+    {
+        const Entry entry = heap.front();
+        std::pop_heap(heap.begin(), heap.end(), std::greater<Entry>());
+        heap.pop_back();
+        if (best_cost >= 0 && entry.first >= best_cost) break;
+
+        const int node_id = entry.second;
+        const Node& node = nodes[node_id];
+        const int cost = scratch.costs[node_id];
+        if (entry.first != cost+get_manhattan_distance(node.cell, target_cell)) continue;
+
+        if (scratch.goal_stamps[node_id] == stamp && (best_cost < 0 || cost+scratch.goal_costs[node_id] < best_cost))
+        {
+            best_cost = cost+scratch.goal_costs[node_id];
+            best_node = node_id;
+        }
+
+        for (Edges::const_iterator ei=edges.begin()+node.first_edge, eie=ei+node.edge_count; ei!=eie; ei++)
+        {
+            const int cost_prime = cost+ei->cost;
+            if (scratch.stamps[ei->node] == stamp && scratch.costs[ei->node] <= cost_prime) continue;
+            scratch.costs[ei->node] = cost_prime;
+            scratch.parents[ei->node] = node_id;
+            scratch.stamps[ei->node] = stamp;
+            heap.push_back(Entry(cost_prime+get_manhattan_distance(nodes[ei->node].cell, target_cell), ei->node));
+            std::push_heap(heap.begin(), heap.end(), std::greater<Entry>());
+        }
+    }
+
+    if (best_node < 0) return best_cost;
+
+    // the first portal of the path off the source cell, reached inside the
+    // cluster of the source or one move across its border
+    int first_node = -1;
+    for (int node_id=best_node; node_id>=0; node_id=scratch.parents[node_id])
+        if (nodes[node_id].cell != source_cell) first_node = node_id;
+    assert( first_node >= 0 );
+    const int first_cell = nodes[first_node].cell;
+    direction = get_cluster(first_cell) == source_cluster ? scratch.first_moves[get_local_index(first_cell)] : get_step_direction(source_cell, first_cell, size);
+
+    return best_cost;
+}
+
+int
+HierarchicalPaths::get_distance(const Position& source, const Position& target, Scratch& scratch) const
+{
+    Direction direction;
+    return search(source, target, scratch, direction);
+}
+
+Direction
+HierarchicalPaths::get_direction(const Position& source, const Position& target, Scratch& scratch) const
+{
+    Direction direction;
+    search(source, target, scratch, direction);
+    return direction;
+}
+
+size_t
+HierarchicalPaths::get_byte_count() const
+{
+    size_t byte_count = sizeof(*this);
+    byte_count += 2*walkable.size()/8;
+    byte_count += nodes.size()*sizeof(Node);
+    byte_count += edges.size()*sizeof(Edge);
+    for (std::vector<NodeIds>::const_iterator ci=cluster_nodes.begin(), cie=cluster_nodes.end(); ci!=cie; ci++)
+        byte_count += sizeof(NodeIds) + ci->size()*sizeof(int);
+    return byte_count;
+}
+
+// Flat breadth first search from the target over the whole board, the
+// target expanded even when heroes can't stand on it. Reference for the
+// hierarchical distances.
+static
+void
+fill_tile_distances(const Tiles& tiles, const int& target, std::vector<int>& distances, std::vector<int>& queue)
+{
+    const int size = tiles.shape()[0];
+    distances.assign(size*size, -1);
+    queue.clear();
+    queue.push_back(target);
+    distances[target] = 0;
+    for (size_t head=0; head<queue.size(); head++)
+    {
+        const int cell = queue[head];
+        for (int direction=NORTH; direction<=WEST; direction++)
+        {
+            const int neighbor = get_neighbor(cell, static_cast<Direction>(direction), size);
+            if (neighbor < 0 || distances[neighbor] >= 0 || !is_walkable(tiles[neighbor/size][neighbor%size])) continue;
+            distances[neighbor] = distances[cell]+1;
+            queue.push_back(neighbor);
+        }
+    }
+}
+
+void
+test_hierarchy()
+{
+    std::cout << "Doing hierarchical paths test...\n";
+
+    Rng rng(42);
+    const int sizes[] = {18, 28, 64, 128, 256};
+    for (int kk=0; kk<static_cast<int>(sizeof(sizes)/sizeof(sizes[0])); kk++)
+    {
+        const int size = sizes[kk];
+        MapParameters parameters;
+        parameters.size = size;
+        parameters.mine_count = 4*std::min(60, size*size/64);
+        parameters.tavern_count = 4+4*(size/64);
+        parameters.seed = 2000+size;
+        const Tiles background_tiles = neutralize_tiles(generate_map(parameters));
+
+        std::vector<int> sources;
+        std::vector<int> targets;
+        for (int cell=0; cell<size*size; cell++)
+        {
+            const Tile tile = background_tiles[cell/size][cell%size];
+            if (tile == EMPTY) sources.push_back(cell);
+            if (tile == EMPTY || tile == MINE || tile == TAVERN) targets.push_back(cell);
+        }
+
+        // random queries and their flat answers
+        const int query_count = size <= 64 ? 2000 : 500;
+        SizeRng<int> size_rng(rng);
+        std::vector<int> query_sources;
+        std::vector<int> query_targets;
+        std::vector<int> query_distances;
+        std::vector<bool> query_moves; // whether each move of the source gets closer
+        std::vector<int> distances;
+        std::vector<int> queue;
+        const double flat_start_time = get_double_time();
+        for (int ll=0; ll<query_count; ll++)
+        {
+            const int source = sources[size_rng(sources.size())];
+            const int target = targets[size_rng(targets.size())];
+            fill_tile_distances(background_tiles, target, distances, queue);
+            query_sources.push_back(source);
+            query_targets.push_back(target);
+            query_distances.push_back(distances[source]);
+            for (int direction=STAY; direction<=WEST; direction++)
+            {
+                const int neighbor = get_neighbor(source, static_cast<Direction>(direction), size);
+                query_moves.push_back(neighbor >= 0 && distances[source] > 0 && distances[neighbor] == distances[source]-1);
+            }
+        }
+        const double flat_time = (get_double_time()-flat_start_time)/query_count;
+
+        // one flat search per target cell, only built while the grid holds the board
+        const double all_pairs_bytes = static_cast<double>(targets.size())*size*size*sizeof(Distance);
+        std::cout << size << "x" << size << " " << sources.size() << " empty " << targets.size() << " targets flat bfs " << clock_it(flat_time) << "/query all pairs " << static_cast<int>(all_pairs_bytes/1024) << "kB";
+        if ((size+2)*(size+2) <= Bitboard::capacity)
+        {
+            const Grid grid(background_tiles);
+            const double cache_start_time = get_double_time();
+            const PathCache cache(grid);
+            const double cache_end_time = get_double_time();
+            std::cout << " path cache " << cache.get_byte_count()/1024 << "kB in " << clock_it(cache_end_time-cache_start_time) << std::endl;
+
+            const HierarchicalPaths paths(background_tiles);
+            HierarchicalPaths::Scratch scratch;
+            for (int ll=0; ll<query_count; ll++)
+            {
+                const Position source(query_sources[ll]/size, query_sources[ll]%size);
+                const Position target(query_targets[ll]/size, query_targets[ll]%size);
+                assert( paths.get_distance(source, target, scratch) == cache.get_distance(source.to_index(grid.stride), target.to_index(grid.stride)) );
+            }
+        }
+        else
+            std::cout << " past the grid capacity, about " << clock_it(flat_time*targets.size()) << " to build" << std::endl;
+
+        const int configurations[][2] = {{8, 1}, {16, 1}, {8, 4}, {16, 8}};
+        for (int ll=0; ll<4; ll++)
+        {
+            const int cluster_size = configurations[ll][0];
+            const int portal_gap = configurations[ll][1];
+
+            const double build_start_time = get_double_time();
+            const HierarchicalPaths paths(background_tiles, cluster_size, portal_gap);
+            const double build_end_time = get_double_time();
+
+            HierarchicalPaths::Scratch scratch;
+            std::vector<int> hierarchical_distances(query_count);
+            std::vector<Direction> hierarchical_directions(query_count);
+            const double query_start_time = get_double_time();
+            for (int mm=0; mm<query_count; mm++)
+            {
+                const Position source(query_sources[mm]/size, query_sources[mm]%size);
+                const Position target(query_targets[mm]/size, query_targets[mm]%size);
+                hierarchical_distances[mm] = paths.get_distance(source, target, scratch);
+            }
+            const double query_end_time = get_double_time();
+            for (int mm=0; mm<query_count; mm++)
+            {
+                const Position source(query_sources[mm]/size, query_sources[mm]%size);
+                const Position target(query_targets[mm]/size, query_targets[mm]%size);
+                hierarchical_directions[mm] = paths.get_direction(source, target, scratch);
+            }
+
+            // exact with every crossing a portal, never shorter than the
+            // shortest path otherwise
+            int error_max = 0;
+            double error_sum = 0;
+            for (int mm=0; mm<query_count; mm++)
+            {
+                const int distance = query_distances[mm];
+                const int distance_prime = hierarchical_distances[mm];
+                assert( (distance < 0) == (distance_prime < 0) );
+                assert( distance_prime >= distance );
+                if (portal_gap == 1)
+                {
+                    assert( distance_prime == distance );
+                    assert( distance <= 0 ? hierarchical_directions[mm] == STAY : query_moves[5*mm+hierarchical_directions[mm]] );
+                }
+                else
+                    assert( (distance <= 0) == (hierarchical_directions[mm] == STAY) );
+                error_max = std::max(error_max, distance_prime-distance);
+                error_sum += distance_prime-distance;
+            }
+
+            std::cout << "  clusters " << cluster_size << " gap " << portal_gap << " " << paths.get_node_count() << " portals " << paths.get_byte_count()/1024 << "kB build " << clock_it(build_end_time-build_start_time) << " query " << clock_it((query_end_time-query_start_time)/query_count) << " (" << flat_time/((query_end_time-query_start_time)/query_count) << "x flat) error max " << error_max << " mean " << error_sum/query_count << std::endl;
+        }
+    }
+
+    std::cout << "...done!\n";
+}
+
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "tiles.h"
+#include <cstdlib>
+#include <utility>
+#include <vector>
+
+// Shortest paths on boards of any size, the grid and the path cache stopping
+// at 30x30. The board is cut into square clusters, every open crossing of a
+// cluster border, or one every portal_gap tiles of it, becomes a pair of
+// portals and the portals of a cluster are joined by their distances inside
+// it. Queries search this portal graph from the cells around the source and
+// the target, so memory grows with the number of portals, linear in the
+// board area, instead of the square of it. Paths only cross clusters at
+// portals: distances are exact with every crossing a portal, otherwise upper
+// bounds at most portal_gap moves longer per cluster border crossed.
+struct HierarchicalPaths
+{
+    // Search buffers of one thread, reused across queries.
+    struct Scratch
+    {
+        Scratch();
+
+        std::vector<int> costs; // by node, valid when the stamp matches
+        std::vector<int> parents; // by node, -1 for the source
+        std::vector<unsigned int> stamps;
+        unsigned int stamp;
+        std::vector<int> local_costs; // by cell of a cluster
+        std::vector<Direction> first_moves;
+        std::vector<int> goal_costs; // by node, valid when goal_stamps match
+        std::vector<unsigned int> goal_stamps;
+        std::vector<int> queue;
+        std::vector<std::pair<int, int> > heap;
+    };
+
+    HierarchicalPaths(const Tiles& background_tiles, const int& cluster_size=8, const int& portal_gap=1);
+
+    /// Moves from source to target, -1 when unreachable. The source is a cell
+    /// a hero can stand on, the target any cell it can walk into.
+    int
+    get_distance(const Position& source, const Position& target, Scratch& scratch) const;
+
+    /// First move of the path get_distance measures, STAY when there or
+    /// unreachable.
+    Direction
+    get_direction(const Position& source, const Position& target, Scratch& scratch) const;
+
+    int
+    get_node_count() const
+    {
+        return nodes.size();
+    }
+
+    size_t
+    get_byte_count() const;
+
+    const int size;
+    const int cluster_size;
+    const int portal_gap;
+    const int cluster_columns;
+
+private:
+
+    struct Node
+    {
+        int cell; // row major index
+        int cluster;
+        int first_edge;
+        int edge_count;
+    };
+
+    struct Edge
+    {
+        int node;
+        int cost;
+    };
+
+    typedef std::vector<Node> Nodes;
+    typedef std::vector<Edge> Edges;
+    typedef std::vector<int> NodeIds;
+
+    int
+    get_cluster(const int& cell) const
+    {
+        return (cell/size/cluster_size)*cluster_columns + (cell%size)/cluster_size;
+    }
+
+    void
+    add_portals(const int& border, const bool& is_row_border, NodeIds& cell_nodes);
+
+    // Distances from source to the walkable cells of its cluster, by cell of
+    // the cluster, and the first move towards each of them.
+    void
+    fill_local_costs(const int& source, std::vector<int>& costs, std::vector<Direction>* first_moves, std::vector<int>& queue) const;
+
+    int
+    get_local_index(const int& cell) const
+    {
+        return (cell/size%cluster_size)*cluster_size + cell%size%cluster_size;
+    }
+
+    int
+    get_manhattan_distance(const int& cell_aa, const int& cell_bb) const
+    {
+        return std::abs(cell_aa/size-cell_bb/size) + std::abs(cell_aa%size-cell_bb%size);
+    }
+
+    int
+    search(const Position& source, const Position& target, Scratch& scratch, Direction& direction) const;
+
+    std::vector<bool> walkable; // heroes stand there
+    std::vector<bool> enterable; // heroes stand or walk into there
+    std::vector<NodeIds> cluster_nodes;
+    Nodes nodes;
+    Edges edges;
+};
+
+void
+test_hierarchy();
+
@@ -0,0 +1,230 @@
+#include "inference.h"
+
+#include "policy.h"
+#include "snapshot.h"
+#include <cstdio>
+#include <unistd.h>
+
+MoveInference::MoveInference() :
+    opponent_count(0),
+    directions(),
+    candidates(),
+    match_count(0),
+    mismatch_count(0),
+    replay_count(0)
+{
+    std::fill(directions.begin(), directions.end(), STAY);
+    std::fill(candidates.begin(), candidates.end(), 0);
+}
+
+std::ostream&
+operator<<(std::ostream& os, const MoveInference& inference)
+{
+    for (int kk=0; kk<inference.opponent_count; kk++)
+        os << (kk ? " " : "") << inference.directions[kk];
+    if (inference.match_count == 0) return os << " (no match, " << inference.mismatch_count << " mismatches)";
+    if (inference.is_ambiguous()) os << " (" << inference.match_count << " matches)";
+    return os;
+}
+
+int
+count_mismatches(const State& state_aa, const State& state_bb)
+{
+    int mismatch_count = state_aa.next_hero_index != state_bb.next_hero_index;
+    for (int kk=0; kk<4; kk++)
+    {
+        const State::Hero& hero_aa = state_aa.heroes[kk];
+        const State::Hero& hero_bb = state_bb.heroes[kk];
+        mismatch_count += hero_aa.position != hero_bb.position;
+        mismatch_count += hero_aa.life != hero_bb.life;
+        mismatch_count += hero_aa.gold != hero_bb.gold;
+        mismatch_count += !(hero_aa.mines == hero_bb.mines);
+        mismatch_count += hero_aa.crashed != hero_bb.crashed;
+        mismatch_count += hero_aa.spawn_position != hero_bb.spawn_position;
+    }
+    return mismatch_count;
+}
+
+// A hero that moved only changes position again when it is killed.
+static
+bool
+can_reach(const State& state, const State& new_state, const int& hero_index)
+{
+    const State::Hero& new_hero = new_state.heroes[hero_index];
+    return state.heroes[hero_index].position == new_hero.position || new_hero.position == new_hero.spawn_position;
+}
+
+static const int max_opponent_count = 3;
+
+struct InferenceSearch
+{
+    const Grid& grid;
+    const State& new_state;
+    const bool prune;
+    MoveInference& inference;
+    MoveInference::Directions directions;
+};
+
+static
+void
+search_moves(InferenceSearch& search, const State& state, const int& depth)
+{
+    MoveInference& inference = search.inference;
+
+    if (depth == inference.opponent_count)
+    {
+        const int mismatch_count = count_mismatches(state, search.new_state);
+        if (mismatch_count == 0)
+        {
+            if (inference.match_count == 0) inference.directions = search.directions;
+            inference.match_count++;
+            inference.mismatch_count = 0;
+            for (int kk=0; kk<max_opponent_count; kk++)
+                if (kk < depth) inference.candidates[kk] |= 1 << search.directions[kk];
+        }
+        else if (inference.match_count == 0 && mismatch_count < inference.mismatch_count)
+        {
+            inference.directions = search.directions;
+            inference.mismatch_count = mismatch_count;
+        }
+        return;
+    }
+
+    const int hero_index = state.next_hero_index;
+    const LegalDirections legal = get_legal_directions(search.grid, search.grid.get_index(state.heroes[hero_index].position));
+    for (int kk=0; kk<legal.size; kk++)
+    {
+        State state_prime(state);
+        state_prime.update(legal.directions[kk]);
+        inference.replay_count++;
+        if (search.prune && !can_reach(state_prime, search.new_state, hero_index)) continue;
+        search.directions[depth] = legal.directions[kk];
+        search_moves(search, state_prime, depth+1);
+    }
+}
+
+MoveInference
+infer_opponent_moves(const Grid& grid, const State& state, const Direction& direction, const State& new_state, const int& opponent_count)
+{
+    assert( opponent_count >= 0 && opponent_count <= max_opponent_count );
+
+    MoveInference inference;
+    inference.opponent_count = opponent_count;
+    inference.mismatch_count = 1 << 30;
+
+    State state_prime(state);
+    state_prime.update(direction);
+    inference.replay_count++;
+
+    {
+        InferenceSearch search = {grid, new_state, true, inference, inference.directions};
+        if (can_reach(state_prime, new_state, state.next_hero_index)) search_moves(search, state_prime, 0);
+    }
+
+    // closest sequence without any cut, for diagnostics only
+    if (inference.match_count == 0)
+    {
+        InferenceSearch search = {grid, new_state, false, inference, inference.directions};
+        search_moves(search, state_prime, 0);
+    }
+
+    return inference;
+}
+
+void
+test_inference()
+{
+    std::cout << "Doing move inference test...\n";
+
+    Rng rng(42);
+
+    for (int size=10; size<=28; size+=6)
+    {
+        const Tiles tiles = make_benchmark_tiles(size);
+        const PTree root = make_initial_state_json(tiles, 1200);
+        const Tiles background_tiles = neutralize_tiles(tiles);
+        const HashedPair<Tiles> hashed_background_tiles(background_tiles);
+        const Grid grid(background_tiles);
+        const PathCache cache(grid);
+        const MixedPolicy policy = make_mixed_policy(cache, .3);
+
+        // record a game as the server would send it, one snapshot per move
+        typedef std::vector<Direction> Directions;
+        StateSnapshots snapshots;
+        Directions moves;
+        {
+            State state(root, hashed_background_tiles, grid);
+            for (int turn=0; turn<1200; turn++)
+            {
+                StateSnapshot snapshot;
+                encode_snapshot(state, turn, snapshot);
+                snapshots.push_back(snapshot);
+                moves.push_back(policy(state, rng));
+                state.update(moves.back());
+            }
+            StateSnapshot snapshot;
+            encode_snapshot(state, 1200, snapshot);
+            snapshots.push_back(snapshot);
+        }
+
+        char path[] = "/tmp/vindinium_game_XXXXXX";
+        const int fd = mkstemp(path);
+        assert( fd >= 0 );
+        close(fd);
+        write_snapshots(path, snapshots);
+
+        // infer the opponents of every hero from the recorded game
+        const MappedSnapshots game(path);
+        State state(root, hashed_background_tiles, grid);
+        State new_state(root, hashed_background_tiles, grid);
+        int inference_count = 0;
+        int ambiguous_count = 0;
+        int replay_count = 0;
+        double total_time = 0;
+        for (int turn=0; turn<1200; turn++)
+        {
+            const int opponent_count = std::min(3, 1200-turn-1);
+            int turn_prime = 0;
+            decode_snapshot(game[turn], state, turn_prime);
+            decode_snapshot(game[turn+1+opponent_count], new_state, turn_prime);
+
+            const double start_time = get_double_time();
+            const MoveInference inference = infer_opponent_moves(grid, state, moves[turn], new_state, opponent_count);
+            total_time += get_double_time()-start_time;
+            inference_count++;
+            replay_count += inference.replay_count;
+            if (inference.is_ambiguous()) ambiguous_count++;
+
+            // the inferred moves replay the game and the recorded ones are candidates
+            assert( inference.match_count > 0 );
+            State replayed(state);
+            replayed.update(moves[turn]);
+            for (int kk=0; kk<opponent_count; kk++)
+            {
+                assert( inference.candidates[kk] & (1 << inference.directions[kk]) );
+                const LegalDirections legal = get_legal_directions(grid, grid.get_index(replayed.heroes[replayed.next_hero_index].position));
+                const bool is_legal = std::find(legal.directions.begin(), legal.directions.begin()+legal.size, moves[turn+1+kk]) != legal.directions.begin()+legal.size;
+                assert( !is_legal || (inference.candidates[kk] & (1 << moves[turn+1+kk])) );
+                replayed.update(inference.directions[kk]);
+            }
+            assert( replayed == new_state );
+        }
+        std::remove(path);
+
+        // a change outside the rules is reported
+        {
+            int turn_prime = 0;
+            decode_snapshot(game[400], state, turn_prime);
+            decode_snapshot(game[404], new_state, turn_prime);
+            new_state.heroes[(state.next_hero_index+2)%4].gold += 1;
+            const MoveInference inference = infer_opponent_moves(grid, state, moves[400], new_state, 3);
+            assert( inference.match_count == 0 );
+            assert( inference.mismatch_count == 1 );
+        }
+
+        std::cout << "inference " << size << "x" << size << " " << 1e6*total_time/inference_count << "us " << static_cast<double>(replay_count)/inference_count << " replays " << 100.*ambiguous_count/inference_count << "% ambiguous" << std::endl;
+    }
+
+    std::cout << "...done!\n";
+}
+
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "state.h"
+
+// Moves the opponents played between two of our turns, rebuilt from the
+// server states. Every sequence of legal opponent moves is replayed with
+// State::update and kept when it gives the new state. Replays are cut as
+// soon as a hero that just moved is neither where the new state has it nor
+// about to be killed and respawned. Moves into walls are the same as
+// staying and never reported.
+struct MoveInference
+{
+    typedef boost::array<Direction, 3> Directions;
+    typedef boost::array<uint8_t, 3> DirectionMasks;
+
+    MoveInference();
+
+    bool
+    is_ambiguous() const
+    {
+        return match_count > 1;
+    }
+
+    int opponent_count; // heroes that played after us, 3 except at the end of a game
+    Directions directions; // first matching sequence trying STAY first, else the closest one
+    DirectionMasks candidates; // bit direction of each opponent set when some matching sequence plays it
+    int match_count; // sequences giving the new state
+    int mismatch_count; // fields of the closest replay that differ, 0 on a match
+    int replay_count; // State::update calls
+};
+
+std::ostream&
+operator<<(std::ostream& os, const MoveInference& inference);
+
+/// Heroes fields and hero to play that differ between the two states.
+int
+count_mismatches(const State& state_aa, const State& state_bb);
+
+/// Opponent moves leading from state, where we play direction, to new_state
+/// after opponent_count opponents played.
+MoveInference
+infer_opponent_moves(const Grid& grid, const State& state, const Direction& direction, const State& new_state, const int& opponent_count);
+
+void
+test_inference();
+
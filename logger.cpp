@@ -0,0 +1,308 @@
+#include "logger.h"
+
+#include "utils.h"
+#include "scheduler.h"
+#include <cassert>
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <boost/lockfree/queue.hpp>
+#include <boost/bind/bind.hpp>
+
+std::ostream&
+operator<<(std::ostream& os, const LogLevel& level)
+{
+    static const std::string level_names[5] = {"debug", "info", "warning", "error", "none"};
+    return os << level_names[static_cast<int>(level)];
+}
+
+LogSink::LogSink(const LogLevel& level, const bool& wants_render) :
+    level(level),
+    wants_render(wants_render)
+{
+}
+
+LogSink::~LogSink()
+{
+}
+
+TextLogSink::TextLogSink(std::ostream& os, const LogLevel& level) :
+    LogSink(level, true),
+    os(os)
+{
+}
+
+void
+TextLogSink::write(const LogRecord& record, const std::string& rendered)
+{
+    if (record.render) os << rendered;
+    else os << record.text << "\n";
+}
+
+void
+TextLogSink::flush()
+{
+    os.flush();
+}
+
+JsonLogSink::JsonLogSink(std::ostream& os, const LogLevel& level) :
+    LogSink(level, false),
+    os(os)
+{
+}
+
+void
+JsonLogSink::write(const LogRecord& record, const std::string&)
+{
+    if (record.render) return;
+
+    os << "{\"time\":" << std::fixed << record.time << std::defaultfloat;
+    os << ",\"level\":\"" << record.level << "\",\"text\":\"";
+    for (std::string::const_iterator ci=record.text.begin(), cie=record.text.end(); ci!=cie; ci++)
+    {
+        const unsigned char cc = *ci;
+        if (cc == '"' || cc == '\\') os << '\\' << cc;
+        else if (cc < 0x20) os << "\\u00" << "0123456789abcdef"[cc >> 4] << "0123456789abcdef"[cc & 15];
+        else os << cc;
+    }
+    os << "\"}\n";
+}
+
+void
+JsonLogSink::flush()
+{
+    os.flush();
+}
+
+BinaryLogSink::BinaryLogSink(std::ostream& os, const LogLevel& level, const bool& wants_render) :
+    LogSink(level, wants_render),
+    os(os)
+{
+}
+
+void
+BinaryLogSink::write(const LogRecord& record, const std::string& rendered)
+{
+    const std::string& text = record.render ? rendered : record.text;
+    const uint8_t level = record.level;
+    const uint32_t size = text.size();
+    os.write(reinterpret_cast<const char*>(&level), sizeof(level));
+    os.write(reinterpret_cast<const char*>(&record.time), sizeof(record.time));
+    os.write(reinterpret_cast<const char*>(&size), sizeof(size));
+    os.write(text.data(), size);
+}
+
+void
+BinaryLogSink::flush()
+{
+    os.flush();
+}
+
+struct LoggerQueue
+{
+    typedef boost::lockfree::queue<LogRecord*, boost::lockfree::capacity<1024> > Records;
+
+    LoggerQueue() :
+        records(),
+        pending_count(0),
+        drain_scheduled(false)
+    {
+    }
+
+    Records records;
+    std::atomic<int> pending_count;
+    std::atomic<bool> drain_scheduled;
+};
+
+Logger::Logger() :
+    sinks(),
+    min_level(LOG_NONE),
+    min_render_level(LOG_NONE),
+    queue(new LoggerQueue())
+{
+    get_scheduler(); // must outlive the logger
+}
+
+Logger::~Logger()
+{
+    flush();
+}
+
+void
+Logger::add_sink(LogSink* sink)
+{
+    flush();
+    sinks.push_back(sink);
+    if (sink->level < min_level) min_level = sink->level;
+    if (sink->wants_render && sink->level < min_render_level) min_render_level = sink->level;
+}
+
+void
+Logger::log(const LogLevel& level, const std::string& text)
+{
+    if (!is_enabled(level)) return;
+
+    LogRecord* record = new LogRecord();
+    record->time = get_double_time();
+    record->level = level;
+    record->text = text;
+    push(record);
+}
+
+void
+Logger::log_render(const LogLevel& level, const LogRender& render)
+{
+    if (!is_render_enabled(level)) return;
+
+    LogRecord* record = new LogRecord();
+    record->time = get_double_time();
+    record->level = level;
+    record->render = render;
+    push(record);
+}
+
+void
+Logger::push(LogRecord* record)
+{
+    queue->pending_count++;
+    while (!queue->records.push(record))
+        if (!get_scheduler().help()) // queue full, let the writer catch up
+            std::this_thread::yield();
+    schedule_drain();
+}
+
+void
+Logger::flush()
+{
+    Scheduler& scheduler = get_scheduler();
+    while (queue->pending_count > 0)
+        if (!scheduler.help())
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+}
+
+void
+Logger::schedule_drain()
+{
+    if (queue->drain_scheduled.exchange(true)) return;
+    get_scheduler().spawn(boost::bind(&Logger::drain, this));
+}
+
+void
+Logger::drain()
+{
+    int written_count = 0;
+    LogRecord* record = NULL;
+    while (queue->records.pop(record))
+    {
+        write(*record);
+        delete record;
+        written_count++;
+    }
+
+    for (Sinks::iterator si=sinks.begin(), sie=sinks.end(); si!=sie; si++)
+        si->flush();
+    queue->pending_count -= written_count;
+
+    queue->drain_scheduled = false;
+    if (!queue->records.empty()) schedule_drain();
+}
+
+void
+Logger::write(const LogRecord& record)
+{
+    std::string rendered;
+    if (record.render)
+    {
+        bool wants_render = false;
+        for (Sinks::const_iterator si=sinks.begin(), sie=sinks.end(); si!=sie; si++)
+            wants_render |= si->wants_render && record.level >= si->level;
+        if (!wants_render) return;
+
+        std::ostringstream render_stream;
+        record.render(render_stream);
+        rendered = render_stream.str();
+    }
+
+    for (Sinks::iterator si=sinks.begin(), sie=sinks.end(); si!=sie; si++)
+        if (record.level >= si->level)
+            si->write(record, rendered);
+}
+
+Logger&
+get_logger()
+{
+    static Logger logger;
+    return logger;
+}
+
+LogLine::LogLine(const LogLevel& level) :
+    level(level),
+    stream(get_logger().is_enabled(level) ? new std::ostringstream() : NULL)
+{
+}
+
+LogLine::~LogLine()
+{
+    if (stream) get_logger().log(level, stream->str());
+}
+
+static
+void
+count_render(std::ostream& os, int& render_count)
+{
+    render_count++;
+    os << "<board>\n";
+}
+
+void
+test_logger()
+{
+    std::cout << "Doing logger test...\n";
+
+    std::ostringstream text_stream;
+    std::ostringstream json_stream;
+    std::ostringstream binary_stream;
+    int render_count = 0;
+
+    {
+        Logger logger;
+        logger.log(LOG_ERROR, "dropped");
+        logger.log_render(LOG_ERROR, boost::bind(count_render, boost::placeholders::_1, boost::ref(render_count)));
+        logger.flush();
+        assert( render_count == 0 );
+
+        logger.add_sink(new JsonLogSink(json_stream, LOG_DEBUG));
+        logger.log(LOG_DEBUG, "debug \"quoted\"");
+        logger.log_render(LOG_INFO, boost::bind(count_render, boost::placeholders::_1, boost::ref(render_count)));
+        logger.flush();
+        assert( render_count == 0 );
+
+        logger.add_sink(new TextLogSink(text_stream, LOG_INFO));
+        logger.add_sink(new BinaryLogSink(binary_stream, LOG_WARNING, false));
+        logger.log(LOG_DEBUG, "debug only");
+        logger.log(LOG_INFO, "info line");
+        logger.log_render(LOG_INFO, boost::bind(count_render, boost::placeholders::_1, boost::ref(render_count)));
+        logger.log_render(LOG_DEBUG, boost::bind(count_render, boost::placeholders::_1, boost::ref(render_count)));
+        logger.log(LOG_WARNING, "warning line");
+        logger.flush();
+    }
+
+    assert( render_count == 1 );
+    assert( text_stream.str() == "info line\n<board>\nwarning line\n" );
+    assert( json_stream.str().find("\"level\":\"debug\",\"text\":\"debug \\\"quoted\\\"\"") != std::string::npos );
+    assert( json_stream.str().find("<board>") == std::string::npos );
+    assert( binary_stream.str().size() == 1+sizeof(double)+4+12 );
+
+    const int payload = 10000000;
+    {
+        const double start_time = get_double_time();
+        for (int kk=0; kk<payload; kk++)
+            LogLine(LOG_DEBUG) << "disabled " << kk;
+        const double end_time = get_double_time();
+        std::cout << "disabled log line " << 1e9*(end_time-start_time)/payload << "ns" << std::endl;
+    }
+
+    std::cout << "...done!\n";
+}
+
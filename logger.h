@@ -0,0 +1,178 @@
+#pragma once
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <boost/function.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+
+enum LogLevel
+{
+    LOG_DEBUG,
+    LOG_INFO,
+    LOG_WARNING,
+    LOG_ERROR,
+    LOG_NONE
+};
+
+std::ostream&
+operator<<(std::ostream& os, const LogLevel& level);
+
+typedef boost::function<void (std::ostream&)> LogRender;
+
+struct LogRecord
+{
+    double time;
+    LogLevel level;
+    std::string text;
+    LogRender render; // deferred output, only run when a sink wants it
+};
+
+struct LogSink
+{
+    LogSink(const LogLevel& level, const bool& wants_render);
+    virtual ~LogSink();
+
+    virtual
+    void
+    write(const LogRecord& record, const std::string& rendered) = 0;
+
+    virtual
+    void
+    flush() = 0;
+
+    const LogLevel level;
+    const bool wants_render;
+};
+
+// Plain text as it used to go to std::cout, including ANSI board renders.
+struct TextLogSink : public LogSink
+{
+    TextLogSink(std::ostream& os, const LogLevel& level);
+
+    void
+    write(const LogRecord& record, const std::string& rendered);
+
+    void
+    flush();
+
+private:
+    std::ostream& os;
+};
+
+// One JSON object per line, renders are skipped.
+struct JsonLogSink : public LogSink
+{
+    JsonLogSink(std::ostream& os, const LogLevel& level);
+
+    void
+    write(const LogRecord& record, const std::string& rendered);
+
+    void
+    flush();
+
+private:
+    std::ostream& os;
+};
+
+// Length prefixed records: level byte, double time, uint32 size, text bytes.
+struct BinaryLogSink : public LogSink
+{
+    BinaryLogSink(std::ostream& os, const LogLevel& level, const bool& wants_render);
+
+    void
+    write(const LogRecord& record, const std::string& rendered);
+
+    void
+    flush();
+
+private:
+    std::ostream& os;
+};
+
+struct LoggerQueue;
+
+// Records are pushed on a lock free queue and formatted and written by a
+// drain task on the scheduler, so producers never wait on a slow terminal
+// or pipe. At most one drain task runs at a time.
+struct Logger
+{
+    Logger();
+    ~Logger();
+
+    void
+    add_sink(LogSink* sink); // takes ownership, call before logging
+
+    bool
+    is_enabled(const LogLevel& level) const
+    {
+        return level >= min_level;
+    }
+
+    bool
+    is_render_enabled(const LogLevel& level) const
+    {
+        return level >= min_render_level;
+    }
+
+    void
+    log(const LogLevel& level, const std::string& text);
+
+    void
+    log_render(const LogLevel& level, const LogRender& render);
+
+    void
+    flush(); // wait until every queued record has been written
+
+private:
+
+    Logger(const Logger& logger); // no copy
+
+    void
+    push(LogRecord* record);
+
+    void
+    schedule_drain();
+
+    void
+    drain();
+
+    void
+    write(const LogRecord& record);
+
+    typedef boost::ptr_vector<LogSink> Sinks;
+
+    Sinks sinks;
+    LogLevel min_level;
+    LogLevel min_render_level;
+    boost::scoped_ptr<LoggerQueue> queue;
+};
+
+Logger&
+get_logger();
+
+// Stream style front end, formatting is skipped when the level is disabled.
+//     LogLine(LOG_INFO) << "bot direction " << direction;
+struct LogLine
+{
+    LogLine(const LogLevel& level);
+    ~LogLine();
+
+    template <typename T>
+    LogLine&
+    operator<<(const T& x)
+    {
+        if (stream) *stream << x;
+        return *this;
+    }
+
+private:
+
+    const LogLevel level;
+    boost::scoped_ptr<std::ostringstream> stream;
+};
+
+void
+test_logger();
+
@@ -0,0 +1,503 @@
+#include "macro.h"
+
+#include "network.h"
+#include <cmath>
+#include <algorithm>
+
+static const int max_macro_moves = 24;
+static const int rollout_macro_count = 2;
+static const int max_mine_macros = 3;
+static const float exploration = .7;
+
+Macro::Macro(const MacroKind& kind, const PositionIndex& target) :
+    kind(kind),
+    target(target)
+{
+}
+
+bool
+operator==(const Macro& macro_aa, const Macro& macro_bb)
+{
+    return macro_aa.kind == macro_bb.kind && macro_aa.target == macro_bb.target;
+}
+
+std::ostream&
+operator<<(std::ostream& os, const Macro& macro)
+{
+    switch (macro.kind)
+    {
+    case MACRO_WAIT:
+        return os << "wait";
+    case MACRO_MINE:
+        return os << "mine " << macro.target;
+    case MACRO_TAVERN:
+        return os << "tavern " << macro.target;
+    case MACRO_HERO:
+        return os << "hero " << macro.target+1;
+    }
+    return os;
+}
+
+PathCache::PathCache(const Grid& grid) :
+    grid(grid),
+    fields(grid.cells.size()),
+    mine_orders(grid.cells.size()*grid.mines.size(), Grid::no_mine)
+{
+    // cell images under each symmetry of the board but the identity
+    std::vector<std::vector<PositionIndex> > images(grid.symmetries.size()-1);
+    for (int kk=0; kk<static_cast<int>(images.size()); kk++)
+        for (int index=0; index<static_cast<int>(grid.cells.size()); index++)
+            images[kk].push_back(grid.transform_index(index, grid.symmetries[kk+1]));
+
+    // bfs from the target, which is expanded even when not walkable. The
+    // field of a symmetric target is the same field with the cells mapped.
+    for (int target=0; target<static_cast<int>(grid.cells.size()); target++)
+    {
+        if (!fields[target].empty()) continue;
+        if (!grid.passable.test(target) && !grid.taverns.test(target) && !grid.mine_cells.test(target)) continue;
+
+        fill_distances(grid, target, fields[target]);
+
+        const Distances& distances = fields[target];
+        for (int kk=0; kk<static_cast<int>(images.size()); kk++)
+        {
+            Distances& distances_prime = fields[images[kk][target]];
+            if (!distances_prime.empty()) continue;
+            distances_prime.resize(distances.size());
+            for (int index=0; index<static_cast<int>(distances.size()); index++)
+                distances_prime[images[kk][index]] = distances[index];
+        }
+    }
+
+    typedef std::pair<Distance, MineId> DistanceMine;
+    typedef std::vector<DistanceMine> DistanceMines;
+    DistanceMines distance_mines;
+    for (int index=0; index<static_cast<int>(grid.cells.size()); index++)
+    {
+        distance_mines.clear();
+        for (int mine_id=0; mine_id<static_cast<int>(grid.mines.size()); mine_id++)
+        {
+            const Distance distance = get_distance(index, grid.mines[mine_id]);
+            if (distance >= 0) distance_mines.push_back(DistanceMine(distance, mine_id));
+        }
+        std::sort(distance_mines.begin(), distance_mines.end());
+        for (int kk=0; kk<static_cast<int>(distance_mines.size()); kk++)
+            mine_orders[index*grid.mines.size()+kk] = distance_mines[kk].second;
+    }
+}
+
+Direction
+PathCache::get_direction(const PositionIndex& index, const PositionIndex& target) const
+{
+    const Distance distance = get_distance(index, target);
+    if (distance <= 0) return STAY;
+
+    const Distances& distances = fields[target];
+    for (int direction=NORTH; direction<=WEST; direction++)
+    {
+        const PositionIndex neighbor = grid.get_neighbor(index, static_cast<Direction>(direction));
+        if (neighbor == target) return static_cast<Direction>(direction);
+        if (grid.passable.test(neighbor) && distances[neighbor] == distance-1) return static_cast<Direction>(direction);
+    }
+
+    assert( false );
+    return STAY;
+}
+
+size_t
+PathCache::get_byte_count() const
+{
+    size_t byte_count = 0;
+    for (Fields::const_iterator fi=fields.begin(), fie=fields.end(); fi!=fie; fi++)
+        byte_count += fi->size()*sizeof(Distance);
+    byte_count += mine_orders.size()*sizeof(MineId);
+    return byte_count;
+}
+
+const int MacroList::capacity;
+
+MacroList::MacroList() :
+    size(0)
+{
+}
+
+MacroList
+enumerate_macros(const State& state, const int& hero_index, const PathCache& cache)
+{
+    const Grid& grid = cache.grid;
+    const State::Hero& hero = state.heroes[hero_index];
+    const PositionIndex index = grid.get_index(hero.position);
+
+    MacroList macros;
+
+    // closest mines not owned yet
+    const MineId* closest_mines = cache.get_closest_mines(index);
+    for (int kk=0, mine_count=0; kk<static_cast<int>(grid.mines.size()) && mine_count<max_mine_macros; kk++)
+    {
+        const MineId mine_id = closest_mines[kk];
+        if (mine_id == Grid::no_mine) break;
+        if (hero.mines.contains(mine_id)) continue;
+        macros.push_back(Macro(MACRO_MINE, grid.mines[mine_id]));
+        mine_count++;
+    }
+
+    // closest tavern when it can pay and is hurt
+    if (hero.gold >= 2 && hero.life <= 80)
+    {
+        Distance best_distance = -1;
+        PositionIndex best_tavern = 0;
+        Bitboard taverns(grid.taverns);
+        for (int tavern=taverns.pop_first(); tavern>=0; tavern=taverns.pop_first())
+        {
+            const Distance distance = cache.get_distance(index, tavern);
+            if (distance < 0 || (best_distance >= 0 && distance >= best_distance)) continue;
+            best_distance = distance;
+            best_tavern = tavern;
+        }
+        if (best_distance >= 0) macros.push_back(Macro(MACRO_TAVERN, best_tavern));
+    }
+
+    // weaker opponents worth killing
+    for (int kk=0; kk<4; kk++)
+    {
+        if (kk == hero_index) continue;
+        const State::Hero& opponent = state.heroes[kk];
+        if (opponent.mines.size() == 0 || opponent.life >= hero.life) continue;
+        if (cache.get_distance(index, grid.get_index(opponent.position)) < 0) continue;
+        macros.push_back(Macro(MACRO_HERO, kk));
+    }
+
+    macros.push_back(Macro(MACRO_WAIT));
+
+    return macros;
+}
+
+static
+PositionIndex
+get_macro_target(const State& state, const Macro& macro, const Grid& grid)
+{
+    return macro.kind == MACRO_HERO ? grid.get_index(state.heroes[macro.target].position) : macro.target;
+}
+
+Direction
+get_macro_direction(const State& state, const int& hero_index, const Macro& macro, const PathCache& cache)
+{
+    if (macro.kind == MACRO_WAIT) return STAY;
+    const PositionIndex index = cache.grid.get_index(state.heroes[hero_index].position);
+    return cache.get_direction(index, get_macro_target(state, macro, cache.grid));
+}
+
+int
+apply_macro(State& state, const Macro& macro, const PathCache& cache, int& turns_left, Rng& rng)
+{
+    const int hero_index = state.next_hero_index;
+    UniformRng<int> uniform(rng, 5);
+
+    int move_count = 0;
+    while (turns_left > 0 && move_count < max_macro_moves)
+    {
+        assert( state.next_hero_index == hero_index );
+
+        // the move into a mine or tavern, or next to a hero, is the last one
+        bool is_last = true;
+        Direction direction = STAY;
+        if (macro.kind != MACRO_WAIT)
+        {
+            const PositionIndex index = cache.grid.get_index(state.heroes[hero_index].position);
+            const PositionIndex target = get_macro_target(state, macro, cache.grid);
+            const Distance distance = cache.get_distance(index, target);
+            direction = cache.get_direction(index, target);
+            is_last = distance <= (macro.kind == MACRO_HERO ? 2 : 1);
+        }
+
+        state.update(direction);
+        turns_left--;
+        move_count++;
+
+        for (int kk=0; kk<3 && turns_left>0; kk++, turns_left--)
+            state.update(static_cast<Direction>(uniform()));
+
+        if (is_last) break;
+    }
+
+    return move_count;
+}
+
+MacroNode::MacroNode() :
+    macro(),
+    visits(0),
+    value(0)
+{
+    std::fill(children.begin(), children.end(), static_cast<MacroNode*>(NULL));
+}
+
+MacroTree::MacroTree(const size_t& max_bytes) :
+    playout_count(0),
+    max_depth(0),
+    cache(NULL),
+    pool(max_bytes),
+    root(NULL),
+    root_state(),
+    root_turns_left(0),
+    path()
+{
+}
+
+void
+MacroTree::reset(const PathCache& cache_value, const State& state, const int& turns_left)
+{
+    cache = &cache_value;
+    pool.reset();
+    root = pool.allocate();
+    assert( root );
+    root_state.reset(new State(state));
+    root_turns_left = turns_left;
+    playout_count = 0;
+    max_depth = 0;
+}
+
+void
+MacroTree::run(const CancellationToken& token, Rng& rng)
+{
+    assert( root && root_state );
+    while (!token.is_cancelled())
+        for (int kk=0; kk<4; kk++)
+            playout(rng);
+}
+
+void
+MacroTree::run_playouts(const int& count, Rng& rng)
+{
+    assert( root && root_state );
+    for (int kk=0; kk<count; kk++)
+        playout(rng);
+}
+
+void
+MacroTree::playout(Rng& rng)
+{
+    State state(*root_state);
+    const int hero_index = state.next_hero_index;
+    int turns_left = root_turns_left;
+
+    path.clear();
+    MacroNode* node = root;
+    while (turns_left > 0)
+    {
+        const MacroList macros = enumerate_macros(state, hero_index, *cache);
+
+        // children of the macros available from this state
+        boost::array<MacroNode*, MacroList::capacity> matches;
+        int unexpanded_count = 0;
+        boost::array<int, MacroList::capacity> unexpanded;
+        for (int kk=0; kk<macros.size; kk++)
+        {
+            matches[kk] = NULL;
+            for (int ll=0; ll<MacroList::capacity && node->children[ll]; ll++)
+                if (node->children[ll]->macro == macros.macros[kk]) matches[kk] = node->children[ll];
+            if (!matches[kk]) unexpanded[unexpanded_count++] = kk;
+        }
+
+        // children slots fill up when states under a node differ a lot
+        int slot = 0;
+        while (slot < MacroList::capacity && node->children[slot]) slot++;
+
+        MacroNode* child = NULL;
+        bool expanded = false;
+        if (unexpanded_count > 0 && slot < MacroList::capacity)
+        {
+            child = pool.allocate();
+            if (!child) break; // out of budget, roll out from here
+
+            SizeRng<int> size_rng(rng);
+            child->macro = macros.macros[unexpanded[size_rng(unexpanded_count)]];
+            node->children[slot] = child;
+            expanded = true;
+        }
+        else
+        {
+            const float log_visits = std::log(static_cast<float>(node->visits+1));
+            float best_score = -1;
+            for (int kk=0; kk<macros.size; kk++)
+            {
+                const MacroNode* match = matches[kk];
+                if (!match || !match->visits) continue;
+                const float score = match->value/match->visits + exploration*std::sqrt(log_visits/match->visits);
+                if (score <= best_score) continue;
+                best_score = score;
+                child = matches[kk];
+            }
+            if (!child) break;
+        }
+
+        apply_macro(state, child->macro, *cache, turns_left, rng);
+        node = child;
+        path.push_back(node);
+
+        if (expanded) break;
+    }
+
+    max_depth = std::max(max_depth, root_turns_left-turns_left);
+
+    for (int kk=0; kk<rollout_macro_count && turns_left>0; kk++)
+    {
+        const MacroList macros = enumerate_macros(state, hero_index, *cache);
+        SizeRng<int> size_rng(rng);
+        apply_macro(state, macros.macros[size_rng(macros.size)], *cache, turns_left, rng);
+    }
+
+    const float reward = get_rewards(state, turns_left)[hero_index];
+
+    root->visits++;
+    for (std::vector<MacroNode*>::const_iterator pi=path.begin(), pie=path.end(); pi!=pie; pi++)
+    {
+        (*pi)->visits++;
+        (*pi)->value += reward;
+    }
+
+    playout_count++;
+}
+
+std::pair<Macro, unsigned int>
+MacroTree::get_best_macro() const
+{
+    std::pair<Macro, unsigned int> best(Macro(), 0);
+    for (int kk=0; kk<MacroList::capacity && root->children[kk]; kk++)
+        if (root->children[kk]->visits > best.second)
+            best = std::make_pair(root->children[kk]->macro, root->children[kk]->visits);
+    return best;
+}
+
+unsigned int
+MacroTree::get_macro_visits(const Macro& macro) const
+{
+    for (int kk=0; kk<MacroList::capacity && root->children[kk]; kk++)
+        if (root->children[kk]->macro == macro) return root->children[kk]->visits;
+    return 0;
+}
+
+size_t
+MacroTree::get_node_count() const
+{
+    return pool.get_live_count();
+}
+
+// Offline game on the benchmark board between a macro search and a raw
+// direction search given the same number of playouts per move, the two
+// other heroes moving randomly. Return the ranks of the two searches.
+static
+std::pair<int, int>
+play_macro_game(const Grid& grid, const PTree& root, const HashedPair<Tiles>& hashed_background_tiles, const PathCache& cache, const int& macro_hero_index, const int& playout_count, Rng& rng, int& macro_depth, int& direction_depth)
+{
+    const int direction_hero_index = 1-macro_hero_index;
+    const int turn_max = root.get<int>("game.maxTurns");
+    State state(root, hashed_background_tiles, grid);
+
+    MacroTree macro_tree(16*1024*1024);
+    SearchTree direction_tree(16*1024*1024);
+    UniformRng<int> uniform(rng, 5);
+
+    for (int turn=0; turn<turn_max; turn++)
+    {
+        const int hero_index = state.next_hero_index;
+        Direction direction = static_cast<Direction>(uniform());
+        if (hero_index == macro_hero_index)
+        {
+            macro_tree.reset(cache, state, turn_max-turn);
+            macro_tree.run_playouts(playout_count, rng);
+            direction = get_macro_direction(state, hero_index, macro_tree.get_best_macro().first, cache);
+            macro_depth = std::max(macro_depth, macro_tree.max_depth);
+        }
+        if (hero_index == direction_hero_index)
+        {
+            direction_tree.reset(state, turn_max-turn);
+            direction_tree.run_playouts(playout_count, rng);
+            const DirectionVisits visits = direction_tree.get_root_visits();
+            direction = static_cast<Direction>(std::max_element(visits.begin(), visits.end())-visits.begin());
+        }
+        state.update(direction);
+    }
+
+    // one tree level per half turn
+    direction_depth = std::max(direction_depth, static_cast<int>(std::log(static_cast<double>(playout_count))/std::log(5.)));
+
+    const boost::array<int, 4> ranks = state.get_ranks();
+    return std::make_pair(ranks[macro_hero_index], ranks[direction_hero_index]);
+}
+
+void
+test_macro()
+{
+    std::cout << "Doing macro test...\n";
+
+    const Tiles tiles = make_benchmark_tiles(18);
+    const PTree root = make_initial_state_json(tiles, 400);
+    const Tiles background_tiles = neutralize_tiles(tiles);
+    const HashedPair<Tiles> hashed_background_tiles(background_tiles);
+    const Grid grid(background_tiles);
+    const State state(root, hashed_background_tiles, grid);
+
+    const double start_time = get_double_time();
+    const PathCache cache(grid);
+    const double end_time = get_double_time();
+    std::cout << "path cache " << cache.get_byte_count()/1024 << "kB in " << clock_it(end_time-start_time) << std::endl;
+
+    // every macro direction follows a shortest path
+    for (int hero_index=0; hero_index<4; hero_index++)
+    {
+        const MacroList macros = enumerate_macros(state, hero_index, cache);
+        assert( macros.size >= 2 );
+        assert( macros.macros[macros.size-1].kind == MACRO_WAIT );
+
+        const PositionIndex index = grid.get_index(state.heroes[hero_index].position);
+        for (int kk=0; kk<macros.size; kk++)
+        {
+            const Macro& macro = macros.macros[kk];
+            if (macro.kind == MACRO_WAIT) continue;
+            const PositionIndex target = get_macro_target(state, macro, grid);
+            const Direction direction = get_macro_direction(state, hero_index, macro, cache);
+            const PositionIndex next = grid.get_neighbor(index, direction);
+            assert( direction != STAY );
+            assert( next == target || cache.get_distance(next, target) == cache.get_distance(index, target)-1 );
+        }
+    }
+
+    // a mine macro ends with the mine taken
+    {
+        Rng rng(42);
+        State state_prime(state);
+        int turns_left = 400;
+        const Macro macro = enumerate_macros(state_prime, 0, cache).macros[0];
+        assert( macro.kind == MACRO_MINE );
+        const int move_count = apply_macro(state_prime, macro, cache, turns_left, rng);
+        assert( move_count == cache.get_distance(grid.get_index(state.heroes[0].position), macro.target) );
+        assert( state_prime.heroes[0].mines.contains(grid.get_mine_id(macro.target)) || state_prime.heroes[0].life < state.heroes[0].life );
+        assert( turns_left == 400-4*move_count );
+    }
+
+    // offline games at equal playouts, seats swapped every game
+    Rng rng(42);
+    const int game_count = 4;
+    const int playout_count = 200;
+    boost::array<int, 2> rank_sums = {{0, 0}};
+    int macro_depth = 0;
+    int direction_depth = 0;
+    int macro_wins = 0;
+    const double games_start_time = get_double_time();
+    for (int game=0; game<game_count; game++)
+    {
+        const std::pair<int, int> ranks = play_macro_game(grid, root, hashed_background_tiles, cache, game%2, playout_count, rng, macro_depth, direction_depth);
+        rank_sums[0] += ranks.first;
+        rank_sums[1] += ranks.second;
+        if (ranks.first < ranks.second) macro_wins++;
+    }
+    const double games_end_time = get_double_time();
+
+    std::cout << game_count << " games " << playout_count << " playouts per move in " << clock_it(games_end_time-games_start_time) << std::endl;
+    std::cout << "macro mean rank " << static_cast<double>(rank_sums[0])/game_count << " depth " << macro_depth << " half turns" << std::endl;
+    std::cout << "direction mean rank " << static_cast<double>(rank_sums[1])/game_count << " depth ~" << direction_depth << " half turns" << std::endl;
+    std::cout << "macro ahead in " << macro_wins << "/" << game_count << " games" << std::endl;
+
+    std::cout << "...done!\n";
+}
+
@@ -0,0 +1,162 @@
+#pragma once
+
+#include "search_tree.h"
+
+enum MacroKind
+{
+    MACRO_WAIT, // stay for one move
+    MACRO_MINE, // walk into a mine
+    MACRO_TAVERN, // walk into a tavern
+    MACRO_HERO // walk next to a hero
+};
+
+struct Macro
+{
+    Macro(const MacroKind& kind=MACRO_WAIT, const PositionIndex& target=0);
+
+    MacroKind kind;
+    PositionIndex target; // cell, or hero index for MACRO_HERO
+};
+
+bool
+operator==(const Macro& macro_aa, const Macro& macro_bb);
+
+std::ostream&
+operator<<(std::ostream& os, const Macro& macro);
+
+// Shortest path distances towards every cell a hero can stand on or walk
+// into, computed once per board. Read only afterwards, so searches on
+// several threads share one cache.
+struct PathCache
+{
+    PathCache(const Grid& grid);
+
+    /// Moves from index to target, -1 when unreachable.
+    Distance
+    get_distance(const PositionIndex& index, const PositionIndex& target) const
+    {
+        const Distances& distances = fields[target];
+        return distances.empty() ? -1 : distances[index];
+    }
+
+    /// First move of a shortest path from index to target, STAY when there or
+    /// unreachable.
+    Direction
+    get_direction(const PositionIndex& index, const PositionIndex& target) const;
+
+    /// Mines reachable from index, closest first, Grid::no_mine after the
+    /// last one.
+    const MineId*
+    get_closest_mines(const PositionIndex& index) const
+    {
+        return mine_orders.data() + index*grid.mines.size();
+    }
+
+    size_t
+    get_byte_count() const;
+
+    const Grid& grid;
+
+private:
+
+    typedef std::vector<Distances> Fields;
+    typedef std::vector<MineId> MineOrders;
+
+    Fields fields; // distances towards each target cell, empty when not a target
+    MineOrders mine_orders; // closest mines of each cell, grid.mines.size() per cell
+};
+
+struct MacroList
+{
+    static const int capacity = 8;
+
+    MacroList();
+
+    void
+    push_back(const Macro& macro)
+    {
+        assert( size < capacity );
+        macros[size++] = macro;
+    }
+
+    boost::array<Macro, capacity> macros;
+    int size;
+};
+
+/// Useful plans for hero_index: the closest mines it does not own, the
+/// closest tavern when hurt, weaker opponents holding mines and waiting.
+MacroList
+enumerate_macros(const State& state, const int& hero_index, const PathCache& cache);
+
+Direction
+get_macro_direction(const State& state, const int& hero_index, const Macro& macro, const PathCache& cache);
+
+/// Play macro for the hero to move until it completes, the others playing
+/// random moves in between. Return the number of moves of the hero.
+int
+apply_macro(State& state, const Macro& macro, const PathCache& cache, int& turns_left, Rng& rng);
+
+struct MacroNode
+{
+    MacroNode();
+
+    boost::array<MacroNode*, MacroList::capacity> children;
+    Macro macro; // macro leading to this node
+    unsigned int visits;
+    float value; // reward sum of the searching hero
+};
+
+typedef NodePool<MacroNode> MacroNodePool;
+typedef boost::array<unsigned int, MacroList::capacity> MacroVisits;
+
+// Open loop UCT over the macros of one hero, the others playing random
+// moves. A node is a whole plan instead of one move, so the same node
+// budget looks much further ahead than SearchTree. Children are matched to
+// the macros enumerated at each visit since the state reached under a node
+// changes with the random moves of the opponents. The tree is not bound to a
+// map, every reset gives the path cache of the new root.
+struct MacroTree
+{
+    MacroTree(const size_t& max_bytes);
+
+    void
+    reset(const PathCache& cache, const State& state, const int& turns_left);
+
+    void
+    run(const CancellationToken& token, Rng& rng);
+
+    void
+    run_playouts(const int& count, Rng& rng);
+
+    /// Most visited macro at the root with its visit count.
+    std::pair<Macro, unsigned int>
+    get_best_macro() const;
+
+    /// Root visits of macro, 0 when it was never tried.
+    unsigned int
+    get_macro_visits(const Macro& macro) const;
+
+    size_t
+    get_node_count() const;
+
+    int playout_count;
+    int max_depth; // deepest playout in half turns
+
+private:
+
+    MacroTree(const MacroTree& tree); // no copy
+
+    void
+    playout(Rng& rng);
+
+    const PathCache* cache; // of the root map, NULL before the first reset
+    MacroNodePool pool;
+    MacroNode* root;
+    boost::scoped_ptr<State> root_state;
+    int root_turns_left;
+    std::vector<MacroNode*> path;
+};
+
+void
+test_macro();
+
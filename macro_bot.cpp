@@ -0,0 +1,172 @@
+#include "macro_bot.h"
+
+#include "logger.h"
+#include <limits>
+#include <chrono>
+#include <thread>
+#include <boost/bind/bind.hpp>
+
+static
+PathCache*
+make_path_cache(const Grid& grid)
+{
+    return new PathCache(grid);
+}
+
+// Walk to the closest mine the hero does not own, or to the closest tavern
+// when low on life. Two bfs per move, used until the path cache is ready.
+static
+Direction
+get_fallback_direction(const State& state, const Grid& grid)
+{
+    const State::Hero& hero = state.heroes[state.next_hero_index];
+    const PositionIndex index = grid.get_index(hero.position);
+
+    Distances distances;
+    grid.kernels.fill_distances(grid, index, distances);
+
+    PositionIndex target = index;
+    Distance target_distance = std::numeric_limits<Distance>::max();
+    if (hero.life > 30)
+        for (int mine_id=0; mine_id<static_cast<int>(grid.mines.size()); mine_id++)
+        {
+            const Distance distance = distances[grid.mines[mine_id]];
+            if (hero.mines.contains(mine_id) || distance <= 0 || distance >= target_distance) continue;
+            target = grid.mines[mine_id];
+            target_distance = distance;
+        }
+    if (target == index)
+    {
+        // step down the tavern distances
+        const Distance distance = grid.tavern_distances[index];
+        if (distance <= 0) return STAY;
+        for (int direction=NORTH; direction<=WEST; direction++)
+        {
+            const PositionIndex neighbor = grid.get_neighbor(index, static_cast<Direction>(direction));
+            if (grid.taverns.test(neighbor)) return static_cast<Direction>(direction);
+            if (grid.passable.test(neighbor) && grid.tavern_distances[neighbor] == distance-1) return static_cast<Direction>(direction);
+        }
+        return STAY;
+    }
+
+    grid.kernels.fill_distances(grid, target, distances);
+    for (int direction=NORTH; direction<=WEST; direction++)
+    {
+        const PositionIndex neighbor = grid.get_neighbor(index, static_cast<Direction>(direction));
+        if (neighbor == target) return static_cast<Direction>(direction);
+        if (grid.passable.test(neighbor) && distances[neighbor] == target_distance-1) return static_cast<Direction>(direction);
+    }
+
+    assert( false );
+    return STAY;
+}
+
+MapData::MapData(const Game& game) :
+    grid(game.background_grid),
+    cache_stage(),
+    pipeline()
+{
+    pipeline.start(cache_stage, boost::bind(make_path_cache, boost::cref(grid)));
+}
+
+static
+MapData*
+make_map_data(const Game& game)
+{
+    return new MapData(game);
+}
+
+BotTables::BotTables(const Options& opt) :
+    trees(),
+    maps(8)
+{
+    const int thread_count = get_scheduler().get_worker_count();
+    const size_t tree_bytes = static_cast<size_t>(opt.search_memory)*1024*1024/thread_count;
+    for (int kk=0; kk<thread_count; kk++)
+        trees.push_back(new MacroTree(tree_bytes));
+}
+
+Bot::Bot(const Options& opt, const Game& game, Rng& rng, BotTables& tables) :
+    grid(game.background_grid),
+    map_data(tables.maps.get(game.get_map_key(), boost::bind(make_map_data, boost::cref(game)))),
+    trees(tables.trees),
+    rngs(),
+    is_cache_ready(false),
+    rng(rng)
+{
+    // the next bot made from rng, next game or connection, searches other streams
+    const Rng bot_rng = rng.split();
+    for (int kk=0; kk<static_cast<int>(trees.size()); kk++)
+        rngs.push_back(bot_rng.get_stream(kk));
+}
+
+void
+Bot::search(const int& tree_index, const CancellationToken& token)
+{
+    trees[tree_index].run(token, rngs[tree_index]);
+}
+
+Direction
+Bot::get_move(const Game& game, const CancellationToken& token)
+{
+    const double start_time = get_double_time();
+    const int turns_left = game.turn_max - game.turn;
+
+    // the path cache may come in during the move budget, the stage itself
+    // runs on a worker in the background
+    const StartupStage<PathCache>& cache_stage = map_data->cache_stage;
+    const PathCache* cache = cache_stage.get();
+    while (!cache && !token.is_cancelled())
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+        cache = cache_stage.get();
+    }
+    if (!cache)
+    {
+        const Direction direction = get_fallback_direction(game.state, grid);
+        LogLine(LOG_INFO) << "path cache not ready, closest mine " << direction << " " << clock_it(get_double_time()-start_time);
+        return direction;
+    }
+
+    if (!is_cache_ready)
+    {
+        LogLine(LOG_INFO) << "path cache " << cache->get_byte_count()/1024 << "kB ready after " << clock_it(cache_stage.duration);
+        is_cache_ready = true;
+    }
+
+    // macros are replanned every move, nothing is kept between turns
+    for (MacroTrees::iterator ti=trees.begin(), tie=trees.end(); ti!=tie; ti++)
+        ti->reset(*cache, game.state, turns_left);
+
+    get_scheduler().parallel_for(trees.size(), boost::bind(&Bot::search, this, boost::placeholders::_1, boost::cref(token)));
+
+    // merge the root visits of every tree by macro
+    const MacroList macros = enumerate_macros(game.state, game.state.next_hero_index, *cache);
+    MacroVisits visits;
+    std::fill(visits.begin(), visits.end(), 0);
+    int playout_count = 0;
+    int max_depth = 0;
+    size_t node_count = 0;
+    for (MacroTrees::const_iterator ti=trees.begin(), tie=trees.end(); ti!=tie; ti++)
+    {
+        for (int kk=0; kk<macros.size; kk++)
+            visits[kk] += ti->get_macro_visits(macros.macros[kk]);
+        playout_count += ti->playout_count;
+        max_depth = std::max(max_depth, ti->max_depth);
+        node_count += ti->get_node_count();
+    }
+
+    const int best = std::max_element(visits.begin(), visits.begin()+macros.size)-visits.begin();
+    const Macro& macro = macros.macros[best];
+
+    LogLine(LOG_INFO) << "macro search " << playout_count << " playouts " << node_count << " nodes depth " << max_depth << " " << clock_it(get_double_time()-start_time);
+    LogLine(LOG_INFO) << "macro " << macro << " " << visits[best] << " visits";
+
+    return get_macro_direction(game.state, game.state.next_hero_index, macro, *cache);
+}
+
+void
+Bot::advance_game(Game& game, const Direction& direction)
+{
+}
+
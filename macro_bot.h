@@ -0,0 +1,62 @@
+#pragma once
+
+#include "game.h"
+#include "macro.h"
+#include "startup.h"
+#include <vector>
+#include <boost/ptr_container/ptr_vector.hpp>
+
+// Path cache of one map, computed on a worker when the map first comes in.
+struct MapData
+{
+    MapData(const Game& game);
+
+    const Grid grid;
+    StartupStage<PathCache> cache_stage; // shared by every tree once published
+    StartupPipeline pipeline;
+};
+
+// One macro tree per worker, --search-memory MB in all, made once and kept
+// across games. Trees are replanned every move on the cache of the game.
+struct BotTables
+{
+    typedef boost::ptr_vector<MacroTree> MacroTrees;
+
+    BotTables(const Options& opt);
+
+    MacroTrees trees;
+    MapTables<MapData> maps; // of the last 8 maps, more while played
+
+private:
+
+    BotTables(const BotTables& tables); // no copy
+};
+
+// UCT over macro actions: walk to a mine, to a tavern or next to a hero.
+struct Bot
+{
+    Bot(const Options& opt, const Game& game, Rng& rng, BotTables& tables);
+
+    Direction
+    get_move(const Game& game, const CancellationToken& token); // token may be cut during the search
+
+    void
+    advance_game(Game& game, const Direction& direction);
+
+private:
+
+    typedef BotTables::MacroTrees MacroTrees;
+    typedef std::vector<Rng> Rngs;
+
+    void
+    search(const int& tree_index, const CancellationToken& token);
+
+    const Grid& grid;
+    const MapTables<MapData>::EntryPointer map_data;
+    MacroTrees& trees; // of the bot tables, one per worker
+    Rngs rngs;
+    bool is_cache_ready; // once the path cache was first used
+    Rng& rng;
+
+};
+
@@ -0,0 +1,266 @@
+#include "map_generator.h"
+
+#include "game.h"
+#include "macro.h"
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+#include <boost/random/bernoulli_distribution.hpp>
+
+MapParameters::MapParameters() :
+    size(18),
+    wall_density(.3),
+    mine_count(16),
+    tavern_count(4),
+    seed(42)
+{
+}
+
+typedef std::vector<Position> Positions;
+typedef std::vector<bool> Flags;
+
+// The four images of position under the mirrors of both axes.
+static
+void
+set_mirrored(Tiles& tiles, const Position& position, const Tile& tile)
+{
+    static const Transform mirrors[4] = {IDENTITY, FLIP_ROWS, FLIP_COLUMNS, ROTATE_180};
+
+    const int size = tiles.shape()[0];
+    for (int kk=0; kk<4; kk++)
+    {
+        const Position image = transform_position(position, mirrors[kk], size);
+        tiles[image.x][image.y] = tile;
+    }
+}
+
+// Empty tiles reachable from source, by row major index.
+static
+Flags
+get_reachable(const Tiles& tiles, const Position& source)
+{
+    const int size = tiles.shape()[0];
+    Flags reachable(size*size, false);
+
+    Positions queue;
+    queue.push_back(source);
+    reachable[source.x*size+source.y] = true;
+    for (size_t head=0; head<queue.size(); head++)
+        for (int direction=NORTH; direction<=WEST; direction++)
+        {
+            Position neighbor(queue[head]);
+            neighbor.with_direction(static_cast<Direction>(direction));
+            if (get_tile_border_check(tiles, neighbor) != EMPTY || reachable[neighbor.x*size+neighbor.y]) continue;
+            reachable[neighbor.x*size+neighbor.y] = true;
+            queue.push_back(neighbor);
+        }
+
+    return reachable;
+}
+
+static
+bool
+is_next_to_reachable(const Tiles& tiles, const Flags& reachable, const Position& position)
+{
+    const int size = tiles.shape()[0];
+    for (int direction=NORTH; direction<=WEST; direction++)
+    {
+        Position neighbor(position);
+        neighbor.with_direction(static_cast<Direction>(direction));
+        if (get_tile_border_check(tiles, neighbor) == EMPTY && reachable[neighbor.x*size+neighbor.y]) return true;
+    }
+    return false;
+}
+
+Tiles
+generate_map(const MapParameters& parameters)
+{
+    const int& size = parameters.size;
+    if (size < 6 || size > 256 || size%2 != 0) throw std::runtime_error("map size must be even, from 6 to 256");
+    if (parameters.wall_density < 0 || parameters.wall_density >= 1) throw std::runtime_error("wall density must be in [0,1)");
+    if (parameters.mine_count < 0 || parameters.mine_count%4 != 0) throw std::runtime_error("mine count must be a multiple of 4");
+    if (parameters.tavern_count < 0 || parameters.tavern_count%4 != 0) throw std::runtime_error("tavern count must be a multiple of 4");
+
+    // each quadrant holds a quarter of everything, next to the corridor
+    const int quadrant = size/2;
+    const int item_count = (parameters.mine_count+parameters.tavern_count)/4;
+    if (item_count > (quadrant-1)*(quadrant-1)-1) throw std::runtime_error("too many mines and taverns for the map size");
+
+    Rng rng(parameters.seed);
+    SizeRng<int> size_rng(rng);
+    boost::random::bernoulli_distribution<double> is_wood(parameters.wall_density);
+
+    Tiles tiles(boost::extents[size][size]);
+    for (int ii=0; ii<quadrant; ii++)
+        for (int jj=0; jj<quadrant; jj++)
+            set_mirrored(tiles, Position(ii,jj), is_wood(rng) ? WOOD : EMPTY);
+
+    // a corridor from the spawn to the center joins the four quadrants, the
+    // spawns stay one tile away from the middle lines
+    const Position spawn(size_rng(quadrant-1), size_rng(quadrant-1));
+    Flags corridor(quadrant*quadrant, false);
+    for (int ii=spawn.x; ii<quadrant; ii++)
+    {
+        corridor[ii*quadrant+spawn.y] = true;
+        set_mirrored(tiles, Position(ii,spawn.y), EMPTY);
+    }
+    for (int jj=spawn.y; jj<quadrant; jj++)
+    {
+        corridor[(quadrant-1)*quadrant+jj] = true;
+        set_mirrored(tiles, Position(quadrant-1,jj), EMPTY);
+    }
+
+    Positions candidates;
+    for (int ii=0; ii<quadrant; ii++)
+        for (int jj=0; jj<quadrant; jj++)
+            if (!corridor[ii*quadrant+jj]) candidates.push_back(Position(ii,jj));
+    assert( static_cast<int>(candidates.size()) >= item_count );
+    std::random_shuffle(candidates.begin(), candidates.end(), size_rng);
+
+    Positions items(candidates.begin(), candidates.begin()+item_count);
+    for (int kk=0; kk<item_count; kk++)
+        set_mirrored(tiles, items[kk], kk < parameters.mine_count/4 ? MINE : TAVERN);
+
+    // wall off what the spawns can't reach. The reachable area is mirrored
+    // too since the corridors meet at the center.
+    const Flags reachable = get_reachable(tiles, spawn);
+    for (int ii=0; ii<size; ii++)
+        for (int jj=0; jj<size; jj++)
+            if (tiles[ii][jj] == EMPTY && !reachable[ii*size+jj]) tiles[ii][jj] = WOOD;
+
+    // items cut off by walls or other items move onto a wall next to the
+    // reachable area, which can't disconnect it
+    Positions stranded;
+    for (Positions::iterator ii=items.begin(), iie=items.end(); ii!=iie; ii++)
+        if (!is_next_to_reachable(tiles, reachable, *ii)) stranded.push_back(*ii);
+    for (Positions::const_iterator si=stranded.begin(), sie=stranded.end(); si!=sie; si++)
+    {
+        const Tile tile = tiles[si->x][si->y];
+        set_mirrored(tiles, *si, WOOD);
+
+        Positions walls;
+        for (int ii=0; ii<quadrant; ii++)
+            for (int jj=0; jj<quadrant; jj++)
+                if (tiles[ii][jj] == WOOD && is_next_to_reachable(tiles, reachable, Position(ii,jj))) walls.push_back(Position(ii,jj));
+        if (walls.empty()) throw std::runtime_error("no room next to the reachable area for the mines and taverns");
+
+        set_mirrored(tiles, walls[size_rng(walls.size())], tile);
+    }
+
+    const int last = size-1;
+    tiles[spawn.x][spawn.y] = HERO1;
+    tiles[last-spawn.x][spawn.y] = HERO2;
+    tiles[last-spawn.x][last-spawn.y] = HERO3;
+    tiles[spawn.x][last-spawn.y] = HERO4;
+
+    return tiles;
+}
+
+static
+int
+count_tiles(const Tiles& tiles, const Tile& tile)
+{
+    return std::count(tiles.origin(), tiles.origin()+tiles.num_elements(), tile);
+}
+
+void
+test_map_generator()
+{
+    std::cout << "Doing map generator test...\n";
+
+    {
+        MapParameters parameters;
+        bool is_rejected = false;
+        parameters.size = 17;
+        try { generate_map(parameters); } catch (std::runtime_error&) { is_rejected = true; }
+        assert( is_rejected );
+        is_rejected = false;
+        parameters.size = 18;
+        parameters.mine_count = 6;
+        try { generate_map(parameters); } catch (std::runtime_error&) { is_rejected = true; }
+        assert( is_rejected );
+    }
+
+    // valid boards over the whole range, the grid stops at its bitboard capacity
+    const int sizes[] = {10, 18, 28, 30, 64, 128, 256};
+    for (int kk=0; kk<static_cast<int>(sizeof(sizes)/sizeof(sizes[0])); kk++)
+    {
+        const int size = sizes[kk];
+        for (int density=0; density<3; density++)
+        {
+            MapParameters parameters;
+            parameters.size = size;
+            parameters.wall_density = .2*density;
+            parameters.mine_count = 4*std::min(60, size*size/64);
+            parameters.tavern_count = 4+4*(size/64);
+            parameters.seed = 1000+density;
+
+            const double start_time = get_double_time();
+            const Tiles tiles = generate_map(parameters);
+            const double generate_time = get_double_time()-start_time;
+
+            assert( hash_value(generate_map(parameters)) == hash_value(tiles) );
+            assert( count_tiles(tiles, MINE) == parameters.mine_count );
+            assert( count_tiles(tiles, TAVERN) == parameters.tavern_count );
+            assert( count_tiles(tiles, HERO1) == 1 && count_tiles(tiles, HERO4) == 1 );
+
+            const Transforms symmetries = detect_symmetries(tiles);
+            assert( std::find(symmetries.begin(), symmetries.end(), FLIP_ROWS) != symmetries.end() );
+            assert( std::find(symmetries.begin(), symmetries.end(), FLIP_COLUMNS) != symmetries.end() );
+
+            // everything is reachable from the first spawn
+            const Tiles background_tiles = neutralize_tiles(tiles);
+            Position spawn;
+            for (int ii=0; ii<size; ii++)
+                for (int jj=0; jj<size; jj++)
+                    if (tiles[ii][jj] == HERO1) spawn = Position(ii,jj);
+            const Flags reachable = get_reachable(background_tiles, spawn);
+            for (int ii=0; ii<size; ii++)
+                for (int jj=0; jj<size; jj++)
+                {
+                    const Tile tile = background_tiles[ii][jj];
+                    if (tile == EMPTY) assert( reachable[ii*size+jj] );
+                    if (tile == MINE || tile == TAVERN) assert( is_next_to_reachable(background_tiles, reachable, Position(ii,jj)) );
+                }
+
+            // both formats the client and the tools load
+            const double format_start_time = get_double_time();
+            const Tiles tiles_prime = parse_tiles(size, serialize_tiles(tiles));
+            std::stringstream stream;
+            stream << tiles;
+            const Tiles tiles_second = read_tiles(stream);
+            const double format_time = get_double_time()-format_start_time;
+            assert( hash_value(tiles_prime) == hash_value(tiles) );
+            assert( hash_value(tiles_second) == hash_value(tiles) );
+
+            std::cout << size << "x" << size << " density " << parameters.wall_density << " " << count_tiles(tiles, WOOD) << " walls generate " << clock_it(generate_time) << " formats " << clock_it(format_time);
+
+            if ((size+2)*(size+2) > Bitboard::capacity)
+            {
+                std::cout << " past the grid capacity" << std::endl;
+                continue;
+            }
+
+            const double game_start_time = get_double_time();
+            const Game game(make_initial_state_json(tiles, 1200));
+            const double cache_start_time = get_double_time();
+            const PathCache cache(game.background_grid);
+            const double cache_end_time = get_double_time();
+            assert( game.symmetries.symmetries.size() >= 2 );
+
+            Rng rng(42);
+            UniformRng<int> uniform(rng, 5);
+            const int payload = 100000;
+            State state(game.state);
+            const double update_start_time = get_double_time();
+            for (int ll=0; ll<payload; ll++)
+                state.update(static_cast<Direction>(uniform()));
+            const double update_end_time = get_double_time();
+
+            std::cout << " game " << clock_it(cache_start_time-game_start_time) << " path cache " << clock_it(cache_end_time-cache_start_time) << " update " << 1e9*(update_end_time-update_start_time)/payload << "ns" << std::endl;
+        }
+    }
+
+    std::cout << "...done!\n";
+}
+
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "tiles.h"
+#include "utils.h"
+
+struct MapParameters
+{
+    MapParameters();
+
+    int size; // even, from 6 to 256
+    double wall_density; // chance of a wood tile before the board is connected
+    int mine_count; // multiple of 4
+    int tavern_count; // multiple of 4
+    uint64_t seed;
+};
+
+/// Random board mirrored on both axes like the server maps, the heroes
+/// spawning around the corners. Every empty tile is reachable from every
+/// spawn and every mine and tavern is next to a reachable tile. Throws
+/// std::runtime_error on parameters no board can satisfy.
+Tiles
+generate_map(const MapParameters& parameters);
+
+void
+test_map_generator();
+
@@ -0,0 +1,85 @@
+#include "map_generator.h"
+#include "grid.h"
+#include "network.h"
+
+#include <fstream>
+#include <stdexcept>
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/variables_map.hpp>
+#include <boost/program_options/parsers.hpp>
+namespace po = boost::program_options;
+
+// Random symmetric maps for benchmarks, written both as a board like the
+// ones saved by --collect-map and as the initial game state the server sends.
+
+int main(int argc, char* argv[])
+{
+    MapParameters parameters;
+    int turn_max;
+    std::string output;
+
+    po::options_description po_options("map_tool [options]");
+    po_options.add_options()
+        ("help,h", "display this message")
+        ("size", po::value<int>(&parameters.size)->default_value(parameters.size), "board size, even from 6 to 30")
+        ("wall-density", po::value<double>(&parameters.wall_density)->default_value(parameters.wall_density), "chance of a wood tile")
+        ("mines", po::value<int>(&parameters.mine_count)->default_value(parameters.mine_count), "number of mines, a multiple of 4")
+        ("taverns", po::value<int>(&parameters.tavern_count)->default_value(parameters.tavern_count), "number of taverns, a multiple of 4")
+        ("seed", po::value<uint64_t>(&parameters.seed)->default_value(parameters.seed), "random seed")
+        ("turns", po::value<int>(&turn_max)->default_value(1200), "max turns of the initial state")
+        ("output", po::value<std::string>(&output)->default_value(""), "output prefix, map_<size>_<seed> if empty");
+
+    try
+    {
+        po::variables_map vm;
+        po::store(po::parse_command_line(argc, argv, po_options), vm);
+        po::notify(vm);
+
+        if (vm.count("help"))
+        {
+            std::cout << po_options;
+            return 0;
+        }
+
+        if (turn_max <= 0) throw po::invalid_option_value("turns <= 0");
+        if (parameters.size > Grid::max_size) throw po::invalid_option_value("size > 30, clients and tools load boards into a grid that stops at 30x30");
+    }
+    catch (std::exception& ex)
+    {
+        std::cerr << "Error occurred when parsing options: " << ex.what() << std::endl;
+        std::cerr << po_options;
+        return 1;
+    }
+
+    if (output.empty())
+    {
+        std::stringstream ss;
+        ss << "map_" << parameters.size << "_" << parameters.seed;
+        output = ss.str();
+    }
+
+    try
+    {
+        const Tiles tiles = generate_map(parameters);
+
+        const std::string tiles_path = output + ".txt";
+        std::ofstream tiles_handle(tiles_path.c_str());
+        tiles_handle << tiles;
+        if (!tiles_handle) throw std::runtime_error("can't write " + tiles_path);
+
+        const std::string state_path = output + ".json";
+        std::ofstream state_handle(state_path.c_str());
+        state_handle << make_initial_state_json(tiles, turn_max);
+        if (!state_handle) throw std::runtime_error("can't write " + state_path);
+
+        std::cout << tiles_path << " " << state_path << " " << parameters.size << "x" << parameters.size << " " << detect_symmetries(tiles).size() << " symmetries" << std::endl;
+    }
+    catch (std::exception& ex)
+    {
+        std::cerr << "Error occurred when generating the map: " << ex.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
+
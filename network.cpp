@@ -172,3 +172,51 @@ get_owned_mines(const PTree& root)
 {
     return extract_owned_mines(get_tiles(root));
 }
+
+PTree
+make_initial_state_json(const Tiles& tiles, const int& turn_max)
+{
+    static const Tile hero_tiles[4] = {HERO1, HERO2, HERO3, HERO4};
+
+    const size_t* shape = tiles.shape();
+    assert( shape[0] == shape[1] );
+
+    PTree root;
+    root.put("game.id", "offline");
+    root.put("game.turn", 0);
+    root.put("game.maxTurns", turn_max);
+    root.put("game.finished", false);
+    root.put("game.board.size", shape[0]);
+    root.put("game.board.tiles", serialize_tiles(tiles));
+
+    const OwnedMines owned_mines = extract_owned_mines(tiles);
+
+    PTree heroes;
+    for (int kk=0; kk<4; kk++)
+    {
+        Position position;
+        for (size_t ii=0; ii<shape[0]; ii++)
+            for (size_t jj=0; jj<shape[1]; jj++)
+                if (tiles[ii][jj] == hero_tiles[kk]) position = Position(ii,jj);
+        assert( position != Position() );
+
+        PTree hero;
+        hero.put("id", kk+1);
+        hero.put("name", "offline" + to_string(kk+1));
+        hero.put("pos.x", position.x);
+        hero.put("pos.y", position.y);
+        hero.put("life", 100);
+        hero.put("gold", 0);
+        hero.put("mineCount", owned_mines[kk].size());
+        hero.put("spawnPos.x", position.x);
+        hero.put("spawnPos.y", position.y);
+        hero.put("crashed", false);
+        heroes.push_back(std::make_pair("", hero));
+    }
+    root.add_child("game.heroes", heroes);
+
+    root.put("viewUrl", "offline");
+    root.put("playUrl", "offline");
+
+    return root;
+}
@@ -53,6 +53,9 @@ get_background_tiles(const PTree& root);
 OwnedMines
 get_owned_mines(const PTree& root);
 
+PTree
+make_initial_state_json(const Tiles& tiles, const int& turn_max);
+
 std::ostream&
 operator<<(std::ostream& os, const PTree& root);
 
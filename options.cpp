@@ -1,5 +1,6 @@
 #include "options.h"
 
+#include "evaluation.h"
 #include <iostream>
 #include <boost/program_options/options_description.hpp>
 #include <boost/program_options/positional_options.hpp>
@@ -8,13 +9,13 @@
 #include <boost/program_options/errors.hpp>
 namespace po = boost::program_options;
 
-Options parse_options(int argc, char* argv[])
+Options parse_options(int argc, char* argv[], const bool& is_daemon)
 {
     Options options;
     options.server_name = "";
     options.map_name = "";
 
-    po::options_description po_options("client [options]");
+    po::options_description po_options(is_daemon ? "daemon [options]" : "client [options]");
     po_options.add_options()
         ("help,h", "display this message")
         ("number-of-turns,n", po::value<int>(&options.number_of_turns)->default_value(60), "number of turns in training mode")
@@ -24,7 +25,24 @@ Options parse_options(int argc, char* argv[])
         ("server,s", po::value<std::string>(&options.server_name)->default_value("vindinium.org"), "server name")
         ("map,m", po::value<std::string>(&options.map_name)->default_value(""), "map name")
         ("proxy", po::value<std::string>(&options.proxy)->default_value(""), "SOCKS proxy to use (eg. localhost:4444)")
-        ("collect-map", po::value<bool>(&options.collect_map)->default_value(false), "save game map");
+        ("collect-map", po::value<bool>(&options.collect_map)->default_value(false), "save game map")
+        ("seed", po::value<uint64_t>(&options.seed)->default_value(0), "random seed, 0 picks one from the clock")
+        ("threads", po::value<int>(&options.threads)->default_value(0), "number of worker threads, 0 for one per core")
+        ("pin-threads", po::value<bool>(&options.pin_threads)->default_value(false), "pin each worker thread to a core")
+        ("search-time", po::value<double>(&options.search_time)->default_value(.5), "search time per move in seconds")
+        ("search-memory", po::value<int>(&options.search_memory)->default_value(256), "search tree memory ceiling in MB")
+        ("quiet,q", po::value<bool>(&options.quiet)->default_value(false), "only log warnings and errors, never render the board")
+        ("log-format", po::value<std::string>(&options.log_format)->default_value("text"), "log format: text, json or binary")
+        ("log-file", po::value<std::string>(&options.log_file)->default_value(""), "log to this file instead of stdout")
+        ("engine-socket", po::value<std::string>(&options.engine_socket)->default_value(""), "unix socket of the engine daemon, moves are searched locally if empty")
+        ("shadow", po::value<bool>(&options.shadow)->default_value(false), "check the forward model against every server answer")
+        ("shadow-file", po::value<std::string>(&options.shadow_file)->default_value("shadow_divergences.bin"), "snapshot file of the states where the forward model diverged")
+        ("max-n", po::value<bool>(&options.max_n)->default_value(false), "alpha-beta bot searches max-n instead of paranoid")
+        ("endgame-turns", po::value<int>(&options.endgame_turns)->default_value(24), "half turns left from which the uct bot tries to solve the game exactly, 0 to never")
+        ("book", po::value<std::string>(&options.book)->default_value(""), "opening book written by book_tool, none if empty")
+        ("canonical-keys", po::value<bool>(&options.canonical_keys)->default_value(false), "search tables share the entries of symmetric states")
+        ("evaluation-weights", po::value<std::string>(&options.evaluation_weights)->default_value(""), "leaf evaluation weights of the alpha-beta bot, see evaluation.h, get_utilities if empty")
+        ("self-test", po::value<bool>(&options.self_test)->default_value(false), "run self tests and benchmarks then exit");
     po::positional_options_description positional;
 
     try
@@ -39,9 +57,18 @@ Options parse_options(int argc, char* argv[])
             std::exit(0);
         }
 
-        if (options.secret_key.size() != 8) throw po::invalid_option_value("secret_key.size != 8");
+        if (options.threads < 0) throw po::invalid_option_value("threads < 0");
+        if (options.self_test) return options;
+
+        if (is_daemon && options.engine_socket.empty()) throw po::invalid_option_value("engine_socket is empty");
+        if (!is_daemon && options.secret_key.size() != 8) throw po::invalid_option_value("secret_key.size != 8");
         if (options.number_of_turns < 0) throw po::invalid_option_value("number_of_turns < 0");
         if (options.number_of_games < 0) throw po::invalid_option_value("number_of_games < 0");
+        if (options.search_time <= 0) throw po::invalid_option_value("search_time <= 0");
+        if (options.search_memory <= 0) throw po::invalid_option_value("search_memory <= 0");
+        if (options.endgame_turns < 0 || options.endgame_turns > 255) throw po::invalid_option_value("endgame_turns not in [0,255]");
+        if (options.log_format != "text" && options.log_format != "json" && options.log_format != "binary") throw po::invalid_option_value("log_format not in text, json, binary");
+        if (!options.evaluation_weights.empty()) load_evaluation_weights(options.evaluation_weights); // throws before joining a game
     }
     catch (std::exception& ex)
     {
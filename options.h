@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <stdint.h>
 
 struct Options
 {
@@ -12,8 +13,25 @@ struct Options
     std::string map_name;
     std::string proxy;
     bool collect_map;
+    bool self_test;
+    uint64_t seed;
+    int threads;
+    bool pin_threads;
+    double search_time;
+    int search_memory;
+    bool quiet;
+    std::string log_format;
+    std::string log_file;
+    std::string engine_socket;
+    bool shadow;
+    std::string shadow_file;
+    bool max_n;
+    int endgame_turns;
+    std::string book;
+    bool canonical_keys;
+    std::string evaluation_weights;
 };
 
 Options
-parse_options(int argc, char* argv[]);
+parse_options(int argc, char* argv[], const bool& is_daemon=false);
 
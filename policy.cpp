@@ -0,0 +1,262 @@
+#include "policy.h"
+
+#include "network.h"
+
+LegalDirections
+get_legal_directions(const Grid& grid, const PositionIndex& index)
+{
+    LegalDirections legal;
+    legal.directions[legal.size++] = STAY;
+    for (int direction=NORTH; direction<=WEST; direction++)
+    {
+        const PositionIndex neighbor = grid.get_neighbor(index, static_cast<Direction>(direction));
+        if (grid.passable.test(neighbor) || grid.taverns.test(neighbor) || grid.mine_cells.test(neighbor))
+            legal.directions[legal.size++] = static_cast<Direction>(direction);
+    }
+    return legal;
+}
+
+RandomPolicy::RandomPolicy(const Grid& grid) :
+    grid(grid)
+{
+}
+
+Direction
+RandomPolicy::operator()(const State& state, Rng& rng) const
+{
+    const LegalDirections legal = get_legal_directions(grid, grid.get_index(state.heroes[state.next_hero_index].position));
+    return legal.directions[get_random_index(rng, legal.size)];
+}
+
+MinePolicy::MinePolicy(const PathCache& cache) :
+    cache(cache)
+{
+}
+
+Direction
+MinePolicy::operator()(const State& state, Rng& rng) const
+{
+    const Grid& grid = cache.grid;
+    const State::Hero& hero = state.heroes[state.next_hero_index];
+    const PositionIndex index = grid.get_index(hero.position);
+
+    const MineId* closest_mines = cache.get_closest_mines(index);
+    for (int kk=0; kk<static_cast<int>(grid.mines.size()); kk++)
+    {
+        const MineId mine_id = closest_mines[kk];
+        if (mine_id == Grid::no_mine) break;
+        if (!hero.mines.contains(mine_id)) return cache.get_direction(index, grid.mines[mine_id]);
+    }
+
+    return STAY;
+}
+
+Direction
+get_tavern_direction(const Grid& grid, const PositionIndex& index)
+{
+    const Distance distance = grid.tavern_distances[index];
+    if (distance <= 0) return STAY;
+
+    for (int direction=NORTH; direction<=WEST; direction++)
+    {
+        const PositionIndex neighbor = grid.get_neighbor(index, static_cast<Direction>(direction));
+        if (grid.tavern_distances[neighbor] != distance-1) continue;
+        if (distance == 1 ? grid.taverns.test(neighbor) : grid.passable.test(neighbor)) return static_cast<Direction>(direction);
+    }
+
+    assert( false );
+    return STAY;
+}
+
+int
+get_prey_index(const State& state, const int& hero_index, const PathCache& cache, const int& max_distance)
+{
+    const Grid& grid = cache.grid;
+    const State::Hero& hero = state.heroes[hero_index];
+    const PositionIndex index = grid.get_index(hero.position);
+
+    int prey_index = -1;
+    Distance best_distance = max_distance+1;
+    for (int kk=0; kk<4; kk++)
+    {
+        if (kk == hero_index) continue;
+        const State::Hero& opponent = state.heroes[kk];
+        if (opponent.life >= hero.life || opponent.mines.size() == 0) continue;
+        const Distance distance = cache.get_distance(index, grid.get_index(opponent.position));
+        if (distance < 0 || distance >= best_distance) continue;
+        best_distance = distance;
+        prey_index = kk;
+    }
+    return prey_index;
+}
+
+MixedPolicy
+make_mixed_policy(const PathCache& cache, const double& epsilon)
+{
+    const MinePolicy mine_policy(cache);
+    const ChaserPolicy<MinePolicy> chaser_policy(cache, mine_policy);
+    const TavernPolicy<ChaserPolicy<MinePolicy> > tavern_policy(cache.grid, chaser_policy);
+    return MixedPolicy(cache.grid, tavern_policy, epsilon);
+}
+
+// Policy cost per decision over a set of states, the returned direction sum
+// keeps the calls from being optimized away.
+template <typename Policy>
+static
+double
+time_policy(const Policy& policy, const std::vector<State>& states, const int& decision_count, Rng& rng, int& direction_sum)
+{
+    const double start_time = get_double_time();
+    for (int kk=0; kk<decision_count; kk++)
+        direction_sum += policy(states[kk%states.size()], rng);
+    const double end_time = get_double_time();
+    return 1e9*(end_time-start_time)/decision_count;
+}
+
+static
+bool
+is_legal(const Grid& grid, const State& state, const Direction& direction)
+{
+    const LegalDirections legal = get_legal_directions(grid, grid.get_index(state.heroes[state.next_hero_index].position));
+    return std::find(legal.directions.begin(), legal.directions.begin()+legal.size, direction) != legal.directions.begin()+legal.size;
+}
+
+// Hero roles in the offline games.
+enum PolicyRole
+{
+    ROLE_RANDOM,
+    ROLE_MINE,
+    ROLE_TAVERN,
+    ROLE_MIXED
+};
+
+void
+test_policy()
+{
+    std::cout << "Doing policy test...\n";
+
+    Rng rng(42);
+
+    for (int size=18; size<=28; size+=10)
+    {
+        const Tiles tiles = make_benchmark_tiles(size);
+        const PTree root = make_initial_state_json(tiles, 1200);
+        const Tiles background_tiles = neutralize_tiles(tiles);
+        const HashedPair<Tiles> hashed_background_tiles(background_tiles);
+        const Grid grid(background_tiles);
+        const PathCache cache(grid);
+
+        const RandomPolicy random_policy(grid);
+        const MinePolicy mine_policy(cache);
+        const TavernPolicy<MinePolicy> tavern_policy(grid, mine_policy);
+        const ChaserPolicy<MinePolicy> chaser_policy(cache, mine_policy);
+        const MixedPolicy mixed_policy = make_mixed_policy(cache);
+
+        // states met in mixed policy games, with owned mines and fights
+        typedef std::vector<State> States;
+        States states;
+        {
+            State state(root, hashed_background_tiles, grid);
+            for (int move=0; move<1024; move++)
+            {
+                state.update(mixed_policy(state, rng));
+                if (move%4 == 0) states.push_back(state);
+            }
+        }
+
+        int prey_count = 0;
+        int low_life_count = 0;
+        for (States::const_iterator si=states.begin(), sie=states.end(); si!=sie; si++)
+        {
+            const State& state = *si;
+            const State::Hero& hero = state.heroes[state.next_hero_index];
+            const PositionIndex index = grid.get_index(hero.position);
+
+            assert( is_legal(grid, state, random_policy(state, rng)) );
+            assert( is_legal(grid, state, mixed_policy(state, rng)) );
+
+            // one step closer to the closest mine not owned
+            const Direction mine_direction = mine_policy(state, rng);
+            assert( is_legal(grid, state, mine_direction) );
+            Distance closest = -1;
+            Distance closest_next = -1;
+            const PositionIndex next = grid.get_neighbor(index, mine_direction);
+            for (int mine_id=0; mine_id<static_cast<int>(grid.mines.size()); mine_id++)
+            {
+                if (hero.mines.contains(mine_id)) continue;
+                const Distance distance = cache.get_distance(index, grid.mines[mine_id]);
+                const Distance distance_next = next == grid.mines[mine_id] ? 0 : cache.get_distance(next, grid.mines[mine_id]);
+                if (distance >= 0 && (closest < 0 || distance < closest)) closest = distance;
+                if (distance_next >= 0 && (closest_next < 0 || distance_next < closest_next)) closest_next = distance_next;
+            }
+            assert( closest < 0 ? mine_direction == STAY : closest_next == closest-1 );
+
+            // one step closer to a tavern when low
+            if (hero.life <= tavern_policy.max_life && hero.gold >= 2 && grid.tavern_distances[index] > 0)
+            {
+                const PositionIndex tavern_next = grid.get_neighbor(index, tavern_policy(state, rng));
+                assert( grid.tavern_distances[tavern_next] == grid.tavern_distances[index]-1 );
+                low_life_count++;
+            }
+
+            // one step closer to the prey
+            const int prey_index = get_prey_index(state, state.next_hero_index, cache, chaser_policy.max_distance);
+            if (prey_index >= 0)
+            {
+                const PositionIndex prey = grid.get_index(state.heroes[prey_index].position);
+                const PositionIndex chaser_next = grid.get_neighbor(index, chaser_policy(state, rng));
+                assert( chaser_next == prey || cache.get_distance(chaser_next, prey) == cache.get_distance(index, prey)-1 );
+                prey_count++;
+            }
+        }
+
+        const int decision_count = 1000000;
+        int direction_sum = 0;
+        std::cout << "policy " << size << "x" << size << " (" << states.size() << " states " << low_life_count << " low life " << prey_count << " preys)";
+        std::cout << " random " << time_policy(random_policy, states, decision_count, rng, direction_sum) << "ns";
+        std::cout << " mine " << time_policy(mine_policy, states, decision_count, rng, direction_sum) << "ns";
+        std::cout << " tavern " << time_policy(tavern_policy, states, decision_count, rng, direction_sum) << "ns";
+        std::cout << " chaser " << time_policy(chaser_policy, states, decision_count, rng, direction_sum) << "ns";
+        std::cout << " mixed " << time_policy(mixed_policy, states, decision_count, rng, direction_sum) << "ns";
+        std::cout << " (" << direction_sum%5 << ")" << std::endl;
+
+        // offline games, roles rotated over the seats
+        const int game_count = 4;
+        boost::array<int, 4> role_golds = {{0, 0, 0, 0}};
+        for (int game=0; game<game_count; game++)
+        {
+            State state(root, hashed_background_tiles, grid);
+            for (int move=0; move<1200; move++)
+            {
+                Direction direction = STAY;
+                switch ((state.next_hero_index+game)%4)
+                {
+                case ROLE_RANDOM:
+                    direction = random_policy(state, rng);
+                    break;
+                case ROLE_MINE:
+                    direction = mine_policy(state, rng);
+                    break;
+                case ROLE_TAVERN:
+                    direction = tavern_policy(state, rng);
+                    break;
+                case ROLE_MIXED:
+                    direction = mixed_policy(state, rng);
+                    break;
+                }
+                state.update(direction);
+            }
+            for (int kk=0; kk<4; kk++)
+                role_golds[(kk+game)%4] += state.heroes[kk].gold;
+        }
+
+        std::cout << "policy " << size << "x" << size << " mean gold over " << game_count << " games";
+        std::cout << " random " << role_golds[ROLE_RANDOM]/game_count;
+        std::cout << " mine " << role_golds[ROLE_MINE]/game_count;
+        std::cout << " tavern " << role_golds[ROLE_TAVERN]/game_count;
+        std::cout << " mixed " << role_golds[ROLE_MIXED]/game_count << std::endl;
+    }
+
+    std::cout << "...done!\n";
+}
+
@@ -0,0 +1,150 @@
+#pragma once
+
+#include "macro.h"
+
+// Cheap hand written opponents for rollouts and offline games. A policy is a
+// functor returning the move of state.next_hero_index:
+//
+//     Direction operator()(const State& state, Rng& rng) const;
+//
+// Policies only hold references to read only tables (Grid, PathCache), never
+// allocate and keep no state between calls, so one instance is shared by
+// every thread. The composite ones take the policy to follow when their own
+// rule does not apply.
+
+/// Uniform in [0,size) from a single draw, slightly biased for large sizes.
+inline
+int
+get_random_index(Rng& rng, const int& size)
+{
+    return static_cast<int>(((rng() >> 32)*static_cast<uint64_t>(size)) >> 32);
+}
+
+struct LegalDirections
+{
+    LegalDirections() : size(0) {}
+
+    boost::array<Direction, 5> directions;
+    int size;
+};
+
+/// STAY and the directions that do not bump into a wall or the border.
+LegalDirections
+get_legal_directions(const Grid& grid, const PositionIndex& index);
+
+// Uniform over the legal directions.
+struct RandomPolicy
+{
+    RandomPolicy(const Grid& grid);
+
+    Direction
+    operator()(const State& state, Rng& rng) const;
+
+    const Grid& grid;
+};
+
+// Walk to the closest mine the hero does not own, STAY when it owns them all.
+struct MinePolicy
+{
+    MinePolicy(const PathCache& cache);
+
+    Direction
+    operator()(const State& state, Rng& rng) const;
+
+    const PathCache& cache;
+};
+
+/// Walk down Grid::tavern_distances, STAY when no tavern is reachable.
+Direction
+get_tavern_direction(const Grid& grid, const PositionIndex& index);
+
+// Walk to the closest tavern when life is at most max_life and the hero can
+// pay for a drink.
+template <typename Policy>
+struct TavernPolicy
+{
+    TavernPolicy(const Grid& grid, const Policy& policy, const int& max_life=40) :
+        grid(grid),
+        policy(policy),
+        max_life(max_life)
+    {
+    }
+
+    Direction
+    operator()(const State& state, Rng& rng) const
+    {
+        const State::Hero& hero = state.heroes[state.next_hero_index];
+        if (hero.life > max_life || hero.gold < 2) return policy(state, rng);
+        return get_tavern_direction(grid, grid.get_index(hero.position));
+    }
+
+    const Grid& grid;
+    const Policy policy;
+    const int max_life;
+};
+
+/// Closest opponent holding mines with less life than hero_index within
+/// max_distance moves, -1 when there is none.
+int
+get_prey_index(const State& state, const int& hero_index, const PathCache& cache, const int& max_distance);
+
+// Run after a weaker opponent holding mines when it is close enough.
+template <typename Policy>
+struct ChaserPolicy
+{
+    ChaserPolicy(const PathCache& cache, const Policy& policy, const int& max_distance=8) :
+        cache(cache),
+        policy(policy),
+        max_distance(max_distance)
+    {
+    }
+
+    Direction
+    operator()(const State& state, Rng& rng) const
+    {
+        const int hero_index = state.next_hero_index;
+        const int prey_index = get_prey_index(state, hero_index, cache, max_distance);
+        if (prey_index < 0) return policy(state, rng);
+        const Grid& grid = cache.grid;
+        return cache.get_direction(grid.get_index(state.heroes[hero_index].position), grid.get_index(state.heroes[prey_index].position));
+    }
+
+    const PathCache& cache;
+    const Policy policy;
+    const int max_distance;
+};
+
+// Play a legal random move with probability epsilon.
+template <typename Policy>
+struct EpsilonPolicy
+{
+    EpsilonPolicy(const Grid& grid, const Policy& policy, const double& epsilon) :
+        random_policy(grid),
+        policy(policy),
+        threshold(epsilon >= 1 ? ~static_cast<uint64_t>(0) : static_cast<uint64_t>(epsilon*18446744073709551616.))
+    {
+        assert( epsilon >= 0 );
+    }
+
+    Direction
+    operator()(const State& state, Rng& rng) const
+    {
+        if (rng() < threshold) return random_policy(state, rng);
+        return policy(state, rng);
+    }
+
+    const RandomPolicy random_policy;
+    const Policy policy;
+    const uint64_t threshold; // epsilon scaled to the rng range
+};
+
+// Rough model of the usual server bots: drink when low, hit weak neighbors
+// holding mines, otherwise take mines, with some noise.
+typedef EpsilonPolicy<TavernPolicy<ChaserPolicy<MinePolicy> > > MixedPolicy;
+
+MixedPolicy
+make_mixed_policy(const PathCache& cache, const double& epsilon=.1);
+
+void
+test_policy();
+
@@ -0,0 +1,156 @@
+#include "pool.h"
+
+#include "utils.h"
+
+Arena::Arena(const size_t& chunk_size) :
+    chunks(),
+    chunk_size(chunk_size),
+    chunk_index(0),
+    chunk_offset(0),
+    used_bytes(0)
+{
+}
+
+Arena::~Arena()
+{
+    release();
+}
+
+void*
+Arena::allocate(const size_t& size)
+{
+    static const size_t alignment = 16;
+    const size_t aligned_size = (size+alignment-1) & ~(alignment-1);
+    assert( aligned_size <= chunk_size );
+
+    if (chunk_index < chunks.size() && chunk_offset+aligned_size > chunk_size)
+    {
+        chunk_index++;
+        chunk_offset = 0;
+    }
+
+    if (chunk_index >= chunks.size())
+    {
+        char* chunk = static_cast<char*>(std::malloc(chunk_size));
+        if (!chunk) throw std::bad_alloc();
+        chunks.push_back(chunk);
+        chunk_index = chunks.size()-1;
+        chunk_offset = 0;
+    }
+
+    void* block = chunks[chunk_index]+chunk_offset;
+    chunk_offset += aligned_size;
+    used_bytes += aligned_size;
+    return block;
+}
+
+void
+Arena::reset()
+{
+    chunk_index = 0;
+    chunk_offset = 0;
+    used_bytes = 0;
+}
+
+void
+Arena::release()
+{
+    for (Chunks::const_iterator ci=chunks.begin(), cie=chunks.end(); ci!=cie; ci++)
+        std::free(*ci);
+    chunks.clear();
+    reset();
+}
+
+void
+Arena::adopt(Arena& other, const size_t& max_bytes)
+{
+    assert( other.chunk_size == chunk_size );
+
+    // unused chunks of this arena come after chunk_index, so do adopted ones
+    for (Chunks::const_iterator ci=other.chunks.begin(), cie=other.chunks.end(); ci!=cie; ci++)
+    {
+        if (get_reserved_bytes() < max_bytes) chunks.push_back(*ci);
+        else std::free(*ci);
+    }
+    other.chunks.clear();
+    other.reset();
+}
+
+size_t
+Arena::get_reserved_bytes() const
+{
+    return chunks.size()*chunk_size;
+}
+
+size_t
+Arena::get_used_bytes() const
+{
+    return used_bytes;
+}
+
+void
+test_pool()
+{
+    std::cout << "Doing pool test...\n";
+
+    struct Node
+    {
+        Node() : value(42) {}
+        Node* next;
+        int value;
+    };
+
+    NodePool<Node> pool(1000*sizeof(Node), 256*sizeof(Node));
+    assert( pool.get_capacity() == 1000 );
+
+    std::vector<Node*> nodes;
+    while (Node* node = pool.allocate())
+    {
+        assert( node->value == 42 );
+        node->value = nodes.size();
+        nodes.push_back(node);
+    }
+    assert( nodes.size() == 1000 );
+    assert( pool.is_exhausted() );
+    assert( pool.get_reserved_bytes() <= 1024*sizeof(Node)+1024 );
+
+    for (size_t kk=0; kk<nodes.size(); kk+=2)
+        pool.recycle(nodes[kk]);
+    assert( pool.get_live_count() == 500 );
+
+    for (size_t kk=0; kk<500; kk++)
+        assert( pool.allocate() );
+    assert( !pool.allocate() );
+    for (size_t kk=1; kk<nodes.size(); kk+=2)
+        assert( nodes[kk]->value == static_cast<int>(kk) );
+
+    const size_t reserved_bytes = pool.get_reserved_bytes();
+    pool.reset();
+    assert( pool.get_live_count() == 0 );
+    for (size_t kk=0; kk<1000; kk++)
+        assert( pool.allocate() );
+    assert( pool.get_reserved_bytes() == reserved_bytes );
+
+    // memory moves to another pool without any new chunk
+    NodePool<Node> other_pool(1000*sizeof(Node), 256*sizeof(Node));
+    other_pool.allocate();
+    const size_t other_reserved_bytes = other_pool.get_reserved_bytes();
+    other_pool.adopt(pool);
+    assert( pool.get_reserved_bytes() == 0 && pool.get_live_count() == 0 );
+    assert( other_pool.get_live_count() == 1 );
+    assert( other_pool.get_reserved_bytes() <= std::max(other_reserved_bytes, 1000*sizeof(Node)) + 256*sizeof(Node) );
+    for (size_t kk=1; kk<1000; kk++)
+        assert( other_pool.allocate() );
+    assert( other_pool.get_reserved_bytes() <= reserved_bytes + other_reserved_bytes );
+
+    const int payload = 4000000;
+    NodePool<Node> large_pool(payload*sizeof(Node));
+    const double start_time = get_double_time();
+    for (int kk=0; kk<payload; kk++)
+        large_pool.allocate();
+    const double end_time = get_double_time();
+    std::cout << "pool " << static_cast<int>(1e-3*payload/(end_time-start_time)) << "knode/s " << clock_it(end_time-start_time) << std::endl;
+
+    std::cout << "...done!\n";
+}
+
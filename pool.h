@@ -0,0 +1,191 @@
+#pragma once
+
+#include <cstdlib>
+#include <new>
+#include <vector>
+#include <cassert>
+#include <algorithm>
+
+// Bump allocator carving blocks out of large chunks. Blocks are never freed
+// one by one: reset rewinds the whole arena at once and keeps its chunks.
+struct Arena
+{
+    Arena(const size_t& chunk_size);
+    ~Arena();
+
+    void*
+    allocate(const size_t& size);
+
+    void
+    reset();
+
+    void
+    release();
+
+    /// Take the chunks of other, which is left empty, as spare space. Chunks
+    /// that would reserve more than max_bytes are freed instead.
+    void
+    adopt(Arena& other, const size_t& max_bytes);
+
+    size_t
+    get_reserved_bytes() const;
+
+    size_t
+    get_used_bytes() const;
+
+private:
+
+    Arena(const Arena& arena); // no copy
+    Arena&
+    operator=(const Arena& arena); // no assignement
+
+    typedef std::vector<char*> Chunks;
+
+    Chunks chunks;
+    const size_t chunk_size;
+    size_t chunk_index;
+    size_t chunk_offset;
+    size_t used_bytes;
+};
+
+// Fixed size node allocator on top of an Arena with a hard node budget.
+// Recycled nodes go to an intrusive free list and are handed out first.
+// Node must be default constructible and trivially destructible.
+template <typename Node>
+struct NodePool
+{
+    NodePool(const size_t& max_bytes, const size_t& chunk_size=1<<20);
+
+    Node*
+    allocate(); // NULL when the budget is exhausted
+
+    void
+    recycle(Node* node);
+
+    void
+    reset();
+
+    /// Take the memory of other once its nodes are not needed anymore.
+    void
+    adopt(NodePool& other);
+
+    bool
+    is_exhausted() const;
+
+    size_t
+    get_live_count() const;
+
+    size_t
+    get_capacity() const;
+
+    size_t
+    get_reserved_bytes() const;
+
+private:
+
+    struct FreeSlot
+    {
+        FreeSlot* next;
+    };
+
+    Arena arena;
+    const size_t capacity;
+    size_t carved_count;
+    size_t live_count;
+    FreeSlot* free_slots;
+};
+
+template <typename Node>
+NodePool<Node>::NodePool(const size_t& max_bytes, const size_t& chunk_size) :
+    arena(std::max(std::min(chunk_size, max_bytes), sizeof(Node)+sizeof(FreeSlot))),
+    capacity(max_bytes/sizeof(Node)),
+    carved_count(0),
+    live_count(0),
+    free_slots(NULL)
+{
+    assert( sizeof(Node) >= sizeof(FreeSlot) );
+}
+
+template <typename Node>
+Node*
+NodePool<Node>::allocate()
+{
+    void* memory = NULL;
+
+    if (free_slots)
+    {
+        memory = free_slots;
+        free_slots = free_slots->next;
+    }
+    else
+    {
+        if (carved_count >= capacity) return NULL;
+        memory = arena.allocate(sizeof(Node));
+        carved_count++;
+    }
+
+    live_count++;
+    return new (memory) Node();
+}
+
+template <typename Node>
+void
+NodePool<Node>::recycle(Node* node)
+{
+    assert( node );
+    assert( live_count > 0 );
+    FreeSlot* slot = reinterpret_cast<FreeSlot*>(node);
+    slot->next = free_slots;
+    free_slots = slot;
+    live_count--;
+}
+
+template <typename Node>
+void
+NodePool<Node>::reset()
+{
+    arena.reset();
+    carved_count = 0;
+    live_count = 0;
+    free_slots = NULL;
+}
+
+template <typename Node>
+void
+NodePool<Node>::adopt(NodePool& other)
+{
+    arena.adopt(other.arena, capacity*sizeof(Node));
+    other.reset();
+}
+
+template <typename Node>
+bool
+NodePool<Node>::is_exhausted() const
+{
+    return live_count >= capacity;
+}
+
+template <typename Node>
+size_t
+NodePool<Node>::get_live_count() const
+{
+    return live_count;
+}
+
+template <typename Node>
+size_t
+NodePool<Node>::get_capacity() const
+{
+    return capacity;
+}
+
+template <typename Node>
+size_t
+NodePool<Node>::get_reserved_bytes() const
+{
+    return arena.get_reserved_bytes();
+}
+
+void
+test_pool();
+
@@ -10,33 +10,11 @@ Position::Position(const int& x, const int& y) :
 void
 Position::with_direction(const Direction& direction)
 {
-    switch (direction)
-    {
-    case STAY:
-        return;
-    case NORTH:
-        x--;
-        return;
-    case SOUTH:
-        x++;
-        return;
-    case EAST:
-        y++;
-        return;
-    case WEST:
-        y--;
-        return;
-    }
+    static const int delta_xs[5] = {0, -1, 1, 0, 0};
+    static const int delta_ys[5] = {0, 0, 0, 1, -1};
 
-    /*
-    static const Position deltas[5] = {
-        Position(0,0),   // STAY
-        Position(-1,0),  // NORTH
-        Position(1,0),   // SOUTH
-        Position(0,1),   // EAST
-        Position(0,-1),  // WEST
-    };
-    */
+    x += delta_xs[direction];
+    y += delta_ys[direction];
 }
 
 bool
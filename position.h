@@ -3,10 +3,14 @@
 #include <iostream>
 #include <list>
 #include <set>
+#include <stdint.h>
 
 #include "utils.h"
 #include "hashed.h"
 
+// Compact form of a position on a board padded with a one tile border.
+typedef uint16_t PositionIndex;
+
 struct Position
 {
     Position(const int& x=-1, const int& y=-1);
@@ -17,11 +21,32 @@ struct Position
     bool
     next_to(const Position& position) const;
 
+    PositionIndex
+    to_index(const int& stride) const;
+
+    static
+    Position
+    from_index(const PositionIndex& index, const int& stride);
+
     int x;
     int y;
 
 };
 
+inline
+PositionIndex
+Position::to_index(const int& stride) const
+{
+    return (x+1)*stride + (y+1);
+}
+
+inline
+Position
+Position::from_index(const PositionIndex& index, const int& stride)
+{
+    return Position(index/stride - 1, index%stride - 1);
+}
+
 Hash
 hash_value(const Position& position);
 
@@ -1,16 +1,19 @@
 #include "random_bot.h"
 
-Bot::Bot(const Options& opt, const Game& game, Rng& rng) :
+BotTables::BotTables(const Options& opt)
+{
+}
+
+Bot::Bot(const Options& opt, const Game& game, Rng& rng, BotTables& tables) :
+    policy(game.background_grid),
     rng(rng)
 {
 }
 
 Direction
-Bot::get_move(const Game& game) const
+Bot::get_move(const Game& game, const CancellationToken& token)
 {
-    typedef UniformRng<uint8_t> UniformRngUInt8;
-    UniformRngUInt8 uniform(rng, 5);
-    return static_cast<Direction>(uniform());
+    return policy(game.state, rng);
 }
 
 void
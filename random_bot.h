@@ -1,19 +1,28 @@
 #pragma once
 
 #include "game.h"
+#include "policy.h"
+#include "scheduler.h"
+
+// Nothing to keep across games.
+struct BotTables
+{
+    BotTables(const Options& opt);
+};
 
 struct Bot
 {
-    Bot(const Options& opt, const Game& game, Rng& rng);
+    Bot(const Options& opt, const Game& game, Rng& rng, BotTables& tables);
 
     Direction
-    get_move(const Game& game) const;
+    get_move(const Game& game, const CancellationToken& token); // token may be cut during the search
 
     void
     advance_game(Game& game, const Direction& direction);
 
 private:
 
+    const RandomPolicy policy;
     Rng& rng;
 
 };
@@ -0,0 +1,473 @@
+#include "scheduler.h"
+
+#include "utils.h"
+#include <cassert>
+#include <deque>
+#include <stdexcept>
+#include <thread>
+#include <chrono>
+#include <boost/bind/bind.hpp>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+struct ScheduledJob
+{
+    ScheduledJob(TaskGroup* group, const Task& task) :
+        group(group),
+        task(task)
+    {
+    }
+
+    TaskGroup* group;
+    Task task;
+};
+
+struct WorkerQueue
+{
+    typedef std::deque<ScheduledJob*> Jobs;
+
+    std::mutex mutex;
+    Jobs jobs;
+    std::thread thread;
+};
+
+static thread_local const Scheduler* current_scheduler = NULL;
+static thread_local int current_worker_index = -1;
+
+CancellationToken::CancellationToken() :
+    cancelled(false),
+    deadline(0)
+{
+}
+
+void
+CancellationToken::cancel()
+{
+    cancelled.store(true, std::memory_order_release);
+}
+
+void
+CancellationToken::reset()
+{
+    cancelled.store(false, std::memory_order_release);
+    deadline.store(0, std::memory_order_release);
+}
+
+void
+CancellationToken::set_deadline(const double& deadline_value)
+{
+    deadline.store(deadline_value, std::memory_order_release);
+}
+
+double
+CancellationToken::get_deadline() const
+{
+    return deadline.load(std::memory_order_acquire);
+}
+
+bool
+CancellationToken::is_cancelled() const
+{
+    if (cancelled.load(std::memory_order_acquire)) return true;
+    const double deadline_value = deadline.load(std::memory_order_acquire);
+    return deadline_value > 0 && get_double_time() >= deadline_value;
+}
+
+TaskGroup::TaskGroup() :
+    pending_count(0),
+    error_mutex(),
+    error()
+{
+}
+
+Scheduler::Scheduler(const int& worker_count, const bool& pin_workers) :
+    queues(),
+    background_queue(new WorkerQueue()),
+    sleep_mutex(),
+    wake_up(),
+    stopping(false),
+    sleeping_count(0),
+    next_queue(0)
+{
+    assert( worker_count > 0 );
+    for (int kk=0; kk<worker_count; kk++)
+        queues.push_back(new WorkerQueue());
+    for (int kk=0; kk<worker_count; kk++)
+        queues[kk].thread = std::thread(&Scheduler::work, this, kk, pin_workers);
+}
+
+Scheduler::~Scheduler()
+{
+    stopping = true;
+    wake_up.notify_all();
+    for (Queues::iterator qi=queues.begin(), qie=queues.end(); qi!=qie; qi++)
+        qi->thread.join();
+}
+
+void
+Scheduler::spawn(TaskGroup& group, const Task& task)
+{
+    group.pending_count++;
+    push(new ScheduledJob(&group, task));
+}
+
+void
+Scheduler::spawn(const Task& task)
+{
+    push(new ScheduledJob(NULL, task));
+}
+
+void
+Scheduler::spawn_background(TaskGroup& group, const Task& task)
+{
+    group.pending_count++;
+    {
+        std::lock_guard<std::mutex> lock(background_queue->mutex);
+        background_queue->jobs.push_back(new ScheduledJob(&group, task));
+    }
+
+    if (sleeping_count > 0) wake_up.notify_one();
+}
+
+void
+Scheduler::push(ScheduledJob* job)
+{
+    const int worker_index = current_scheduler == this ? current_worker_index : next_queue++ % queues.size();
+
+    WorkerQueue& queue = queues[worker_index];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.jobs.push_back(job);
+    }
+
+    if (sleeping_count > 0) wake_up.notify_one();
+}
+
+// Job of group nearest the back of the queue, or the front, NULL group
+// matching any job.
+static
+ScheduledJob*
+take_job(WorkerQueue& queue, const TaskGroup* group, const bool& from_back)
+{
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    const int job_count = queue.jobs.size();
+    for (int kk=0; kk<job_count; kk++)
+    {
+        const WorkerQueue::Jobs::iterator ji = queue.jobs.begin() + (from_back ? job_count-1-kk : kk);
+        ScheduledJob* job = *ji;
+        if (group && job->group != group) continue;
+        queue.jobs.erase(ji);
+        return job;
+    }
+    return NULL;
+}
+
+ScheduledJob*
+Scheduler::pop(const int& worker_index, const TaskGroup* group)
+{
+    const int queue_count = queues.size();
+
+    if (worker_index >= 0)
+        if (ScheduledJob* job = take_job(queues[worker_index], group, true))
+            return job;
+
+    const int start = worker_index >= 0 ? worker_index+1 : next_queue % queue_count;
+    for (int kk=0; kk<queue_count; kk++)
+        if (ScheduledJob* job = take_job(queues[(start+kk) % queue_count], group, false))
+            return job;
+
+    return NULL;
+}
+
+bool
+Scheduler::run_one(const int& worker_index, const TaskGroup* group, const bool& background)
+{
+    ScheduledJob* job = pop(worker_index, group);
+    if (!job && background) job = take_job(*background_queue, group, false);
+    if (!job) return false;
+
+    boost::scoped_ptr<ScheduledJob> job_owner(job);
+    try
+    {
+        job->task();
+    }
+    catch (...)
+    {
+        if (!job->group) throw;
+        std::lock_guard<std::mutex> lock(job->group->error_mutex);
+        if (!job->group->error) job->group->error = std::current_exception();
+    }
+    if (job->group) job->group->pending_count--;
+
+    return true;
+}
+
+bool
+Scheduler::help()
+{
+    return run_one(current_scheduler == this ? current_worker_index : -1, NULL, false);
+}
+
+void
+Scheduler::wait(TaskGroup& group)
+{
+    // only tasks of the group, a search waiting on its workers must not pick
+    // up a whole startup stage or another connection's task
+    const int worker_index = current_scheduler == this ? current_worker_index : -1;
+    while (group.pending_count > 0)
+        if (!run_one(worker_index, &group, true))
+            std::this_thread::yield();
+
+    std::exception_ptr error;
+    {
+        std::lock_guard<std::mutex> lock(group.error_mutex);
+        std::swap(error, group.error);
+    }
+    if (error) std::rethrow_exception(error);
+}
+
+static
+void
+run_body(const boost::function<void (int)>& body, const int& index)
+{
+    body(index);
+}
+
+void
+Scheduler::parallel_for(const int& count, const boost::function<void (int)>& body)
+{
+    TaskGroup group;
+    for (int kk=0; kk<count; kk++)
+        spawn(group, boost::bind(run_body, boost::cref(body), kk));
+    wait(group);
+}
+
+int
+Scheduler::get_worker_count() const
+{
+    return queues.size();
+}
+
+int
+Scheduler::get_worker_index()
+{
+    return current_worker_index;
+}
+
+void
+Scheduler::work(const int& worker_index, const bool& pin_worker)
+{
+    current_scheduler = this;
+    current_worker_index = worker_index;
+
+#if defined(__linux__)
+    if (pin_worker)
+    {
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(worker_index % std::max(1u, std::thread::hardware_concurrency()), &cpu_set);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+    }
+#endif
+
+    while (true)
+    {
+        if (run_one(worker_index, NULL, true)) continue;
+        if (stopping) return;
+
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        sleeping_count++;
+        wake_up.wait_for(lock, std::chrono::milliseconds(1));
+        sleeping_count--;
+    }
+}
+
+static
+boost::scoped_ptr<Scheduler>&
+get_scheduler_pointer()
+{
+    static boost::scoped_ptr<Scheduler> scheduler;
+    return scheduler;
+}
+
+void
+init_scheduler(const int& worker_count, const bool& pin_workers)
+{
+    boost::scoped_ptr<Scheduler>& scheduler = get_scheduler_pointer();
+    assert( !scheduler );
+    const int default_count = std::max(1u, std::thread::hardware_concurrency());
+    scheduler.reset(new Scheduler(worker_count > 0 ? worker_count : default_count, pin_workers));
+}
+
+Scheduler&
+get_scheduler()
+{
+    boost::scoped_ptr<Scheduler>& scheduler = get_scheduler_pointer();
+    if (!scheduler) init_scheduler(0, false);
+    return *scheduler;
+}
+
+static
+void
+count_leaf(std::atomic<int>& counter)
+{
+    counter++;
+}
+
+static
+void
+throw_leaf()
+{
+    throw std::runtime_error("leaf failed");
+}
+
+static
+void
+block_worker(std::atomic<bool>& is_started, const std::atomic<bool>& is_released)
+{
+    is_started = true;
+    while (!is_released) std::this_thread::yield();
+}
+
+static
+void
+run_stage(std::atomic<bool>& is_started)
+{
+    is_started = true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+}
+
+static
+void
+check_stage(const std::atomic<bool>& is_stage_started, std::atomic<bool>& is_ahead)
+{
+    is_ahead = !is_stage_started;
+}
+
+static
+void
+spin_until(const CancellationToken& token)
+{
+    while (!token.is_cancelled()) std::this_thread::yield();
+}
+
+static
+void
+spawn_leaves(Scheduler& scheduler, std::atomic<int>& counter, const int&)
+{
+    TaskGroup group;
+    for (int kk=0; kk<10; kk++)
+        scheduler.spawn(group, boost::bind(count_leaf, boost::ref(counter)));
+    scheduler.wait(group);
+}
+
+void
+test_scheduler()
+{
+    std::cout << "Doing scheduler test...\n";
+
+    {
+        Scheduler scheduler(3);
+        std::atomic<int> counter(0);
+        scheduler.parallel_for(100, boost::bind(spawn_leaves, boost::ref(scheduler), boost::ref(counter), boost::placeholders::_1));
+        assert( counter == 1000 );
+    }
+
+    { // a throwing task still completes its group, wait rethrows
+        Scheduler scheduler(2);
+        TaskGroup group;
+        std::atomic<int> counter(0);
+        for (int kk=0; kk<10; kk++)
+            scheduler.spawn(group, kk == 5 ? Task(throw_leaf) : Task(boost::bind(count_leaf, boost::ref(counter))));
+        bool is_rethrown = false;
+        try { scheduler.wait(group); } catch (std::runtime_error&) { is_rethrown = true; }
+        assert( is_rethrown );
+        assert( counter == 9 );
+        assert( group.pending_count == 0 );
+        scheduler.wait(group); // reported once
+    }
+
+    { // waiters only run tasks of their group
+        Scheduler scheduler(1);
+        std::atomic<bool> is_started(false);
+        std::atomic<bool> is_released(false);
+        scheduler.spawn(boost::bind(block_worker, boost::ref(is_started), boost::cref(is_released)));
+        while (!is_started) std::this_thread::yield();
+
+        TaskGroup other_group;
+        std::atomic<int> other_counter(0);
+        scheduler.spawn(other_group, boost::bind(count_leaf, boost::ref(other_counter)));
+        std::atomic<int> counter(0);
+        scheduler.parallel_for(10, boost::bind(count_leaf, boost::ref(counter)));
+        assert( counter == 10 );
+        assert( other_counter == 0 );
+
+        is_released = true;
+        scheduler.wait(other_group);
+        assert( other_counter == 1 );
+    }
+
+    { // a queued stage delays neither searches nor queued tasks
+        Scheduler scheduler(1);
+        std::atomic<bool> is_started(false);
+        std::atomic<bool> is_released(false);
+        scheduler.spawn(boost::bind(block_worker, boost::ref(is_started), boost::cref(is_released)));
+        while (!is_started) std::this_thread::yield();
+
+        TaskGroup stage_group;
+        std::atomic<bool> is_stage_started(false);
+        scheduler.spawn_background(stage_group, boost::bind(run_stage, boost::ref(is_stage_started)));
+
+        CancellationToken token;
+        const double start_time = get_double_time();
+        token.set_deadline(start_time+.02);
+        scheduler.parallel_for(4, boost::bind(spin_until, boost::cref(token)));
+        const double search_time = get_double_time()-start_time;
+        assert( !is_stage_started );
+        assert( search_time < .1 );
+
+        TaskGroup group;
+        std::atomic<bool> is_ahead(false);
+        scheduler.spawn(group, boost::bind(check_stage, boost::cref(is_stage_started), boost::ref(is_ahead)));
+        is_released = true;
+        while (group.pending_count > 0) std::this_thread::yield();
+        assert( is_ahead );
+        scheduler.wait(stage_group);
+        scheduler.wait(group);
+        assert( is_stage_started );
+        std::cout << "search next to a queued stage " << clock_it(search_time) << std::endl;
+    }
+
+    {
+        CancellationToken token;
+        assert( !token.is_cancelled() );
+        token.set_deadline(get_double_time()+3600);
+        assert( !token.is_cancelled() );
+        token.set_deadline(get_double_time()-1);
+        assert( token.is_cancelled() );
+        token.reset();
+        assert( !token.is_cancelled() );
+        token.cancel();
+        assert( token.is_cancelled() );
+    }
+
+    {
+        const int payload = 100000;
+        Scheduler scheduler(1);
+        TaskGroup group;
+        std::atomic<int> counter(0);
+        const double start_time = get_double_time();
+        for (int kk=0; kk<payload; kk++)
+            scheduler.spawn(group, boost::bind(count_leaf, boost::ref(counter)));
+        scheduler.wait(group);
+        const double end_time = get_double_time();
+        assert( counter == payload );
+        std::cout << "spawn " << static_cast<int>(1e-3*payload/(end_time-start_time)) << "ktask/s" << std::endl;
+    }
+
+    std::cout << "...done!\n";
+}
+
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <condition_variable>
+#include <boost/function.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/scoped_ptr.hpp>
+
+typedef boost::function<void ()> Task;
+
+// Cooperative cancellation shared between the turn loop and its tasks.
+// Cancelling and testing are single atomic operations, a task polling
+// is_cancelled also stops once the optional deadline has passed.
+struct CancellationToken
+{
+    CancellationToken();
+
+    void
+    cancel();
+
+    void
+    reset();
+
+    void
+    set_deadline(const double& deadline);
+
+    double
+    get_deadline() const;
+
+    bool
+    is_cancelled() const;
+
+private:
+
+    CancellationToken(const CancellationToken& token); // no copy
+
+    std::atomic<bool> cancelled;
+    std::atomic<double> deadline;
+};
+
+struct TaskGroup
+{
+    TaskGroup();
+
+    std::atomic<int> pending_count;
+    std::mutex error_mutex;
+    std::exception_ptr error; // first exception thrown by a task, rethrown by wait
+};
+
+struct WorkerQueue;
+struct ScheduledJob;
+
+// Fixed pool of workers, each owning a deque. Workers pop their own deque
+// from the back and steal from the front of the others when idle, then take
+// background tasks. Threads waiting on a group run its queued tasks instead
+// of blocking.
+struct Scheduler
+{
+    Scheduler(const int& worker_count, const bool& pin_workers=false);
+    ~Scheduler();
+
+    void
+    spawn(TaskGroup& group, const Task& task);
+
+    void
+    spawn(const Task& task); // detached, must not throw
+
+    /// Long task off the move clock, such as a startup stage. Workers only
+    /// take it when no other task is queued and wait only runs it for its
+    /// own group, so searches never end up running it.
+    void
+    spawn_background(TaskGroup& group, const Task& task);
+
+    /// Run queued tasks of the group until it is done, then rethrow the
+    /// first exception one of its tasks threw, if any. Tasks of other groups
+    /// are left to the workers.
+    void
+    wait(TaskGroup& group);
+
+    void
+    parallel_for(const int& count, const boost::function<void (int)>& body);
+
+    bool
+    help(); // run one queued task if any, for threads polling a condition
+
+    int
+    get_worker_count() const;
+
+    static
+    int
+    get_worker_index(); // -1 outside of the workers
+
+private:
+
+    Scheduler(const Scheduler& scheduler); // no copy
+
+    void
+    push(ScheduledJob* job);
+
+    ScheduledJob*
+    pop(const int& worker_index, const TaskGroup* group); // any job when group is NULL
+
+    bool
+    run_one(const int& worker_index, const TaskGroup* group, const bool& background);
+
+    void
+    work(const int& worker_index, const bool& pin_worker);
+
+    typedef boost::ptr_vector<WorkerQueue> Queues;
+
+    Queues queues;
+    boost::scoped_ptr<WorkerQueue> background_queue;
+    std::mutex sleep_mutex;
+    std::condition_variable wake_up;
+    std::atomic<bool> stopping;
+    std::atomic<int> sleeping_count;
+    std::atomic<unsigned int> next_queue;
+};
+
+void
+init_scheduler(const int& worker_count, const bool& pin_workers);
+
+Scheduler&
+get_scheduler();
+
+void
+test_scheduler();
+
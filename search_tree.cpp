@@ -0,0 +1,434 @@
+#include "search_tree.h"
+
+#include "policy.h"
+#include <cmath>
+#include <algorithm>
+#include <thread>
+#include <boost/bind/bind.hpp>
+
+static const int rollout_depth = 40;
+static const float exploration = .7;
+
+SearchNode::SearchNode() :
+    visits(0),
+    value(0)
+{
+    std::fill(children, children+5, static_cast<SearchNode*>(NULL));
+}
+
+Rewards
+get_rewards(const State& state, const int& turns_left)
+{
+    boost::array<int, 4> projected_golds;
+    for (int kk=0; kk<4; kk++)
+    {
+        const int offset = (kk-state.next_hero_index+4) % 4;
+        const int moves_left = (turns_left-offset+3) / 4;
+        const State::Hero& hero = state.heroes[kk];
+        projected_golds[kk] = hero.gold + hero.mines.size()*moves_left;
+    }
+
+    Rewards rewards;
+    for (int kk=0; kk<4; kk++)
+    {
+        float reward = 0;
+        for (int ll=0; ll<4; ll++)
+        {
+            if (ll == kk) continue;
+            if (projected_golds[kk] > projected_golds[ll]) reward += 1;
+            if (projected_golds[kk] == projected_golds[ll]) reward += .5;
+        }
+        rewards[kk] = reward/3;
+    }
+
+    return rewards;
+}
+
+static
+Direction
+select_child(const SearchNode* node)
+{
+    const float log_visits = std::log(static_cast<float>(node->visits));
+
+    Direction best_direction = STAY;
+    float best_score = -1;
+    for (int direction=0; direction<5; direction++)
+    {
+        const SearchNode* child = node->children[direction];
+        assert( child );
+        assert( child->visits > 0 );
+
+        const float score = child->value/child->visits + exploration*std::sqrt(log_visits/child->visits);
+        if (score <= best_score) continue;
+        best_score = score;
+        best_direction = static_cast<Direction>(direction);
+    }
+
+    return best_direction;
+}
+
+SearchTree::SearchTree(const size_t& max_bytes) :
+    playout_count(0),
+    prune_count(0),
+    kept_node_count(0),
+    dropped_node_count(0),
+    kept_playout_count(0),
+    pool(new SearchNodePool(max_bytes/2)),
+    spare_pool(new SearchNodePool(max_bytes/2)),
+    is_stale(false),
+    root(NULL),
+    root_state(),
+    root_turns_left(0),
+    path()
+{
+}
+
+void
+SearchTree::reset(const State& state, const int& turns_left)
+{
+    pool->reset();
+    is_stale = false;
+    root = pool->allocate();
+    assert( root );
+    root_state.reset(new State(state));
+    root_turns_left = turns_left;
+    playout_count = 0;
+    prune_count = 0;
+    kept_node_count = 0;
+    dropped_node_count = 0;
+    kept_playout_count = 0;
+}
+
+bool
+SearchTree::has_root(const State& state) const
+{
+    return root && root_state && *root_state == state;
+}
+
+void
+SearchTree::run(const CancellationToken& token, Rng& rng)
+{
+    if (is_stale) compact();
+    assert( root && root_state );
+    while (!token.is_cancelled())
+        for (int kk=0; kk<16; kk++)
+            playout(rng);
+}
+
+void
+SearchTree::run_playouts(const int& count, Rng& rng)
+{
+    if (is_stale) compact();
+    assert( root && root_state );
+    for (int kk=0; kk<count; kk++)
+        playout(rng);
+}
+
+void
+SearchTree::playout(Rng& rng)
+{
+    if (pool->is_exhausted()) prune();
+
+    State state(*root_state);
+    int turns_left = root_turns_left;
+
+    path.clear();
+    SearchNode* node = root;
+    while (turns_left > 0)
+    {
+        const int mover = state.next_hero_index;
+
+        Direction unexpanded_directions[5];
+        int unexpanded_count = 0;
+        for (int direction=0; direction<5; direction++)
+            if (!node->children[direction])
+                unexpanded_directions[unexpanded_count++] = static_cast<Direction>(direction);
+
+        Direction direction = STAY;
+        bool expanded = false;
+        if (unexpanded_count > 0)
+        {
+            SearchNode* child = pool->allocate();
+            if (!child) break; // out of budget, roll out from here
+
+            SizeRng<int> size_rng(rng);
+            direction = unexpanded_directions[size_rng(unexpanded_count)];
+            node->children[direction] = child;
+            expanded = true;
+        }
+        else direction = select_child(node);
+
+        node = node->children[direction];
+        state.update(direction);
+        turns_left--;
+        path.push_back(std::make_pair(node, mover));
+
+        if (expanded) break;
+    }
+
+    UniformRng<int> uniform(rng, 5);
+    for (int kk=0; kk<rollout_depth && turns_left>0; kk++, turns_left--)
+        state.update(static_cast<Direction>(uniform()));
+
+    const Rewards rewards = get_rewards(state, turns_left);
+
+    root->visits++;
+    for (Path::const_iterator pi=path.begin(), pie=path.end(); pi!=pie; pi++)
+    {
+        pi->first->visits++;
+        pi->first->value += rewards[pi->second];
+    }
+
+    playout_count++;
+}
+
+void
+SearchTree::prune()
+{
+    const size_t target_count = pool->get_capacity()*3/4;
+    unsigned int min_visits = 2;
+    while (pool->get_live_count() > target_count && min_visits <= root->visits)
+    {
+        prune_below(root, min_visits);
+        min_visits *= 2;
+    }
+    prune_count++;
+}
+
+void
+SearchTree::prune_below(SearchNode* node, const unsigned int& min_visits)
+{
+    for (int direction=0; direction<5; direction++)
+    {
+        SearchNode* child = node->children[direction];
+        if (!child) continue;
+
+        if (child->visits < min_visits)
+        {
+            release_subtree(child);
+            node->children[direction] = NULL;
+            continue;
+        }
+
+        prune_below(child, min_visits);
+    }
+}
+
+void
+SearchTree::release_subtree(SearchNode* node)
+{
+    for (int direction=0; direction<5; direction++)
+        if (node->children[direction])
+            release_subtree(node->children[direction]);
+    pool->recycle(node);
+}
+
+void
+SearchTree::advance_root(const Direction& direction)
+{
+    assert( root_state );
+
+    if (root) root = root->children[direction];
+    is_stale = true;
+    root_state->update(direction);
+    root_turns_left--;
+}
+
+SearchNode*
+SearchTree::copy_subtree(const SearchNode* node)
+{
+    SearchNode* copy = spare_pool->allocate();
+    assert( copy );
+    copy->visits = node->visits;
+    copy->value = node->value;
+    for (int direction=0; direction<5; direction++)
+        if (node->children[direction])
+            copy->children[direction] = copy_subtree(node->children[direction]);
+    return copy;
+}
+
+void
+SearchTree::compact()
+{
+    assert( root_state );
+    if (!is_stale) return;
+
+    // the kept subtree is much smaller than what is dropped
+    assert( spare_pool->get_live_count() == 0 );
+    SearchNode* new_root = root ? copy_subtree(root) : spare_pool->allocate();
+    assert( new_root );
+
+    kept_node_count = spare_pool->get_live_count();
+    dropped_node_count = pool->get_live_count()-(root ? kept_node_count : 0);
+    kept_playout_count = new_root->visits;
+
+    spare_pool->adopt(*pool);
+    pool.swap(spare_pool);
+    root = new_root;
+    is_stale = false;
+    playout_count = 0;
+    prune_count = 0;
+}
+
+DirectionVisits
+SearchTree::get_root_visits() const
+{
+    DirectionVisits visits;
+    for (int direction=0; direction<5; direction++)
+    {
+        const SearchNode* child = root ? root->children[direction] : NULL;
+        visits[direction] = child ? child->visits : 0;
+    }
+    return visits;
+}
+
+size_t
+SearchTree::get_node_count() const
+{
+    return pool->get_live_count();
+}
+
+size_t
+SearchTree::get_reserved_bytes() const
+{
+    return pool->get_reserved_bytes()+spare_pool->get_reserved_bytes();
+}
+
+void
+test_search_tree()
+{
+    std::cout << "Doing search tree test...\n";
+
+    const Tiles tiles = make_benchmark_tiles(18);
+    const PTree root = make_initial_state_json(tiles, 1200);
+    const Tiles background_tiles = neutralize_tiles(tiles);
+    const HashedPair<Tiles> hashed_background_tiles(background_tiles);
+    const Grid background_grid(background_tiles);
+    const State state(root, hashed_background_tiles, background_grid);
+
+    Rng rng;
+    rng.seed(42);
+
+    const size_t max_nodes = 5000;
+    SearchTree tree(max_nodes*sizeof(SearchNode));
+    tree.reset(state, 1200);
+    assert( tree.has_root(state) );
+
+    CancellationToken token;
+    const double start_time = get_double_time();
+    token.set_deadline(start_time+.2);
+    tree.run(token, rng);
+    const double end_time = get_double_time();
+
+    std::cout << tree.playout_count << " playouts " << tree.get_node_count() << " nodes " << tree.prune_count << " prunes" << std::endl;
+    std::cout << "search " << static_cast<int>(1e-3*tree.playout_count/(end_time-start_time)) << "kplayout/s" << std::endl;
+    assert( tree.get_node_count() <= max_nodes );
+    assert( tree.prune_count > 0 );
+
+    const DirectionVisits visits = tree.get_root_visits();
+    const Direction direction = static_cast<Direction>(std::max_element(visits.begin(), visits.end())-visits.begin());
+    const size_t node_count = tree.get_node_count();
+    const unsigned int direction_visits = visits[direction];
+    tree.advance_root(direction);
+    assert( !tree.has_root(state) );
+    tree.compact();
+    assert( tree.get_node_count() == tree.kept_node_count );
+    assert( tree.kept_node_count+tree.dropped_node_count == node_count );
+    assert( tree.kept_playout_count == direction_visits );
+    assert( tree.get_reserved_bytes() <= max_nodes*sizeof(SearchNode) );
+
+    tree.run_playouts(1000, rng);
+    assert( tree.get_node_count() <= max_nodes/2 );
+    tree.advance_root(tree.get_root_visits()[NORTH] > 0 ? NORTH : STAY);
+    tree.compact();
+    assert( tree.get_reserved_bytes() <= max_nodes*sizeof(SearchNode) );
+
+    // reuse along a game against scripted opponents, the root following
+    // every hero move
+    {
+        const PathCache cache(background_grid);
+        const MixedPolicy policy = make_mixed_policy(cache);
+        const int playout_count = 5000;
+        SearchTree reused_tree(64*1024*1024);
+        State game_state(state);
+        reused_tree.reset(game_state, 1200);
+        size_t kept_count = 0;
+        size_t total_count = 0;
+        size_t kept_playouts = 0;
+        int move_count = 0;
+        double compact_time = 0;
+        for (int turn=0; turn<160; turn+=4)
+        {
+            const double start_time = get_double_time();
+            reused_tree.compact();
+            compact_time += get_double_time()-start_time;
+            assert( reused_tree.has_root(game_state) );
+            if (turn > 0)
+            {
+                assert( reused_tree.get_node_count() == std::max<size_t>(1, reused_tree.kept_node_count) );
+                kept_count += reused_tree.kept_node_count;
+                total_count += reused_tree.kept_node_count+reused_tree.dropped_node_count;
+                kept_playouts += reused_tree.kept_playout_count;
+                move_count++;
+            }
+
+            reused_tree.run_playouts(playout_count, rng);
+            const DirectionVisits visits_prime = reused_tree.get_root_visits();
+            const Direction direction_prime = static_cast<Direction>(std::max_element(visits_prime.begin(), visits_prime.end())-visits_prime.begin());
+            reused_tree.advance_root(direction_prime);
+            game_state.update(direction_prime);
+
+            for (int kk=0; kk<3; kk++)
+            {
+                const Direction opponent_direction = policy(game_state, rng);
+                reused_tree.advance_root(opponent_direction);
+                game_state.update(opponent_direction);
+            }
+        }
+        std::cout << "reuse " << 100.*kept_count/total_count << "% nodes kept +" << 100.*kept_playouts/move_count/playout_count << "% playouts " << 1e6*compact_time/move_count << "us per compact" << std::endl;
+        assert( kept_count > 0 );
+    }
+
+    std::cout << "...done!\n";
+}
+
+static
+void
+run_search_task(const State& state, const StreamRng& master_rng, const int& task_index)
+{
+    Rng rng = master_rng.get_stream(task_index);
+    SearchTree tree(16*1024*1024);
+    tree.reset(state, 1200);
+    tree.run_playouts(20000, rng);
+}
+
+void
+test_search_scaling()
+{
+    std::cout << "Doing search scaling test...\n";
+
+    const Tiles tiles = make_benchmark_tiles(28);
+    const PTree root = make_initial_state_json(tiles, 1200);
+    const Tiles background_tiles = neutralize_tiles(tiles);
+    const HashedPair<Tiles> hashed_background_tiles(background_tiles);
+    const Grid background_grid(background_tiles);
+    const State state(root, hashed_background_tiles, background_grid);
+    const StreamRng master_rng(42);
+
+    const int task_count = 32;
+    const int max_worker_count = std::max(2u, std::thread::hardware_concurrency());
+    double single_delta = 0;
+    for (int worker_count=1; worker_count<=max_worker_count; worker_count*=2)
+    {
+        Scheduler scheduler(worker_count);
+        const double start_time = get_double_time();
+        scheduler.parallel_for(task_count, boost::bind(run_search_task, boost::cref(state), boost::cref(master_rng), boost::placeholders::_1));
+        const double end_time = get_double_time();
+
+        const double delta = end_time-start_time;
+        if (worker_count == 1) single_delta = delta;
+        std::cout << worker_count << " workers " << static_cast<int>(1e-3*task_count*20000/delta) << "kplayout/s speedup " << single_delta/delta << std::endl;
+    }
+
+    std::cout << "...done!\n";
+}
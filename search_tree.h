@@ -0,0 +1,110 @@
+#pragma once
+
+#include "state.h"
+#include "pool.h"
+#include "scheduler.h"
+#include <boost/scoped_ptr.hpp>
+
+struct SearchNode
+{
+    SearchNode();
+
+    SearchNode* children[5];
+    unsigned int visits;
+    float value; // reward sum of the hero who moved into this node
+};
+
+typedef NodePool<SearchNode> SearchNodePool;
+typedef boost::array<float, 4> Rewards;
+typedef boost::array<unsigned int, 5> DirectionVisits;
+
+/// Pairwise comparison of the gold each hero would have at the end of the
+/// game if mine ownership did not change anymore, in [0,1].
+Rewards
+get_rewards(const State& state, const int& turns_left);
+
+// UCT tree over raw directions whose nodes live in a NodePool. When the pool
+// budget is reached, low visit subtrees are pruned instead of failing.
+// Between turns the root follows the moves actually played and the subtree
+// below it is kept: it is copied to a second pool and the first one is
+// dropped at once, its chunks going to the new pool.
+struct SearchTree
+{
+    /// Both pools together reserve at most max_bytes, half each, so the
+    /// copy of compact fits the budget.
+    SearchTree(const size_t& max_bytes);
+
+    void
+    reset(const State& state, const int& turns_left);
+
+    bool
+    has_root(const State& state) const;
+
+    void
+    run(const CancellationToken& token, Rng& rng);
+
+    void
+    run_playouts(const int& count, Rng& rng);
+
+    /// Move the root to its child through direction. The nodes left out are
+    /// only freed by the next compact.
+    void
+    advance_root(const Direction& direction);
+
+    /// Keep the subtree of the root and free everything else in bulk, done
+    /// by run and run_playouts when the root moved.
+    void
+    compact();
+
+    DirectionVisits
+    get_root_visits() const;
+
+    size_t
+    get_node_count() const;
+
+    size_t
+    get_reserved_bytes() const;
+
+    int playout_count;
+    int prune_count;
+    size_t kept_node_count; // nodes kept by the last compact
+    size_t dropped_node_count; // nodes freed by the last compact
+    unsigned int kept_playout_count; // root visits kept by the last compact
+
+private:
+
+    typedef std::pair<SearchNode*, int> NodeMover;
+    typedef std::vector<NodeMover> Path;
+
+    SearchTree(const SearchTree& tree); // no copy
+
+    void
+    playout(Rng& rng);
+
+    void
+    prune();
+
+    void
+    prune_below(SearchNode* node, const unsigned int& min_visits);
+
+    void
+    release_subtree(SearchNode* node);
+
+    SearchNode*
+    copy_subtree(const SearchNode* node);
+
+    boost::scoped_ptr<SearchNodePool> pool;
+    boost::scoped_ptr<SearchNodePool> spare_pool; // empty outside of compact
+    bool is_stale; // root moved since the last compact
+    SearchNode* root;
+    boost::scoped_ptr<State> root_state;
+    int root_turns_left;
+    Path path;
+};
+
+void
+test_search_tree();
+
+void
+test_search_scaling();
+
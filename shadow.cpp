@@ -0,0 +1,183 @@
+#include "shadow.h"
+
+#include "policy.h"
+#include "logger.h"
+#include <cstdio>
+#include <unistd.h>
+
+ShadowVerifier::ShadowVerifier(const Grid& grid, const std::string& dump_path) :
+    check_count(0),
+    divergence_count(0),
+    check_time(0),
+    grid(grid),
+    dump_path(dump_path),
+    dumps(),
+    recorded(),
+    recorded_direction(STAY),
+    has_recorded(false)
+{
+}
+
+void
+ShadowVerifier::record(const State& state, const int& turn, const Direction& direction)
+{
+    encode_snapshot(state, turn, recorded);
+    recorded_direction = direction;
+    has_recorded = true;
+}
+
+static
+void
+log_hero(LogLine& line, const State::Hero& hero)
+{
+    line << hero.position << " life " << hero.life << " gold " << hero.gold << " mines " << hero.mines.size() << (hero.crashed ? " crashed" : "");
+}
+
+bool
+ShadowVerifier::verify(const State& state, const int& turn, const MoveInference& inference)
+{
+    if (!has_recorded) return true;
+    has_recorded = false;
+
+    // the last answer of a game can come before every opponent played
+    const int opponent_count = turn-recorded.turn-1;
+    if (opponent_count < 0 || opponent_count > 3)
+    {
+        LogLine(LOG_WARNING) << "shadow can't check turn " << recorded.turn << " to " << turn;
+        return true;
+    }
+
+    const double start_time = get_double_time();
+    assert( inference.opponent_count == opponent_count );
+    check_count++;
+
+    if (inference.match_count > 0)
+    {
+        LogLine(LOG_DEBUG) << "shadow turn " << turn << " matched";
+        check_time += get_double_time()-start_time;
+        return true;
+    }
+
+    divergence_count++;
+
+    // closest prediction
+    State recorded_state(state); // same map as the recorded state
+    int recorded_turn = 0;
+    decode_snapshot(recorded, recorded_state, recorded_turn);
+    State closest(recorded_state);
+    closest.update(recorded_direction);
+    for (int kk=0; kk<opponent_count; kk++)
+        closest.update(inference.directions[kk]);
+
+    LogLine(LOG_WARNING) << "shadow divergence turn " << turn << " after " << recorded_direction << " " << inference;
+    for (int kk=0; kk<4; kk++)
+    {
+        if (closest.heroes[kk] == state.heroes[kk]) continue;
+        {
+            LogLine line(LOG_WARNING);
+            line << "shadow hero " << kk+1 << " predicted ";
+            log_hero(line, closest.heroes[kk]);
+        }
+        {
+            LogLine line(LOG_WARNING);
+            line << "shadow hero " << kk+1 << " server    ";
+            log_hero(line, state.heroes[kk]);
+        }
+    }
+
+    StateSnapshot best;
+    encode_snapshot(closest, turn, best);
+    StateSnapshot server;
+    encode_snapshot(state, turn, server);
+    dumps.push_back(recorded);
+    dumps.push_back(best);
+    dumps.push_back(server);
+    if (!dump_path.empty())
+    {
+        write_snapshots(dump_path, dumps);
+        LogLine(LOG_WARNING) << "shadow dumped " << divergence_count << " divergences to " << dump_path;
+    }
+    check_time += get_double_time()-start_time;
+
+    return false;
+}
+
+void
+test_shadow()
+{
+    std::cout << "Doing shadow verification test...\n";
+
+    Rng rng(42);
+
+    const Tiles tiles = make_benchmark_tiles(18);
+    const PTree root = make_initial_state_json(tiles, 1200);
+    const Tiles background_tiles = neutralize_tiles(tiles);
+    const HashedPair<Tiles> hashed_background_tiles(background_tiles);
+    const Grid grid(background_tiles);
+    const PathCache cache(grid);
+    const MixedPolicy policy = make_mixed_policy(cache, .3);
+
+    // the server is our own simulation, so every turn matches
+    State server_state(root, hashed_background_tiles, grid);
+    ShadowVerifier verifier(grid, "");
+    int turn = 0;
+    while (turn+4 <= 1200)
+    {
+        const Direction direction = policy(server_state, rng);
+        verifier.record(server_state, turn, direction);
+        const State recorded_state(server_state);
+        server_state.update(direction);
+        for (int kk=0; kk<3; kk++)
+            server_state.update(policy(server_state, rng));
+        turn += 4;
+
+        const MoveInference inference = infer_opponent_moves(grid, recorded_state, direction, server_state, 3);
+        const bool matched = verifier.verify(server_state, turn, inference);
+        assert( matched );
+    }
+    assert( verifier.check_count == 300 );
+    assert( verifier.divergence_count == 0 );
+    std::cout << verifier.check_count << " checks " << 1e6*verifier.check_time/verifier.check_count << "us per check" << std::endl;
+
+    // last answer of a game with a single opponent move
+    {
+        const Direction direction = policy(server_state, rng);
+        verifier.record(server_state, turn, direction);
+        const State recorded_state(server_state);
+        server_state.update(direction);
+        server_state.update(policy(server_state, rng));
+        const bool matched = verifier.verify(server_state, turn+2, infer_opponent_moves(grid, recorded_state, direction, server_state, 1));
+        assert( matched );
+    }
+
+    // a server rule our model does not know about
+    char path[] = "/tmp/vindinium_shadow_XXXXXX";
+    const int fd = mkstemp(path);
+    assert( fd >= 0 );
+    close(fd);
+    {
+        ShadowVerifier verifier_prime(grid, path);
+        State state(root, hashed_background_tiles, grid);
+        verifier_prime.record(state, 0, STAY);
+        const State recorded_state(state);
+        for (int kk=0; kk<4; kk++)
+            state.update(STAY);
+        state.heroes[2].gold += 7;
+        const bool matched = verifier_prime.verify(state, 4, infer_opponent_moves(grid, recorded_state, STAY, state, 3));
+        assert( !matched );
+        assert( verifier_prime.divergence_count == 1 );
+
+        const MappedSnapshots mapped(path);
+        assert( mapped.size() == 3 );
+        State state_prime(state);
+        int turn_prime = -1;
+        decode_snapshot(mapped[1], state_prime, turn_prime);
+        assert( count_mismatches(state_prime, state) == 1 );
+        decode_snapshot(mapped[2], state_prime, turn_prime);
+        assert( state_prime == state && turn_prime == 4 );
+    }
+    std::remove(path);
+
+    std::cout << "...done!\n";
+}
+
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "snapshot.h"
+#include "inference.h"
+#include <string>
+
+// Checks the forward model against the server. Before each request the
+// state and our move are recorded, and once the server answered, the
+// opponent moves inferred from the two states are checked. When no sequence
+// of moves gives the server state, the forward model disagrees with the
+// server rules: the closest prediction is logged and the state before, the
+// closest prediction and the server state are appended to a snapshot file.
+struct ShadowVerifier
+{
+    ShadowVerifier(const Grid& grid, const std::string& dump_path); // no dump when dump_path is empty
+
+    /// State and turn right before our direction is sent.
+    void
+    record(const State& state, const int& turn, const Direction& direction);
+
+    /// State and turn of the server answer, false on a divergence. inference
+    /// holds the opponent moves from the recorded state and direction to
+    /// state, the ones the client already inferred to follow the game.
+    bool
+    verify(const State& state, const int& turn, const MoveInference& inference);
+
+    int check_count;
+    int divergence_count;
+    double check_time; // seconds spent in verify
+
+private:
+
+    const Grid& grid;
+    std::string dump_path;
+    StateSnapshots dumps; // before, closest and server snapshots of every divergence
+
+    StateSnapshot recorded;
+    Direction recorded_direction;
+    bool has_recorded;
+};
+
+void
+test_shadow();
+
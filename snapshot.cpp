@@ -0,0 +1,272 @@
+#include "snapshot.h"
+
+#include <cassert>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static_assert(sizeof(HeroSnapshot) == 12, "snapshot layout changed, bump the version");
+static_assert(sizeof(StateSnapshot) == 200, "snapshot layout changed, bump the version");
+static_assert(sizeof(SnapshotFileHeader) == 16, "snapshot layout changed, bump the version");
+
+const uint32_t StateSnapshot::magic_value;
+const uint16_t StateSnapshot::version_value;
+
+void
+encode_snapshot(const State& state, const int& turn, StateSnapshot& snapshot)
+{
+    snapshot.magic = StateSnapshot::magic_value;
+    snapshot.version = StateSnapshot::version_value;
+    snapshot.next_hero_index = state.next_hero_index;
+    snapshot.board_size = state.background_grid.size;
+    snapshot.turn = turn;
+    snapshot.padding = 0;
+    snapshot.map_hash = state.hashed_background_tiles.hash;
+
+    for (int kk=0; kk<4; kk++)
+    {
+        const State::Hero& hero = state.heroes[kk];
+        HeroSnapshot& hero_snapshot = snapshot.heroes[kk];
+        hero_snapshot.gold = hero.gold;
+        hero_snapshot.life = hero.life;
+        hero_snapshot.x = hero.position.x;
+        hero_snapshot.y = hero.position.y;
+        hero_snapshot.spawn_x = hero.spawn_position.x;
+        hero_snapshot.spawn_y = hero.spawn_position.y;
+        hero_snapshot.crashed = hero.crashed;
+        hero_snapshot.padding = 0;
+        snapshot.mines[kk] = hero.mines.words;
+    }
+}
+
+void
+decode_snapshot(const StateSnapshot& snapshot, State& state, int& turn)
+{
+    const Grid& grid = state.background_grid;
+    if (snapshot.magic != StateSnapshot::magic_value) throw std::runtime_error("not a state snapshot");
+    if (snapshot.version != StateSnapshot::version_value) throw std::runtime_error("unsupported state snapshot version");
+    if (snapshot.map_hash != state.hashed_background_tiles.hash || snapshot.board_size != grid.size) throw std::runtime_error("state snapshot of another map");
+    if (snapshot.next_hero_index >= 4) throw std::runtime_error("bad state snapshot hero index");
+
+    // no mine id past the last mine of the board
+    MineSet::Words owned = {{0, 0, 0, 0}};
+    for (int kk=0; kk<4; kk++)
+        for (int ll=0; ll<4; ll++)
+            owned[ll] |= snapshot.mines[kk][ll];
+    for (int ll=0; ll<4; ll++)
+        if (owned[ll] && 64*ll+63-__builtin_clzll(owned[ll]) >= static_cast<int>(grid.mines.size()))
+            throw std::runtime_error("bad state snapshot mine");
+
+    // coordinates are unsigned, only the upper bound needs a check
+    for (int kk=0; kk<4; kk++)
+    {
+        const HeroSnapshot& hero_snapshot = snapshot.heroes[kk];
+        const int max_coordinate = std::max(std::max(hero_snapshot.x, hero_snapshot.y), std::max(hero_snapshot.spawn_x, hero_snapshot.spawn_y));
+        if (max_coordinate >= grid.size) throw std::runtime_error("bad state snapshot hero position");
+    }
+
+    for (int kk=0; kk<4; kk++)
+    {
+        const HeroSnapshot& hero_snapshot = snapshot.heroes[kk];
+        State::Hero& hero = state.heroes[kk];
+        hero.position.x = hero_snapshot.x;
+        hero.position.y = hero_snapshot.y;
+        hero.spawn_position.x = hero_snapshot.spawn_x;
+        hero.spawn_position.y = hero_snapshot.spawn_y;
+        hero.life = hero_snapshot.life;
+        hero.gold = hero_snapshot.gold;
+        hero.crashed = hero_snapshot.crashed;
+        hero.mines.words = snapshot.mines[kk];
+    }
+
+    state.next_hero_index = snapshot.next_hero_index;
+    turn = snapshot.turn;
+}
+
+void
+write_snapshots(const std::string& path, const StateSnapshots& snapshots)
+{
+    SnapshotFileHeader header;
+    header.magic = StateSnapshot::magic_value;
+    header.version = StateSnapshot::version_value;
+    header.snapshot_size = sizeof(StateSnapshot);
+    header.count = snapshots.size();
+
+    std::ofstream file(path.c_str(), std::ios::binary);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (!snapshots.empty()) file.write(reinterpret_cast<const char*>(&snapshots[0]), snapshots.size()*sizeof(StateSnapshot));
+    if (!file) throw std::runtime_error("can't write snapshot file " + path);
+}
+
+MappedSnapshots::MappedSnapshots(const std::string& path) :
+    data(NULL),
+    byte_count(0),
+    snapshots(NULL),
+    count(0)
+{
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("can't open snapshot file " + path);
+
+    struct stat status;
+    if (fstat(fd, &status) < 0 || status.st_size < static_cast<off_t>(sizeof(SnapshotFileHeader)))
+    {
+        close(fd);
+        throw std::runtime_error("truncated snapshot file " + path);
+    }
+
+    byte_count = status.st_size;
+    data = mmap(NULL, byte_count, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) throw std::runtime_error("can't map snapshot file " + path);
+
+    const SnapshotFileHeader& header = *static_cast<const SnapshotFileHeader*>(data);
+    if (header.magic != StateSnapshot::magic_value || header.version != StateSnapshot::version_value || header.snapshot_size != sizeof(StateSnapshot) || byte_count != sizeof(SnapshotFileHeader)+header.count*sizeof(StateSnapshot))
+    {
+        munmap(data, byte_count);
+        throw std::runtime_error("bad snapshot file " + path);
+    }
+
+    snapshots = reinterpret_cast<const StateSnapshot*>(static_cast<const char*>(data)+sizeof(SnapshotFileHeader));
+    count = header.count;
+}
+
+MappedSnapshots::~MappedSnapshots()
+{
+    munmap(data, byte_count);
+}
+
+static
+bool
+is_rejected(const StateSnapshot& snapshot, State& state)
+{
+    int turn = 0;
+    try
+    {
+        decode_snapshot(snapshot, state, turn);
+    }
+    catch (const std::runtime_error& error)
+    {
+        return true;
+    }
+    return false;
+}
+
+void
+test_snapshot()
+{
+    std::cout << "Doing state snapshot test...\n";
+
+    Rng rng(42);
+    UniformRng<int> uniform(rng, 5);
+
+    for (int size=10; size<=28; size+=6)
+    {
+        const Tiles tiles = make_benchmark_tiles(size);
+        const PTree root = make_initial_state_json(tiles, 1200);
+        const Tiles background_tiles = neutralize_tiles(tiles);
+        const HashedPair<Tiles> hashed_background_tiles(background_tiles);
+        const Grid grid(background_tiles);
+        State state(root, hashed_background_tiles, grid);
+
+        // states along a random game, each with its turn
+        StateSnapshots snapshots;
+        typedef std::vector<State> States;
+        States states;
+        for (int turn=0; turn<1200; turn++)
+        {
+            StateSnapshot snapshot;
+            encode_snapshot(state, turn, snapshot);
+            snapshots.push_back(snapshot);
+            states.push_back(state);
+            state.update(static_cast<Direction>(uniform()));
+        }
+
+        // decode(encode(state)) == state
+        State state_prime(root, hashed_background_tiles, grid);
+        for (int kk=0; kk<static_cast<int>(states.size()); kk++)
+        {
+            int turn = -1;
+            decode_snapshot(snapshots[kk], state_prime, turn);
+            assert( turn == kk );
+            assert( state_prime == states[kk] );
+            assert( hash_value(state_prime) == hash_value(states[kk]) );
+        }
+
+        // corrupted snapshots are rejected
+        {
+            StateSnapshot snapshot = snapshots.back();
+            snapshot.version++;
+            assert( is_rejected(snapshot, state_prime) );
+            snapshot = snapshots.back();
+            snapshot.map_hash++;
+            assert( is_rejected(snapshot, state_prime) );
+            snapshot = snapshots.back();
+            snapshot.next_hero_index = 4;
+            assert( is_rejected(snapshot, state_prime) );
+            snapshot = snapshots.back();
+            snapshot.heroes[2].x = size;
+            assert( is_rejected(snapshot, state_prime) );
+            snapshot = snapshots.back();
+            assert( grid.mines.size() < 64 );
+            snapshot.mines[1][0] |= static_cast<uint64_t>(1) << grid.mines.size();
+            assert( is_rejected(snapshot, state_prime) );
+        }
+
+        // mapped file of the whole game
+        char path[] = "/tmp/vindinium_snapshots_XXXXXX";
+        const int fd = mkstemp(path);
+        assert( fd >= 0 );
+        close(fd);
+        write_snapshots(path, snapshots);
+        {
+            const MappedSnapshots mapped(path);
+            assert( mapped.size() == snapshots.size() );
+            for (int kk=0; kk<static_cast<int>(mapped.size()); kk++)
+            {
+                int turn = -1;
+                decode_snapshot(mapped[kk], state_prime, turn);
+                assert( turn == kk );
+                assert( state_prime == states[kk] );
+            }
+        }
+        std::remove(path);
+
+        const int payload = 1000000;
+        double deltas[2] = {0, 0};
+        int checksum = 0;
+        for (int pass=0; pass<2; pass++)
+        {
+            const double start_time = get_double_time();
+            for (int kk=0; kk<payload; kk++)
+            {
+                const int index = kk%states.size();
+                if (pass == 0)
+                {
+                    encode_snapshot(states[index], index, snapshots[index]);
+                    checksum += snapshots[index].heroes[index%4].life;
+                }
+                if (pass == 1)
+                {
+                    int turn = 0;
+                    decode_snapshot(snapshots[index], state_prime, turn);
+                    checksum += state_prime.heroes[index%4].life + turn;
+                }
+            }
+            const double end_time = get_double_time();
+            deltas[pass] = end_time-start_time;
+        }
+
+        std::cout << "snapshot " << size << "x" << size << " " << sizeof(StateSnapshot) << "B";
+        std::cout << " encode " << 1e9*deltas[0]/payload << "ns";
+        std::cout << " decode " << 1e9*deltas[1]/payload << "ns";
+        std::cout << " (" << checksum%1000 << ")" << std::endl;
+    }
+
+    std::cout << "...done!\n";
+}
+
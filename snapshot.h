@@ -0,0 +1,95 @@
+#pragma once
+
+#include "state.h"
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// Fixed size binary image of a State and its turn. The board itself is not
+// stored, only the hash of its background tiles: a snapshot is decoded into a
+// State of the same map, which rejects snapshots of any other map. Fields are
+// in host order, like the engine protocol, and the layout is frozen for a
+// given version: bump snapshot_version on any change.
+struct HeroSnapshot
+{
+    int32_t gold;
+    int16_t life;
+    uint8_t x;
+    uint8_t y;
+    uint8_t spawn_x;
+    uint8_t spawn_y;
+    uint8_t crashed;
+    uint8_t padding;
+};
+
+struct StateSnapshot
+{
+    static const uint32_t magic_value = 0x504e5356; // "VSNP"
+    static const uint16_t version_value = 1;
+
+    uint32_t magic;
+    uint16_t version;
+    uint8_t next_hero_index;
+    uint8_t board_size;
+    uint32_t turn;
+    uint32_t padding;
+    uint64_t map_hash; // hash of the background tiles
+    boost::array<HeroSnapshot, 4> heroes;
+    boost::array<MineSet::Words, 4> mines; // mines owned by each hero
+};
+
+void
+encode_snapshot(const State& state, const int& turn, StateSnapshot& snapshot);
+
+/// Overwrite state with snapshot, which must come from the same map. Throws
+/// std::runtime_error on a bad version, map or hero.
+void
+decode_snapshot(const StateSnapshot& snapshot, State& state, int& turn);
+
+typedef std::vector<StateSnapshot> StateSnapshots;
+
+// Snapshot files are a 16 byte header followed by the snapshots back to
+// back, so they can be mapped and indexed in place.
+struct SnapshotFileHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t snapshot_size;
+    uint64_t count;
+};
+
+void
+write_snapshots(const std::string& path, const StateSnapshots& snapshots);
+
+// Read only memory mapping of a snapshot file.
+struct MappedSnapshots
+{
+    MappedSnapshots(const std::string& path);
+    ~MappedSnapshots();
+
+    size_t
+    size() const
+    {
+        return count;
+    }
+
+    const StateSnapshot&
+    operator[](const size_t& index) const
+    {
+        assert( index < count );
+        return snapshots[index];
+    }
+
+private:
+
+    MappedSnapshots(const MappedSnapshots& mapped); // no copy
+
+    void* data;
+    size_t byte_count;
+    const StateSnapshot* snapshots;
+    size_t count;
+};
+
+void
+test_snapshot();
+
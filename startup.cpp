@@ -0,0 +1,121 @@
+#include "startup.h"
+
+#include "game.h"
+#include "logger.h"
+#include "macro.h"
+#include "network.h"
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+
+StartupPipeline::StartupPipeline() :
+    start_time(get_double_time()),
+    group()
+{
+}
+
+StartupPipeline::~StartupPipeline()
+{
+    // a failed stage stays unpublished, its readers already do without it
+    try { wait(); } catch (std::exception& error) { LogLine(LOG_WARNING) << "startup stage failed " << error.what(); }
+}
+
+void
+StartupPipeline::wait()
+{
+    get_scheduler().wait(group);
+}
+
+static
+PathCache*
+make_path_cache(const Grid& grid)
+{
+    return new PathCache(grid);
+}
+
+static
+PathCache*
+make_failed_path_cache()
+{
+    throw std::runtime_error("no path cache");
+}
+
+static
+int*
+make_map_entry(const int& value)
+{
+    return new int(value);
+}
+
+void
+test_startup()
+{
+    std::cout << "Doing startup pipeline test...\n";
+
+    for (int size=10; size<=28; size+=18)
+    {
+        const Tiles tiles = make_benchmark_tiles(size);
+        const PTree root = make_initial_state_json(tiles, 1200);
+
+        const double start_time = get_double_time();
+        const Game game(root);
+        const double parsed_time = get_double_time();
+
+        double published_time = 0;
+        {
+            StartupStage<PathCache> cache_stage;
+            StartupPipeline pipeline;
+            pipeline.start(cache_stage, boost::bind(make_path_cache, boost::cref(game.background_grid)));
+            const double started_time = get_double_time();
+
+            // polled like a bot waiting on its first move
+            while (!cache_stage.get()) std::this_thread::sleep_for(std::chrono::microseconds(100));
+            published_time = get_double_time();
+            assert( cache_stage.duration > 0 );
+            assert( cache_stage.get()->get_distance(game.background_grid.get_index(game.state.heroes[0].position), game.background_grid.mines[0]) > 0 );
+
+            std::cout << "startup " << size << "x" << size << " game " << clock_it(parsed_time-start_time) << " spawn " << clock_it(started_time-parsed_time) << " path cache " << clock_it(cache_stage.duration) << " published after " << clock_it(published_time-pipeline.start_time) << std::endl;
+        }
+
+        // stages still running are waited for on destruction
+        {
+            StartupStage<PathCache> cache_stage;
+            {
+                StartupPipeline pipeline;
+                pipeline.start(cache_stage, boost::bind(make_path_cache, boost::cref(game.background_grid)));
+            }
+            assert( cache_stage.get() );
+        }
+
+        // failed stages are reported by wait and left unpublished
+        {
+            StartupStage<PathCache> cache_stage;
+            StartupPipeline pipeline;
+            pipeline.start(cache_stage, make_failed_path_cache);
+            bool is_rethrown = false;
+            try { pipeline.wait(); } catch (std::runtime_error&) { is_rethrown = true; }
+            assert( is_rethrown );
+            assert( !cache_stage.get() );
+            pipeline.start(cache_stage, make_failed_path_cache); // logged on destruction
+        }
+    }
+
+    { // one entry per map, dropped past the count once no game holds it
+        const Game game_aa(make_initial_state_json(make_benchmark_tiles(10), 1200));
+        const Game game_bb(make_initial_state_json(make_benchmark_tiles(10), 600));
+        const Game game_cc(make_initial_state_json(make_benchmark_tiles(12), 1200));
+        assert( game_aa.get_map_key() == game_bb.get_map_key() );
+        assert( game_aa.get_map_key() != game_cc.get_map_key() );
+
+        MapTables<int> tables(2);
+        const MapTables<int>::EntryPointer held = tables.get(1, boost::bind(make_map_entry, 1));
+        assert( tables.get(1, boost::bind(make_map_entry, 10)) == held );
+        tables.get(2, boost::bind(make_map_entry, 2));
+        tables.get(3, boost::bind(make_map_entry, 3)); // drops map 2
+        assert( *tables.get(1, boost::bind(make_map_entry, 10)) == 1 );
+        assert( *tables.get(2, boost::bind(make_map_entry, 20)) == 20 );
+    }
+
+    std::cout << "...done!\n";
+}
+
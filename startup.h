@@ -0,0 +1,134 @@
+#pragma once
+
+#include "scheduler.h"
+#include "utils.h"
+#include "hashed.h"
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <boost/bind/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+
+// Result of one per-map precomputation, published once complete. Readers get
+// NULL until then and fall back to decisions that do not need it.
+template <typename Value>
+struct StartupStage
+{
+    typedef boost::function<Value* ()> Compute;
+
+    StartupStage() :
+        value(NULL),
+        duration(0)
+    {
+    }
+
+    ~StartupStage()
+    {
+        delete value.load();
+    }
+
+    Value*
+    get() const
+    {
+        return value.load(std::memory_order_acquire);
+    }
+
+    std::atomic<Value*> value;
+    double duration; // seconds spent computing, set before value is published
+
+private:
+
+    StartupStage(const StartupStage& stage); // no copy
+};
+
+// Per-map precomputations started as background tasks of the worker pool as
+// soon as the board is parsed, so they overlap the first searches instead of
+// running on the first move clock. Declare the pipeline after the stages it fills: its
+// destructor waits for the stages still running.
+struct StartupPipeline
+{
+    StartupPipeline();
+    ~StartupPipeline();
+
+    /// Publish the new Value returned by compute to stage, on a worker.
+    template <typename Value>
+    void
+    start(StartupStage<Value>& stage, const typename StartupStage<Value>::Compute& compute)
+    {
+        get_scheduler().spawn_background(group, boost::bind(&StartupPipeline::run_stage<Value>, boost::ref(stage), compute));
+    }
+
+    void
+    wait();
+
+    const double start_time;
+
+private:
+
+    StartupPipeline(const StartupPipeline& pipeline); // no copy
+
+    template <typename Value>
+    static
+    void
+    run_stage(StartupStage<Value>& stage, const typename StartupStage<Value>::Compute& compute)
+    {
+        const double start_time = get_double_time();
+        Value* value = compute();
+        stage.duration = get_double_time()-start_time;
+        stage.value.store(value, std::memory_order_release);
+    }
+
+    TaskGroup group;
+};
+
+// Per-map data kept across games, and across connections in the daemon, by
+// Game::get_map_key. Past max_count maps, the ones no game holds anymore are
+// dropped when a new map comes in.
+template <typename Entry>
+struct MapTables
+{
+    typedef boost::shared_ptr<Entry> EntryPointer;
+    typedef boost::function<Entry* ()> Make;
+
+    MapTables(const size_t& max_count) :
+        max_count(max_count),
+        mutex(),
+        entries()
+    {
+    }
+
+    /// Entry of the map, from make the first time the map comes in.
+    EntryPointer
+    get(const Hash& map_key, const Make& make)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        typename Entries::const_iterator ei = entries.find(map_key);
+        if (ei != entries.end()) return ei->second;
+
+        for (typename Entries::iterator ej=entries.begin(); entries.size() >= max_count && ej!=entries.end(); )
+        {
+            if (ej->second.unique()) entries.erase(ej++);
+            else ej++;
+        }
+
+        const EntryPointer entry(make());
+        entries.insert(std::make_pair(map_key, entry));
+        return entry;
+    }
+
+    const size_t max_count;
+
+private:
+
+    typedef std::map<Hash, EntryPointer> Entries;
+
+    MapTables(const MapTables& tables); // no copy
+
+    std::mutex mutex;
+    Entries entries;
+};
+
+void
+test_startup();
+
@@ -1,12 +1,19 @@
 #include "state.h"
 
+#include "allocations.h"
+#include <new>
 #include <vector>
+#include <boost/random/uniform_smallint.hpp>
 #include <boost/functional/hash.hpp>
 
-State::State(const PTree& root, const HashedPair<Tiles>& hashed_background_tiles) :
+State::State(const PTree& root, const HashedPair<Tiles>& hashed_background_tiles, const Grid& background_grid) :
     next_hero_index(root.get<int>("game.turn") % 4),
-    hashed_background_tiles(hashed_background_tiles)
+    hashed_background_tiles(hashed_background_tiles),
+    background_grid(background_grid),
+    update_kernel(select_update_kernel(background_grid.dimension))
 {
+    assert( background_grid.size == static_cast<int>(hashed_background_tiles.value.shape()[0]) );
+
     // init heroes
     const OwnedMines owned_mines = get_owned_mines(root.get_child("game.board"));
 
@@ -19,7 +26,7 @@ State::State(const PTree& root, const HashedPair<Tiles>& hashed_background_tiles
         assert( kk+1 == id );
 #endif
 
-        heroes[kk] = Hero(ti->second, owned_mines[kk]);
+        heroes[kk] = Hero(ti->second, make_mine_set(background_grid, owned_mines[kk]));
 
         assert( kk < 4 );
         kk++;
@@ -40,7 +47,7 @@ State::update(const PTree& root)
         const int id = ti->second.get<int>("id");
         assert( kk+1 == id );
 #endif
-        heroes[kk].update(ti->second, owned_mines[kk]);
+        heroes[kk].update(ti->second, make_mine_set(background_grid, owned_mines[kk]));
 
         assert( kk < 4 );
         kk++;
@@ -69,12 +76,8 @@ State::chain_respawn(const int& killed_hero_index, const int& killer_hero_index)
     killed_hero.position = killed_hero.spawn_position;
     killed_hero.life = 100;
     if (killer_hero_index >= 0) // steal mines
-    {
-        Hero& killer_hero = heroes[killer_hero_index];
-        for (PositionsSet::const_iterator mi=killed_hero.mine_positions.begin(), mie=killed_hero.mine_positions.end(); mi!=mie; mi++)
-            killer_hero.mine_positions.insert(*mi);
-    }
-    killed_hero.mine_positions.clear();
+        heroes[killer_hero_index].mines.merge(killed_hero.mines);
+    killed_hero.mines.clear();
 
     if (crushed_hero_index < 0) return;
     if (killed_hero_index == crushed_hero_index) return; // dead on self spawning point
@@ -85,8 +88,25 @@ State::chain_respawn(const int& killed_hero_index, const int& killer_hero_index)
 }
 
 
+State::UpdateKernel
+State::select_update_kernel(const int& dimension)
+{
+#define STATE_SELECT_KERNEL(size) if (dimension == size) return &State::update_with_dimension<FixedDimension<size> >;
+    GRID_FOR_EACH_DIMENSION(STATE_SELECT_KERNEL)
+#undef STATE_SELECT_KERNEL
+
+    return &State::update_with_dimension<GenericDimension>;
+}
+
 void
 State::update(const Direction& direction)
+{
+    (this->*update_kernel)(direction);
+}
+
+template <typename Dimension>
+void
+State::update_with_dimension(const Direction& direction)
 {
     static const Tile hero_index_to_mines[4] = {
         MINE1,
@@ -116,29 +136,13 @@ State::update(const Direction& direction)
     const size_t hero_index = next_hero_index;
     Hero& hero = heroes[hero_index];
 
-    /*{
-        const Tiles& tiles_full = get_tiles_full();
-
-        Tiles tiles_simple(hashed_background_tiles.value);
-        std::fill(tiles_simple.origin(), tiles_simple.origin()+tiles_simple.num_elements(), UNKNOWN);
-        const size_t* shape = tiles_simple.shape();
-        for (size_t ii=0; ii<shape[0]; ii++)
-            for (size_t jj=0; jj<shape[1]; jj++)
-            {
-                const Position position(ii,jj);
-                tiles_simple[ii][jj] = get_tile_from_background(position);
-            }
-
-        assert( tiles_simple == tiles_full );
-    }*/
-
-
     // move hero and resolve local interaction
     if (direction != STAY)
     {
-        Position target_position = hero.position;
-        target_position.with_direction(direction);
-        const Tile& target_tile = get_tile_from_background_border_check(target_position);
+        const int stride = Dimension::get_stride(background_grid);
+        const PositionIndex target_index = hero.position.to_index(stride) + Dimension::get_offset(background_grid, direction);
+        const Position target_position = Position::from_index(target_index, stride);
+        const Tile target_tile = process_background_tile(background_grid.get_tile(target_index), target_position, target_index);
 
         switch (target_tile)
         {
@@ -167,12 +171,13 @@ State::update(const Direction& direction)
             if (target_tile == hero_index_to_mines[hero_index]) break;
             hero.life -= 20;
             if (hero.life <= 0) break;
-            hero.mine_positions.insert(target_position);
+            const MineId mine_id = background_grid.get_mine_id(target_index);
+            hero.mines.insert(mine_id);
             const int spoiled_hero_index = tile_to_hero_indexes[static_cast<int>(target_tile)];
             if (spoiled_hero_index < 0) break;
             Hero& spoiled_hero = heroes[spoiled_hero_index];
-            assert( spoiled_hero.mine_positions.find(target_position) != spoiled_hero.mine_positions.end() );
-            spoiled_hero.mine_positions.erase(target_position);
+            assert( spoiled_hero.mines.contains(mine_id) );
+            spoiled_hero.mines.erase(mine_id);
             break;
         }
 
@@ -201,7 +206,7 @@ State::update(const Direction& direction)
     if (hero.life > 1) hero.life--;
 
     // mining
-    hero.gold += hero.mine_positions.size();
+    hero.gold += hero.mines.size();
 
     // tick next_hero_index
     next_hero_index++;
@@ -229,7 +234,7 @@ State::status(std::ostream& os) const
         os << "@" << (kk+1) << " " << "\033[" << colors[kk] << "m";
         os << hero.life << "hp ";
         os << hero.gold << "g ";
-        os << hero.mine_positions.size() << "m";
+        os << hero.mines.size() << "m";
         os << "\033[0m" << std::endl;
     }
 
@@ -262,7 +267,7 @@ operator==(const State& state_aa, const State& state_bb)
 }
 
 typedef std::pair<int, int> GoldIdPair;
-typedef std::vector<GoldIdPair> GoldIdPairs;
+typedef boost::array<GoldIdPair, 4> GoldIdPairs;
 
 static
 bool
@@ -276,7 +281,7 @@ State::get_winner() const
 {
     GoldIdPairs gold_ids;
     for (int kk=0; kk<4; kk++)
-        gold_ids.push_back(std::make_pair(heroes[kk].gold, kk));
+        gold_ids[kk] = std::make_pair(heroes[kk].gold, kk);
 
     std::sort(gold_ids.begin(), gold_ids.end(), sort_gold_id_pair);
 
@@ -299,7 +304,7 @@ State::get_ranks() const {
     boost::array<int, 4> res;
     GoldIdPairs gold_ids;
     for (int kk=0; kk<4; kk++)
-        gold_ids.push_back(std::make_pair(heroes[kk].gold, kk));
+        gold_ids[kk] = std::make_pair(heroes[kk].gold, kk);
 
     std::sort(gold_ids.begin(), gold_ids.end(), sort_gold_id_pair);
     for (int kk=0; kk<4; kk++) {
@@ -309,7 +314,7 @@ State::get_ranks() const {
 }
 
 Tile
-State::process_background_tile(const Tile& tile, const Position& position) const
+State::process_background_tile(const Tile& tile, const Position& position, const PositionIndex& index) const
 {
     static const Tile hero_tiles[4] = {HERO1, HERO2, HERO3, HERO4};
     static const Tile hero_mine_tiles[4] = {MINE1, MINE2, MINE3, MINE4};
@@ -332,11 +337,8 @@ State::process_background_tile(const Tile& tile, const Position& position) const
         return UNKNOWN;
     case MINE:
         for (int kk=0; kk<4; kk++)
-        {
-            const Hero& hero = heroes[kk];
-            if (hero.mine_positions.find(position) != hero.mine_positions.end())
+            if (heroes[kk].mines.contains(background_grid.get_mine_id(index)))
                 return hero_mine_tiles[kk];
-        }
         return tile;
     case EMPTY:
         for (int kk=0; kk<4; kk++)
@@ -349,16 +351,46 @@ State::process_background_tile(const Tile& tile, const Position& position) const
     return UNKNOWN;
 }
 
+State::Bitboards
+State::get_bitboards() const
+{
+    Bitboards bitboards;
+    for (int kk=0; kk<4; kk++)
+    {
+        const Hero& hero = heroes[kk];
+        bitboards.hero_positions[kk].set(background_grid.get_index(hero.position));
+        bitboards.heroes |= bitboards.hero_positions[kk];
+
+        for (int mine_id=0; mine_id<static_cast<int>(background_grid.mines.size()); mine_id++)
+            if (hero.mines.contains(mine_id))
+                bitboards.owned_mines[kk].set(background_grid.mines[mine_id]);
+    }
+
+    bitboards.free = background_grid.passable;
+    bitboards.free.and_not(bitboards.heroes);
+
+    return bitboards;
+}
+
+int
+State::get_stride() const
+{
+    return background_grid.stride;
+}
+
 Tile
 State::get_tile_from_background(const Position& position) const
 {
-    return process_background_tile(get_tile(hashed_background_tiles.value, position), position);
+    const PositionIndex index = background_grid.get_index(position);
+    return process_background_tile(get_tile(background_grid, position), position, index);
 }
 
 Tile
 State::get_tile_from_background_border_check(const Position& position) const
 {
-    return process_background_tile(get_tile_border_check(hashed_background_tiles.value, position), position);
+    if (!background_grid.in_padded_board(position)) return UNKNOWN;
+    const PositionIndex index = background_grid.get_index(position);
+    return process_background_tile(background_grid.get_tile(index), position, index);
 }
 
 Tiles
@@ -373,9 +405,10 @@ State::get_tiles_full() const
     {
         const Hero& hero = heroes[kk];
         get_tile(tiles, hero.position) = hero_tiles[kk];
-        for (PositionsSet::const_iterator mi=hero.mine_positions.begin(), mie=hero.mine_positions.end(); mi!=mie; mi++)
+        for (size_t mine_id=0; mine_id<background_grid.mines.size(); mine_id++)
         {
-            Tile& tile = get_tile(tiles, *mi);
+            if (!hero.mines.contains(mine_id)) continue;
+            Tile& tile = get_tile(tiles, background_grid.get_position(background_grid.mines[mine_id]));
             assert( tile == MINE );
             tile = hero_mine_tiles[kk];
         }
@@ -388,33 +421,33 @@ State::Hero::Hero() :
     position(Position()),
     life(-1),
     gold(-1),
-    mine_positions(),
+    mines(),
     spawn_position(Position()),
     crashed(true)
 {
 }
 
-State::Hero::Hero(const PTree& root, const PositionsSet& mine_positions) :
+State::Hero::Hero(const PTree& root, const MineSet& mines) :
     position(get_position(root.get_child("pos"))),
     life(root.get<int>("life")),
     gold(root.get<int>("gold")),
-    mine_positions(mine_positions),
+    mines(mines),
     spawn_position(get_position(root.get_child("spawnPos"))),
     crashed(root.get<bool>("crashed"))
 {
-    assert( root.get<size_t>("mineCount") == mine_positions.size() );
+    assert( root.get<int>("mineCount") == mines.size() );
 }
 
 void
-State::Hero::update(const PTree& root, const PositionsSet& mine_positions)
+State::Hero::update(const PTree& root, const MineSet& mines)
 {
     this->position = get_position(root.get_child("pos"));
     this->life = root.get<int>("life");
     this->gold = root.get<int>("gold");
     this->crashed = root.get<bool>("crashed");
-    this->mine_positions = mine_positions;
+    this->mines = mines;
 
-    assert( root.get<size_t>("mineCount") == mine_positions.size() );
+    assert( root.get<int>("mineCount") == mines.size() );
 }
 
 Hash
@@ -426,7 +459,7 @@ hash_value(const State::Hero& hero)
     boost::hash_combine(seed, hero.gold);
     boost::hash_combine(seed, hero.crashed);
     boost::hash_combine(seed, hero.spawn_position);
-    boost::hash_range(seed, hero.mine_positions.begin(), hero.mine_positions.end());
+    boost::hash_combine(seed, hero.mines);
     return seed;
 }
 
@@ -439,8 +472,129 @@ operator==(const State::Hero& hero_aa, const State::Hero& hero_bb)
     if (hero_aa.crashed != hero_bb.crashed) return false;
     if (hero_aa.spawn_position != hero_bb.spawn_position) return false;
 
-    if (hero_aa.mine_positions.size() != hero_bb.mine_positions.size()) return false;
-    return std::equal(hero_aa.mine_positions.begin(), hero_aa.mine_positions.end(), hero_bb.mine_positions.begin());
+    return hero_aa.mines == hero_bb.mines;
 }
 
 
+
+void
+test_state()
+{
+    std::cout << "Doing state test...\n";
+
+    Rng rng;
+    rng.seed(42);
+    UniformRng<int> uniform(rng, 5);
+
+    typedef std::vector<Direction> Directions;
+    Directions directions;
+    for (int kk=0; kk<100000; kk++)
+        directions.push_back(static_cast<Direction>(uniform()));
+
+    for (int size=10; size<=28; size+=2)
+    {
+        const Tiles tiles = make_benchmark_tiles(size);
+        const PTree root = make_initial_state_json(tiles, 1200);
+        const Tiles background_tiles = neutralize_tiles(tiles);
+        const HashedPair<Tiles> hashed_background_tiles(background_tiles);
+        const Grid fixed_grid(background_tiles);
+        const Grid generic_grid(background_tiles, false);
+
+        const State fixed_initial(root, hashed_background_tiles, fixed_grid);
+        const State generic_initial(root, hashed_background_tiles, generic_grid);
+        assert( fixed_initial == generic_initial );
+
+        double fixed_delta = 0;
+        double generic_delta = 0;
+        Hash fixed_seed = 0;
+        Hash generic_seed = 0;
+        for (int pass=0; pass<2; pass++)
+        {
+            State state(pass == 0 ? fixed_initial : generic_initial);
+            Hash seed = 0;
+            const double start_time = get_double_time();
+            for (Directions::const_iterator di=directions.begin(), die=directions.end(); di!=die; di++)
+            {
+                state.update(*di);
+                seed += state.heroes[state.next_hero_index].life;
+            }
+            const double end_time = get_double_time();
+            boost::hash_combine(seed, hash_value(state));
+            (pass == 0 ? fixed_delta : generic_delta) = end_time-start_time;
+            (pass == 0 ? fixed_seed : generic_seed) = seed;
+
+            const State::Bitboards bitboards = state.get_bitboards();
+            for (int kk=0; kk<4; kk++)
+            {
+                const State::Hero& hero = state.heroes[kk];
+                assert( bitboards.owned_mines[kk].count() == hero.mines.size() );
+                assert( bitboards.hero_positions[kk].test(hero.position.to_index(state.get_stride())) );
+                assert( !bitboards.free.test(hero.position.to_index(state.get_stride())) );
+                for (int ll=0; ll<4; ll++)
+                    if (ll != kk) assert( is_adjacent(bitboards.hero_positions[kk], bitboards.hero_positions[ll], state.get_stride()) == hero.position.next_to(state.heroes[ll].position) );
+            }
+        }
+        assert( fixed_seed == generic_seed );
+
+        std::cout << "update " << size << "x" << size;
+        std::cout << " fixed " << static_cast<int>(1e-3*directions.size()/fixed_delta) << "kupdate/s";
+        std::cout << " generic " << static_cast<int>(1e-3*directions.size()/generic_delta) << "kupdate/s";
+        std::cout << " speedup " << generic_delta/fixed_delta << std::endl;
+    }
+
+    std::cout << "...done!\n";
+}
+
+void
+test_state_allocations()
+{
+    std::cout << "Doing state allocations test...\n";
+
+    if (!is_counting_allocations())
+    {
+        std::cout << "skipped, configure with COUNT_ALLOCATIONS to enable\n";
+        return;
+    }
+
+    // the nothrow forms are counted too
+    {
+        const AllocationCounter counter;
+        int* pointer = new (std::nothrow) int(1);
+        int* pointers = new (std::nothrow) int[4];
+        delete pointer;
+        delete[] pointers;
+        assert( counter.get_count() == 2 );
+    }
+
+    const Tiles tiles = make_benchmark_tiles(28);
+    const PTree root = make_initial_state_json(tiles, 1200);
+    const Tiles background_tiles = neutralize_tiles(tiles);
+    const HashedPair<Tiles> hashed_background_tiles(background_tiles);
+    const Grid background_grid(background_tiles);
+    const State initial_state(root, hashed_background_tiles, background_grid);
+
+    Rng rng;
+    rng.seed(42);
+    UniformRng<int> uniform(rng, 5);
+
+    State state(initial_state);
+    Hash seed = 0;
+    int winner_total = 0;
+    int rank_total = 0;
+
+    const AllocationCounter counter;
+    for (int kk=0; kk<100000; kk++)
+    {
+        state.update(static_cast<Direction>(uniform()));
+        boost::hash_combine(seed, hash_value(state));
+        winner_total += state.get_winner();
+        rank_total += state.get_ranks()[kk%4];
+    }
+    const size_t allocation_count = counter.get_count();
+
+    std::cout << std::hex << seed << std::dec << " " << winner_total << " " << rank_total << std::endl;
+    std::cout << allocation_count << " allocations" << std::endl;
+    assert( allocation_count == 0 );
+
+    std::cout << "...done!\n";
+}
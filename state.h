@@ -2,28 +2,40 @@
 
 #include "hashed.h"
 #include "network.h"
+#include "grid.h"
 #include <boost/array.hpp>
 
+struct StateSnapshot;
+
 struct State
 {
     struct Hero
     {
         Hero();
-        Hero(const PTree& root, const PositionsSet& mine_positions);
+        Hero(const PTree& root, const MineSet& mines);
 
-        void update(const PTree&, const PositionsSet& mine_positions);
+        void update(const PTree&, const MineSet& mines);
 
         Position position;
         int life;
         int gold;
-        PositionsSet mine_positions;
+        MineSet mines;
         Position spawn_position;
         bool crashed;
     };
 
     typedef boost::array<Hero, 4> Heroes;
 
-    State(const PTree& root, const HashedPair<Tiles>& background_tiles);
+    // Whole board sets of the current heroes, see bitboard.h.
+    struct Bitboards
+    {
+        Bitboard heroes;
+        boost::array<Bitboard, 4> hero_positions;
+        boost::array<Bitboard, 4> owned_mines;
+        Bitboard free; // passable and not occupied by a hero
+    };
+
+    State(const PTree& root, const HashedPair<Tiles>& background_tiles, const Grid& background_grid);
 
     void
     update(const PTree& root);
@@ -41,6 +53,12 @@ struct State
     boost::array<int, 4>
     get_ranks() const;
 
+    Bitboards
+    get_bitboards() const;
+
+    int
+    get_stride() const;
+
     Tile
     get_tile_from_background(const Position& position) const;
 
@@ -54,7 +72,7 @@ struct State
 private:
 
     Tile
-    process_background_tile(const Tile& tile, const Position& position) const;
+    process_background_tile(const Tile& tile, const Position& position, const PositionIndex& index) const;
 
     Tiles
     get_tiles_full() const;
@@ -62,6 +80,16 @@ private:
     void
     chain_respawn(const int& killed_hero_index, const int& killer_hero_index);
 
+    typedef void (State::*UpdateKernel)(const Direction& direction);
+
+    template <typename Dimension>
+    void
+    update_with_dimension(const Direction& direction);
+
+    static
+    UpdateKernel
+    select_update_kernel(const int& dimension);
+
     friend
     Hash
     hash_value(const State& state);
@@ -70,7 +98,17 @@ private:
     bool
     operator==(const State& state_aa, const State& state_bb);
 
+    friend
+    void
+    encode_snapshot(const State& state, const int& turn, StateSnapshot& snapshot);
+
+    friend
+    void
+    decode_snapshot(const StateSnapshot& snapshot, State& state, int& turn);
+
     const HashedPair<Tiles> hashed_background_tiles;
+    const Grid& background_grid;
+    UpdateKernel update_kernel;
 
 };
 
@@ -83,3 +121,9 @@ hash_value(const State::Hero& hero);
 bool
 operator==(const State::Hero& hero_aa, const State::Hero& hero_bb);
 
+void
+test_state();
+
+void
+test_state_allocations();
+
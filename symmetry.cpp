@@ -0,0 +1,265 @@
+#include "symmetry.h"
+
+#include "alphabeta.h"
+#include "endgame.h"
+#include "macro.h"
+#include <algorithm>
+#include <boost/unordered_set.hpp>
+
+SymmetryGroup::SymmetryGroup(const Grid& grid, const State& state, const bool& enabled) :
+    symmetries(),
+    size(grid.size),
+    stride(grid.stride)
+{
+    for (Transforms::const_iterator ti=grid.symmetries.begin(), tie=grid.symmetries.end(); ti!=tie; ti++)
+    {
+        if (!enabled && *ti != IDENTITY) break;
+
+        // the spawns have to be permuted cyclically to keep the turn order
+        int hero_shift = -1;
+        for (int shift=0; shift<4 && hero_shift<0; shift++)
+        {
+            bool is_match = true;
+            for (int kk=0; kk<4; kk++)
+                is_match &= transform_position(state.heroes[kk].spawn_position, *ti, size) == state.heroes[(kk+shift)%4].spawn_position;
+            if (is_match) hero_shift = shift;
+        }
+        if (hero_shift < 0) continue;
+
+        Symmetry symmetry;
+        symmetry.transform = *ti;
+        symmetry.hero_shift = hero_shift;
+        for (int mine_id=0; mine_id<static_cast<int>(grid.mines.size()); mine_id++)
+            symmetry.mine_ids.push_back(grid.get_mine_id(grid.transform_index(grid.mines[mine_id], *ti)));
+        for (int direction=STAY; direction<=WEST; direction++)
+        {
+            symmetry.directions[direction] = transform_direction(static_cast<Direction>(direction), *ti);
+            symmetry.inverse_directions[direction] = transform_direction(static_cast<Direction>(direction), invert_transform(*ti));
+        }
+        symmetries.push_back(symmetry);
+    }
+
+    assert( !symmetries.empty() );
+    assert( symmetries.front().transform == IDENTITY && symmetries.front().hero_shift == 0 );
+}
+
+State
+SymmetryGroup::transform_state(const State& state, const int& symmetry_index) const
+{
+    const Symmetry& symmetry = symmetries[symmetry_index];
+
+    State state_prime(state);
+    for (int kk=0; kk<4; kk++)
+    {
+        const State::Hero& hero = state.heroes[kk];
+        State::Hero& hero_prime = state_prime.heroes[(kk+symmetry.hero_shift)%4];
+        hero_prime = hero;
+        hero_prime.position = transform_position(hero.position, symmetry.transform, size);
+        hero_prime.spawn_position = transform_position(hero.spawn_position, symmetry.transform, size);
+        hero_prime.mines.clear();
+        for (int ll=0; ll<static_cast<int>(hero.mines.words.size()); ll++)
+            for (uint64_t word=hero.mines.words[ll]; word; word&=word-1)
+                hero_prime.mines.insert(symmetry.mine_ids[64*ll + __builtin_ctzll(word)]);
+    }
+    state_prime.next_hero_index = (state.next_hero_index+symmetry.hero_shift)%4;
+
+    return state_prime;
+}
+
+CanonicalKey
+SymmetryGroup::get_canonical_key(const State& state) const
+{
+    if (is_trivial())
+    {
+        const CanonicalKey key = {hash_value(state), 0};
+        return key;
+    }
+
+    // the canonical state is the image where the hero to move comes first,
+    // the hash only breaks ties between symmetries with the same shift
+    int first_hero_index = 4;
+    for (Symmetries::const_iterator si=symmetries.begin(), sie=symmetries.end(); si!=sie; si++)
+        first_hero_index = std::min(first_hero_index, (state.next_hero_index+si->hero_shift)%4);
+
+    CanonicalKey key = {0, -1};
+    for (int kk=0; kk<static_cast<int>(symmetries.size()); kk++)
+    {
+        if ((state.next_hero_index+symmetries[kk].hero_shift)%4 != first_hero_index) continue;
+        const Hash hash = kk == 0 ? hash_value(state) : hash_value(transform_state(state, kk));
+        if (key.symmetry_index >= 0 && hash >= key.hash) continue;
+        key.hash = hash;
+        key.symmetry_index = kk;
+    }
+    return key;
+}
+
+State
+SymmetryGroup::get_canonical_state(const State& state, int& symmetry_index) const
+{
+    symmetry_index = get_canonical_key(state).symmetry_index;
+    return transform_state(state, symmetry_index);
+}
+
+typedef boost::unordered_set<Hash> HashSet;
+
+// Every state reachable in depth half turns, by raw and canonical hash.
+static
+void
+collect_hashes(const SymmetryGroup& group, const State& state, const int& depth, HashSet& raw_hashes, HashSet& canonical_hashes)
+{
+    raw_hashes.insert(hash_value(state));
+    canonical_hashes.insert(group.get_canonical_key(state).hash);
+    if (depth <= 0) return;
+
+    for (int direction=STAY; direction<=WEST; direction++)
+    {
+        State state_prime(state);
+        state_prime.update(static_cast<Direction>(direction));
+        collect_hashes(group, state_prime, depth-1, raw_hashes, canonical_hashes);
+    }
+}
+
+void
+test_symmetry()
+{
+    std::cout << "Doing symmetry test...\n";
+
+    for (int transform=IDENTITY; transform<=ANTI_TRANSPOSE; transform++)
+    {
+        const Transform transform_prime = invert_transform(static_cast<Transform>(transform));
+        for (int direction=STAY; direction<=WEST; direction++)
+            assert( transform_direction(transform_direction(static_cast<Direction>(direction), static_cast<Transform>(transform)), transform_prime) == direction );
+        const Position position(2,5);
+        assert( transform_position(transform_position(position, static_cast<Transform>(transform), 12), transform_prime, 12) == position );
+    }
+    assert( transform_direction(NORTH, ROTATE_90) == EAST );
+
+    assert( detect_symmetries(make_benchmark_tiles(18)).size() == 1 );
+    assert( detect_symmetries(make_symmetric_benchmark_tiles(18)).size() == 8 );
+
+    Rng rng(42);
+    for (int size=10; size<=28; size+=18)
+    {
+        const Tiles tiles = make_symmetric_benchmark_tiles(size);
+        const PTree root = make_initial_state_json(tiles, 1200);
+        const Tiles background_tiles = neutralize_tiles(tiles);
+        const HashedPair<Tiles> hashed_background_tiles(background_tiles);
+        const Grid grid(background_tiles);
+        const State initial_state(root, hashed_background_tiles, grid);
+
+        // the four rotations map the spawns cyclically, the mirrors do not
+        const SymmetryGroup group(grid, initial_state);
+        assert( group.symmetries.size() == 4 );
+        const SymmetryGroup trivial_group(grid, initial_state, false);
+        assert( trivial_group.is_trivial() );
+        assert( trivial_group.get_canonical_key(initial_state).hash == hash_value(initial_state) );
+
+        // symmetric states share their key and moves commute with the symmetries
+        State state(initial_state);
+        UniformRng<int> uniform(rng, 5);
+        int check_count = 0;
+        for (int turn=0; turn<400; turn++)
+        {
+            const CanonicalKey key = group.get_canonical_key(state);
+            int symmetry_index = -1;
+            assert( hash_value(group.get_canonical_state(state, symmetry_index)) == key.hash );
+            assert( symmetry_index == key.symmetry_index );
+
+            const Direction direction = static_cast<Direction>(uniform());
+            State state_next(state);
+            state_next.update(direction);
+            for (int kk=0; kk<static_cast<int>(group.symmetries.size()); kk++)
+            {
+                const State state_prime = group.transform_state(state, kk);
+                assert( group.get_canonical_key(state_prime).hash == key.hash );
+
+                State state_prime_next(state_prime);
+                state_prime_next.update(group.symmetries[kk].directions[direction]);
+                assert( state_prime_next == group.transform_state(state_next, kk) );
+                check_count++;
+            }
+
+            state.update(direction);
+        }
+
+        // path cache fields of symmetric targets are mapped instead of searched
+        {
+            const double cache_start_time = get_double_time();
+            const PathCache cache(grid);
+            const double cache_end_time = get_double_time();
+            Grid asymmetric_grid(grid);
+            asymmetric_grid.symmetries.resize(1);
+            const PathCache asymmetric_cache(asymmetric_grid);
+            const double asymmetric_end_time = get_double_time();
+
+            Distances distances;
+            for (int target=0; target<static_cast<int>(grid.cells.size()); target++)
+            {
+                if (!grid.passable.test(target) && !grid.mine_cells.test(target) && !grid.taverns.test(target)) continue;
+                fill_distances(grid, target, distances);
+                for (int index=0; index<static_cast<int>(grid.cells.size()); index++)
+                {
+                    assert( cache.get_distance(index, target) == distances[index] );
+                    assert( asymmetric_cache.get_distance(index, target) == distances[index] );
+                }
+            }
+
+            std::cout << size << "x" << size << " " << grid.symmetries.size() << " board symmetries path cache " << clock_it(cache_end_time-cache_start_time) << " against " << clock_it(asymmetric_end_time-cache_end_time) << " without" << std::endl;
+        }
+
+        // how many states of a shallow search are the same up to symmetry
+        HashSet raw_hashes;
+        HashSet canonical_hashes;
+        collect_hashes(group, initial_state, 6, raw_hashes, canonical_hashes);
+
+        const int payload = 100000;
+        const double start_time = get_double_time();
+        Hash checksum = 0;
+        for (int kk=0; kk<payload; kk++)
+            checksum += group.get_canonical_key(state).hash;
+        const double end_time = get_double_time();
+
+        std::cout << size << "x" << size << " " << check_count << " checks " << raw_hashes.size() << " states " << canonical_hashes.size() << " canonical (" << static_cast<double>(raw_hashes.size())/canonical_hashes.size() << "x) key " << 1e9*(end_time-start_time)/payload << "ns (" << checksum%1000 << ")" << std::endl;
+
+        // transposition hits gained at a fixed depth, the values do not change
+        boost::array<int, 2> values;
+        for (int enabled=0; enabled<2; enabled++)
+        {
+            const SymmetryGroup search_group(grid, initial_state, enabled);
+            TranspositionTable table(16*1024*1024);
+            CancellationToken token;
+            AlphaBetaSearch search(grid, search_group, table, false);
+            const double search_start_time = get_double_time();
+            search.run(initial_state, 1200, token, 1, 8);
+            const double search_end_time = get_double_time();
+            values[enabled] = search.best_value;
+            std::cout << (enabled ? "canonical" : "raw") << " keys depth " << search.completed_depth << " " << search.node_count << " nodes " << search.table_hit_count << " table hits " << clock_it(search_end_time-search_start_time) << std::endl;
+        }
+        assert( values[0] == values[1] );
+
+        // same for the endgame proofs along the game
+        {
+            const SymmetryGroup search_group(grid, initial_state, false);
+            TranspositionTable table(16*1024*1024);
+            TranspositionTable raw_table(16*1024*1024);
+            EndgameSolver solver(grid, group, table);
+            EndgameSolver raw_solver(grid, search_group, raw_table);
+            CancellationToken token;
+            State state_prime(initial_state);
+            for (int turn=0; turn<400; turn++)
+            {
+                if (turn%40 == 39)
+                {
+                    const EndgameResult result = solver.solve(state_prime, 6, token);
+                    const EndgameResult raw_result = raw_solver.solve(state_prime, 6, token);
+                    assert( result.proven && raw_result.proven );
+                    assert( result.score == raw_result.score );
+                }
+                state_prime.update(static_cast<Direction>(uniform()));
+            }
+        }
+    }
+
+    std::cout << "...done!\n";
+}
+
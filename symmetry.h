@@ -0,0 +1,72 @@
+#pragma once
+
+#include "state.h"
+#include <vector>
+#include <boost/array.hpp>
+
+// Symmetry of the game: a transform of the board that also maps the spawn
+// of every hero onto the spawn of the hero hero_shift places later. Turn
+// order only depends on the hero indices modulo 4, so relabeling the heroes
+// cyclically keeps the game identical once directions are mapped.
+struct Symmetry
+{
+    Transform transform;
+    int hero_shift; // hero kk becomes hero (kk+hero_shift)%4
+    Grid::MineIds mine_ids; // image of each mine id
+    boost::array<Direction, 5> directions; // image of each direction
+    boost::array<Direction, 5> inverse_directions;
+};
+
+struct CanonicalKey
+{
+    Hash hash; // hash_value of the canonical state
+    int symmetry_index; // symmetry mapping the state to the canonical one
+};
+
+// Symmetries of one game, detected from the board and the spawns. Every
+// state maps to its symmetric image with the first hero to move, the
+// smallest hash breaking ties, so tables keyed by the canonical hash share
+// the entries of symmetric states. Directions stored next to a canonical
+// key are in the canonical frame.
+struct SymmetryGroup
+{
+    typedef std::vector<Symmetry> Symmetries;
+
+    SymmetryGroup(const Grid& grid, const State& state, const bool& enabled=true);
+
+    /// hash_value(state) when the game has no symmetry.
+    CanonicalKey
+    get_canonical_key(const State& state) const;
+
+    State
+    get_canonical_state(const State& state, int& symmetry_index) const;
+
+    State
+    transform_state(const State& state, const int& symmetry_index) const;
+
+    Direction
+    to_canonical(const Direction& direction, const int& symmetry_index) const
+    {
+        return symmetries[symmetry_index].directions[direction];
+    }
+
+    Direction
+    from_canonical(const Direction& direction, const int& symmetry_index) const
+    {
+        return symmetries[symmetry_index].inverse_directions[direction];
+    }
+
+    bool
+    is_trivial() const
+    {
+        return symmetries.size() == 1;
+    }
+
+    Symmetries symmetries; // identity first
+    int size;
+    int stride;
+};
+
+void
+test_symmetry();
+
@@ -0,0 +1,206 @@
+#include "territory.h"
+
+#include "network.h"
+#include <cassert>
+
+const int Territory::no_owner;
+const int Territory::contested_owner;
+
+Territory::Territory() :
+    distances(),
+    owned(),
+    contested(),
+    mine_counts(),
+    contested_mine_count(0),
+    tavern_distances(),
+    arrivals(),
+    lanes(),
+    queue()
+{
+}
+
+int
+Territory::get_owner(const PositionIndex& index) const
+{
+    if (contested.test(index)) return contested_owner;
+    for (int kk=0; kk<4; kk++)
+        if (owned[kk].test(index)) return kk;
+    return no_owner;
+}
+
+void
+fill_territory(const Grid& grid, const State::Heroes& heroes, Territory& territory, const bool& with_distances)
+{
+    const int cell_count = grid.cells.size();
+    Distances& arrivals = territory.arrivals;
+    Territory::Lanes& lanes = territory.lanes;
+    Territory::Indexes& queue = territory.queue;
+    arrivals.assign(cell_count, -1);
+    lanes.assign(cell_count, 0);
+    queue.resize(cell_count);
+
+    int head = 0;
+    int tail = 0;
+    for (int kk=0; kk<4; kk++)
+    {
+        const PositionIndex source = grid.get_index(heroes[kk].position);
+        if (arrivals[source] < 0)
+        {
+            arrivals[source] = 0;
+            queue[tail++] = source;
+        }
+        lanes[source] |= 1 << kk;
+
+        territory.owned[kk] = Bitboard();
+        territory.mine_counts[kk] = 0;
+        territory.tavern_distances[kk] = grid.tavern_distances[source];
+        if (with_distances) fill_distances(grid, source, territory.distances[kk]);
+    }
+    territory.contested = Bitboard();
+    territory.contested_mine_count = 0;
+
+    // Cells leave the queue in arrival order, so every hero arriving at the
+    // first step has been merged in the lanes when the cell is settled. A
+    // hero that is not among the first at a cell is not among the first
+    // past it either, so each cell is expanded once.
+    while (head < tail)
+    {
+        const PositionIndex current = queue[head++];
+        const uint8_t current_lanes = lanes[current];
+        const Distance next_arrival = arrivals[current]+1;
+
+        const bool is_mine = grid.get_mine_id(current) != Grid::no_mine;
+        if (current_lanes & (current_lanes-1))
+        {
+            territory.contested.set(current);
+            if (is_mine) territory.contested_mine_count++;
+        }
+        else
+        {
+            const int owner = __builtin_ctz(current_lanes);
+            territory.owned[owner].set(current);
+            if (is_mine) territory.mine_counts[owner]++;
+        }
+
+        // mines and taverns are reached but never walked through
+        if (next_arrival > 1 && !grid.passable.test(current)) continue;
+
+        for (int direction=NORTH; direction<=WEST; direction++)
+        {
+            const PositionIndex neighbor = grid.get_neighbor(current, static_cast<Direction>(direction));
+            const Tile tile = grid.get_tile(neighbor);
+            if (tile == UNKNOWN || tile == WOOD) continue;
+
+            if (arrivals[neighbor] < 0)
+            {
+                arrivals[neighbor] = next_arrival;
+                lanes[neighbor] = current_lanes;
+                queue[tail++] = neighbor;
+            }
+            else if (arrivals[neighbor] == next_arrival) lanes[neighbor] |= current_lanes;
+        }
+    }
+}
+
+void
+test_territory()
+{
+    std::cout << "Doing territory test...\n";
+
+    Rng rng(42);
+    UniformRng<int> uniform(rng, 5);
+
+    for (int size=10; size<=28; size+=6)
+    {
+        const Tiles tiles = make_benchmark_tiles(size);
+        const PTree root = make_initial_state_json(tiles, 1200);
+        const Tiles background_tiles = neutralize_tiles(tiles);
+        const HashedPair<Tiles> hashed_background_tiles(background_tiles);
+        const Grid grid(background_tiles);
+        State state(root, hashed_background_tiles, grid);
+
+        Territory territory;
+        Territory territory_prime;
+        Distances distances;
+        for (int move=0; move<200; move++)
+        {
+            state.update(static_cast<Direction>(uniform()));
+            if (move%20 != 0) continue;
+
+            // against one bfs per hero
+            fill_territory(grid, state.heroes, territory);
+            typedef boost::array<Distances, 4> HeroDistances;
+            HeroDistances bfs_distances;
+            for (int kk=0; kk<4; kk++)
+            {
+                fill_distances(grid, grid.get_index(state.heroes[kk].position), bfs_distances[kk]);
+                assert( territory.distances[kk] == bfs_distances[kk] );
+
+                int tavern_distance = -1;
+                for (int index=0; index<static_cast<int>(grid.cells.size()); index++)
+                    if (grid.taverns.test(index) && bfs_distances[kk][index] >= 0 && (tavern_distance < 0 || bfs_distances[kk][index] < tavern_distance))
+                        tavern_distance = bfs_distances[kk][index];
+                assert( territory.tavern_distances[kk] == tavern_distance );
+            }
+
+            Territory::HeroCounts mine_counts = {{0, 0, 0, 0}};
+            int contested_mine_count = 0;
+            for (int index=0; index<static_cast<int>(grid.cells.size()); index++)
+            {
+                int owner = Territory::no_owner;
+                Distance best = -1;
+                for (int kk=0; kk<4; kk++)
+                {
+                    const Distance distance = bfs_distances[kk][index];
+                    if (distance < 0) continue;
+                    if (best < 0 || distance < best) { best = distance; owner = kk; }
+                    else if (distance == best) owner = Territory::contested_owner;
+                }
+                assert( territory.get_owner(index) == owner );
+
+                if (!grid.mine_cells.test(index)) continue;
+                if (owner == Territory::contested_owner) contested_mine_count++;
+                else if (owner != Territory::no_owner) mine_counts[owner]++;
+            }
+            assert( territory.mine_counts == mine_counts );
+            assert( territory.contested_mine_count == contested_mine_count );
+
+            fill_territory(grid, state.heroes, territory_prime, false);
+            for (int kk=0; kk<4; kk++)
+                assert( territory_prime.owned[kk] == territory.owned[kk] );
+            assert( territory_prime.tavern_distances == territory.tavern_distances );
+        }
+
+        const int payload = 400000/size;
+        double deltas[3] = {0, 0, 0};
+        long int checksum = 0;
+        for (int pass=0; pass<3; pass++)
+        {
+            const double start_time = get_double_time();
+            for (int kk=0; kk<payload; kk++)
+            {
+                if (pass < 2)
+                {
+                    fill_territory(grid, state.heroes, territory, pass == 0);
+                    checksum += territory.mine_counts[kk%4];
+                    continue;
+                }
+                for (int ll=0; ll<4; ll++)
+                {
+                    fill_distances(grid, grid.get_index(state.heroes[ll].position), distances);
+                    checksum += distances[0];
+                }
+            }
+            const double end_time = get_double_time();
+            deltas[pass] = end_time-start_time;
+        }
+
+        std::cout << "territory " << size << "x" << size << " " << checksum%2;
+        std::cout << " distances " << 1e6*deltas[0]/payload << "us";
+        std::cout << " owners " << 1e6*deltas[1]/payload << "us";
+        std::cout << " 4 bfs " << 1e6*deltas[2]/payload << "us";
+        std::cout << " speedup " << deltas[2]/deltas[1] << std::endl;
+    }
+
+    std::cout << "...done!\n";
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "state.h"
+
+// Which hero reaches each cell first. The four heroes are expanded by a
+// single BFS where every cell carries a 4 bit lane mask of the heroes that
+// reach it first, so each cell is visited once however many heroes there are.
+// Like fill_distances, mines and taverns are reached but never walked
+// through, and other heroes are not obstacles.
+struct Territory
+{
+    typedef boost::array<Distances, 4> HeroDistances;
+    typedef boost::array<Bitboard, 4> HeroBitboards;
+    typedef boost::array<int, 4> HeroCounts;
+    typedef std::vector<uint8_t> Lanes;
+    typedef std::vector<PositionIndex> Indexes;
+
+    static const int no_owner = -1;
+    static const int contested_owner = 4;
+
+    Territory();
+
+    int
+    get_owner(const PositionIndex& index) const; // hero index, contested_owner or no_owner
+
+    HeroDistances distances; // arrival step of each hero, -1 when unreachable
+    HeroBitboards owned; // cells one hero reaches strictly first
+    Bitboard contested; // cells several heroes reach at the same step
+
+    HeroCounts mine_counts; // mines reached strictly first
+    int contested_mine_count;
+    HeroCounts tavern_distances; // nearest tavern, -1 when none is reachable, see Grid::tavern_distances
+
+    // scratch buffers kept between calls
+    Distances arrivals; // first arrival step of any hero
+    Lanes lanes; // heroes arriving at that step
+    Indexes queue;
+};
+
+/// Territory of heroes standing on grid. Per hero distances cost one more
+/// BFS per hero and are only filled when with_distances is set, the
+/// ownership and counts always are. Does not allocate once territory has
+/// been filled for this board size.
+void
+fill_territory(const Grid& grid, const State::Heroes& heroes, Territory& territory, const bool& with_distances=true);
+
+void
+test_territory();
+
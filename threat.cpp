@@ -0,0 +1,200 @@
+#include "threat.h"
+
+#include "network.h"
+#include <cassert>
+
+const int ThreatMap::damage;
+
+ThreatMap::ThreatMap(const Grid& grid) :
+    grid(grid),
+    positions(),
+    hit_turns(),
+    distances()
+{
+    for (int kk=0; kk<4; kk++)
+        hit_turns[kk].assign(grid.cells.size(), -1);
+}
+
+void
+ThreatMap::fill_hit_turns(const int& hero_index, const Position& position)
+{
+    fill_distances(grid, grid.get_index(position), distances);
+
+    Distances& turns = hit_turns[hero_index];
+    for (int index=0; index<static_cast<int>(grid.cells.size()); index++)
+    {
+        turns[index] = -1;
+        if (!grid.passable.test(index)) continue;
+
+        // closest cell the hero can stand on next to index
+        Distance best = -1;
+        for (int direction=NORTH; direction<=WEST; direction++)
+        {
+            const PositionIndex neighbor = grid.get_neighbor(index, static_cast<Direction>(direction));
+            const Distance distance = distances[neighbor];
+            if (distance < 0 || !grid.passable.test(neighbor)) continue;
+            if (best < 0 || distance < best) best = distance;
+        }
+
+        if (best >= 0) turns[index] = std::max(best, static_cast<Distance>(1)); // staying still also hits
+    }
+
+    positions[hero_index] = position;
+}
+
+int
+ThreatMap::update(const State::Heroes& heroes)
+{
+    int update_count = 0;
+    for (int kk=0; kk<4; kk++)
+    {
+        if (positions[kk] == heroes[kk].position) continue;
+        fill_hit_turns(kk, heroes[kk].position);
+        update_count++;
+    }
+    return update_count;
+}
+
+int
+ThreatMap::get_attacker_count(const int& hero_index, const PositionIndex& index, const int& turn_count) const
+{
+    int attacker_count = 0;
+    for (int kk=0; kk<4; kk++)
+    {
+        if (kk == hero_index) continue;
+        const int turns = hit_turns[kk][index];
+        if (turns >= 0 && turns <= turn_count) attacker_count++;
+    }
+    return attacker_count;
+}
+
+static
+int
+get_thirsty_life(const int& life, const int& turn_count)
+{
+    return life > 1 ? life - std::min(turn_count, life-1) : life;
+}
+
+int
+ThreatMap::get_worst_life(const State::Heroes& heroes, const int& hero_index, const PositionIndex& index, const int& turn_count) const
+{
+    return get_thirsty_life(heroes[hero_index].life, turn_count) - damage*get_attacker_count(hero_index, index, turn_count);
+}
+
+Bitboard
+ThreatMap::get_deadly_cells(const State::Heroes& heroes, const int& hero_index, const int& turn_count) const
+{
+    // number of hits the hero survives
+    const int life = get_thirsty_life(heroes[hero_index].life, turn_count);
+    const int lethal_count = (life+damage-1)/damage;
+
+    Bitboard deadly;
+    if (lethal_count > 3) return deadly;
+
+    for (int index=0; index<static_cast<int>(grid.cells.size()); index++)
+        if (grid.passable.test(index) && get_attacker_count(hero_index, index, turn_count) >= lethal_count)
+            deadly.set(index);
+
+    return deadly;
+}
+
+void
+test_threat()
+{
+    std::cout << "Doing threat map test...\n";
+
+    Rng rng(42);
+    UniformRng<int> uniform(rng, 5);
+
+    for (int size=10; size<=28; size+=6)
+    {
+        const Tiles tiles = make_benchmark_tiles(size);
+        const PTree root = make_initial_state_json(tiles, 1200);
+        const Tiles background_tiles = neutralize_tiles(tiles);
+        const HashedPair<Tiles> hashed_background_tiles(background_tiles);
+        const Grid grid(background_tiles);
+        State state(root, hashed_background_tiles, grid);
+
+        ThreatMap threats(grid);
+        assert( threats.update(state.heroes) == 4 );
+        assert( threats.update(state.heroes) == 0 );
+
+        for (int move=0; move<400; move++)
+        {
+            state.update(static_cast<Direction>(uniform()));
+            threats.update(state.heroes);
+            if (move%100 != 0) continue;
+
+            // incremental against fresh
+            ThreatMap fresh_threats(grid);
+            fresh_threats.update(state.heroes);
+            assert( fresh_threats.hit_turns == threats.hit_turns );
+
+            // against plain distances and next_to
+            for (int kk=0; kk<4; kk++)
+            {
+                Distances distances;
+                fill_distances(grid, grid.get_index(state.heroes[kk].position), distances);
+                for (int index=0; index<static_cast<int>(grid.cells.size()); index++)
+                {
+                    const Position position = grid.get_position(index);
+                    int expected = -1;
+                    if (grid.passable.test(index))
+                        for (int other=0; other<static_cast<int>(grid.cells.size()); other++)
+                        {
+                            if (!grid.passable.test(other) || distances[other] < 0) continue;
+                            if (other == index || !grid.get_position(other).next_to(position)) continue;
+                            const int turns = std::max(1, static_cast<int>(distances[other]));
+                            if (expected < 0 || turns < expected) expected = turns;
+                        }
+                    assert( threats.get_hit_turns(kk, index) == expected );
+                }
+
+                const Bitboard deadly = threats.get_deadly_cells(state.heroes, kk, 5);
+                for (int index=0; index<static_cast<int>(grid.cells.size()); index++)
+                    assert( deadly.test(index) == (grid.passable.test(index) && threats.get_worst_life(state.heroes, kk, index, 5) <= 0) );
+            }
+        }
+
+        // single hero moves against full recomputes
+        typedef std::vector<State> States;
+        States states;
+        for (int move=0; move<256; move++)
+        {
+            state.update(static_cast<Direction>(uniform()));
+            states.push_back(state);
+        }
+        threats.update(state.heroes);
+
+        const int payload = 40000/size;
+        double deltas[3] = {0, 0, 0};
+        int update_count = 0;
+        int deadly_count = 0;
+        for (int pass=0; pass<3; pass++)
+        {
+            ThreatMap threats_prime(grid);
+            const double start_time = get_double_time();
+            for (int kk=0; kk<payload; kk++)
+            {
+                const State& state_prime = states[kk%states.size()];
+                if (pass == 0) update_count += threats_prime.update(state_prime.heroes);
+                if (pass == 1)
+                {
+                    threats_prime.positions = ThreatMap::Positions(); // forget everything
+                    threats_prime.update(state_prime.heroes);
+                }
+                if (pass == 2) deadly_count += threats.get_deadly_cells(state.heroes, kk%4, 3).count();
+            }
+            const double end_time = get_double_time();
+            deltas[pass] = end_time-start_time;
+        }
+
+        std::cout << "threat " << size << "x" << size;
+        std::cout << " incremental " << 1e6*deltas[0]/payload << "us (" << static_cast<double>(update_count)/payload << " heroes)";
+        std::cout << " full " << 1e6*deltas[1]/payload << "us";
+        std::cout << " deadly " << 1e6*deltas[2]/payload << "us (" << deadly_count/payload << " cells)" << std::endl;
+    }
+
+    std::cout << "...done!\n";
+}
+
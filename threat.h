@@ -0,0 +1,58 @@
+#pragma once
+
+#include "state.h"
+
+// Where each hero can be hit in the coming turns. A hero moving next to
+// another deals it 20 damage, so an opponent threatens a cell as soon as it
+// can end a move on one of its neighbors. For every hero the map keeps the
+// number of its own moves before it can hit a hero standing on each cell,
+// and only recomputes it when that hero changed position.
+struct ThreatMap
+{
+    typedef boost::array<Distances, 4> HeroDistances;
+    typedef boost::array<Position, 4> Positions;
+
+    static const int damage = 20;
+
+    ThreatMap(const Grid& grid);
+
+    /// Refresh the heroes that moved since the last update, return how many.
+    int
+    update(const State::Heroes& heroes);
+
+    /// Moves hero_index needs before it can hit a hero standing on index,
+    /// counting the hitting move, -1 when it never can.
+    int
+    get_hit_turns(const int& hero_index, const PositionIndex& index) const
+    {
+        return hit_turns[hero_index][index];
+    }
+
+    /// Opponents of hero_index that can hit it on index within turn_count moves.
+    int
+    get_attacker_count(const int& hero_index, const PositionIndex& index, const int& turn_count) const;
+
+    /// Life of hero_index after turn_count of its own moves on index when every
+    /// opponent that can reach it hits once and it never drinks.
+    int
+    get_worst_life(const State::Heroes& heroes, const int& hero_index, const PositionIndex& index, const int& turn_count) const;
+
+    /// Walkable cells where hero_index can be killed within turn_count moves.
+    Bitboard
+    get_deadly_cells(const State::Heroes& heroes, const int& hero_index, const int& turn_count) const;
+
+    const Grid& grid;
+    Positions positions; // where each map was computed
+    HeroDistances hit_turns;
+
+private:
+
+    void
+    fill_hit_turns(const int& hero_index, const Position& position);
+
+    Distances distances; // scratch
+};
+
+void
+test_threat();
+
@@ -1,6 +1,9 @@
 #include "tiles.h"
 
+#include <algorithm>
 #include <cassert>
+#include <sstream>
+#include <stdexcept>
 #include <boost/functional/hash.hpp>
 
 Tiles
@@ -75,6 +78,63 @@ neutralize_tiles(const Tiles& tiles_orig)
     return tiles;
 }
 
+Tiles
+make_benchmark_tiles(const int& tiles_size)
+{
+    assert( tiles_size >= 4 );
+
+    Tiles tiles(boost::extents[tiles_size][tiles_size]);
+    for (int ii=0; ii<tiles_size; ii++)
+        for (int jj=0; jj<tiles_size; jj++)
+        {
+            Tile tile = EMPTY;
+            if (ii%4 == 2 && jj%4 == 2) tile = WOOD;
+            if (ii%4 == 0 && jj%4 == 2) tile = MINE;
+            tiles[ii][jj] = tile;
+        }
+
+    const int middle = tiles_size/2;
+    tiles[middle-1][middle-1] = TAVERN;
+    tiles[middle][middle] = TAVERN;
+
+    const int last = tiles_size-1;
+    tiles[0][0] = HERO1;
+    tiles[last][0] = HERO2;
+    tiles[last][last] = HERO3;
+    tiles[0][last] = HERO4;
+
+    return tiles;
+}
+
+// Board symmetric under the whole dihedral group: a quadrant pattern
+// symmetric about its diagonal, mirrored on both axes. The spawns go around
+// the corners like on the server maps.
+Tiles
+make_symmetric_benchmark_tiles(const int& tiles_size)
+{
+    Tiles tiles(boost::extents[tiles_size][tiles_size]);
+
+    const int last = tiles_size-1;
+    for (int ii=0; ii<tiles_size; ii++)
+        for (int jj=0; jj<tiles_size; jj++)
+        {
+            const int aa = std::min(ii, last-ii);
+            const int bb = std::min(jj, last-jj);
+            Tile tile = EMPTY;
+            if (aa%4 == 2 && bb%4 == 2) tile = WOOD;
+            if ((aa%4 == 0 && bb%4 == 2) || (aa%4 == 2 && bb%4 == 0)) tile = MINE;
+            if (aa == tiles_size/2-1 && bb == tiles_size/2-1) tile = TAVERN;
+            tiles[ii][jj] = tile;
+        }
+
+    tiles[0][0] = HERO1;
+    tiles[last][0] = HERO2;
+    tiles[last][last] = HERO3;
+    tiles[0][last] = HERO4;
+
+    return tiles;
+}
+
 OwnedMines
 extract_owned_mines(const Tiles& tiles)
 {
@@ -155,6 +215,52 @@ operator<<(std::ostream& os, const Tiles& tiles)
     return os;
 }
 
+Tiles
+read_tiles(std::istream& is)
+{
+    static const std::string border = "║";
+    static const std::string pretty_unknown = "··";
+
+    std::string tiles_string;
+    int tiles_size = 0;
+    std::string line;
+    while (std::getline(is, line))
+    {
+        if (line.compare(0, border.size(), border) != 0) continue; // top and bottom borders
+
+        // drop the colors and the side borders
+        std::string row;
+        for (size_t kk=0; kk<line.size(); kk++)
+        {
+            if (line[kk] != '\033') row += line[kk];
+            else while (kk<line.size() && line[kk] != 'm') kk++;
+        }
+        if (row.size() < 2*border.size() || row.compare(row.size()-border.size(), border.size(), border) != 0) throw std::runtime_error("bad board row");
+        row = row.substr(border.size(), row.size()-2*border.size());
+
+        for (size_t kk=0; kk<row.size(); kk+=2)
+        {
+            if (row.compare(kk, pretty_unknown.size(), pretty_unknown) == 0)
+            {
+                tiles_string += "??";
+                kk += pretty_unknown.size()-2;
+                continue;
+            }
+            tiles_string += row.substr(kk, 2);
+        }
+        tiles_size++;
+    }
+
+    if (tiles_size == 0 || static_cast<int>(tiles_string.size()) != 2*tiles_size*tiles_size) throw std::runtime_error("board is not square");
+
+    Tiles tiles(boost::extents[tiles_size][tiles_size]);
+    std::stringstream tiles_stream(tiles_string);
+    Tile* flat = tiles.data();
+    for (int kk=0; kk<tiles_size*tiles_size; kk++)
+        tiles_stream >> flat[kk];
+    return tiles;
+}
+
 static const std::string pretty_tile_names[13] = {
     "\033[37m··\033[0m",
     "  ", "##",
@@ -173,6 +279,102 @@ static const std::string tile_names[13] = {
     "$1", "$2", "$3", "$4"
 };
 
+Position
+transform_position(const Position& position, const Transform& transform, const int& size)
+{
+    const int last = size-1;
+    switch (transform)
+    {
+    case IDENTITY:
+        return position;
+    case ROTATE_90:
+        return Position(position.y, last-position.x);
+    case ROTATE_180:
+        return Position(last-position.x, last-position.y);
+    case ROTATE_270:
+        return Position(last-position.y, position.x);
+    case FLIP_ROWS:
+        return Position(last-position.x, position.y);
+    case FLIP_COLUMNS:
+        return Position(position.x, last-position.y);
+    case TRANSPOSE:
+        return Position(position.y, position.x);
+    case ANTI_TRANSPOSE:
+        return Position(last-position.y, last-position.x);
+    }
+    assert( false );
+    return position;
+}
+
+Direction
+transform_direction(const Direction& direction, const Transform& transform)
+{
+    // move from the center of a 3x3 board and see where the image lands
+    const Position center(1,1);
+    Position target(center);
+    target.with_direction(direction);
+    const Position image = transform_position(target, transform, 3);
+
+    for (int direction_prime=STAY; direction_prime<=WEST; direction_prime++)
+    {
+        Position candidate(center);
+        candidate.with_direction(static_cast<Direction>(direction_prime));
+        if (candidate == image) return static_cast<Direction>(direction_prime);
+    }
+    assert( false );
+    return STAY;
+}
+
+Transform
+invert_transform(const Transform& transform)
+{
+    if (transform == ROTATE_90) return ROTATE_270;
+    if (transform == ROTATE_270) return ROTATE_90;
+    return transform; // every other one is an involution
+}
+
+static
+Tile
+get_background_tile(const Tile& tile)
+{
+    if (tile == HERO1 || tile == HERO2 || tile == HERO3 || tile == HERO4) return EMPTY;
+    if (tile == MINE1 || tile == MINE2 || tile == MINE3 || tile == MINE4) return MINE;
+    return tile;
+}
+
+Transforms
+detect_symmetries(const Tiles& tiles)
+{
+    assert( tiles.shape()[0] == tiles.shape()[1] );
+    const int size = tiles.shape()[0];
+
+    Transforms transforms;
+    for (int transform=IDENTITY; transform<=ANTI_TRANSPOSE; transform++)
+    {
+        bool is_symmetry = true;
+        for (int ii=0; is_symmetry && ii<size; ii++)
+            for (int jj=0; is_symmetry && jj<size; jj++)
+            {
+                const Position image = transform_position(Position(ii,jj), static_cast<Transform>(transform), size);
+                is_symmetry = get_background_tile(tiles[ii][jj]) == get_background_tile(tiles[image.x][image.y]);
+            }
+        if (is_symmetry) transforms.push_back(static_cast<Transform>(transform));
+    }
+
+    assert( !transforms.empty() && transforms.front() == IDENTITY );
+    return transforms;
+}
+
+std::string
+serialize_tiles(const Tiles& tiles)
+{
+    std::string tiles_string;
+    const Tile* data = tiles.origin();
+    for (size_t kk=0, kk_max=tiles.num_elements(); kk<kk_max; kk++)
+        tiles_string += tile_names[static_cast<int>(data[kk])];
+    return tiles_string;
+}
+
 std::ostream&
 operator<<(std::ostream& os, const Tile& tile)
 {
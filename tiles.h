@@ -4,6 +4,7 @@
 #include "position.h"
 #include <boost/multi_array.hpp>
 #include <boost/array.hpp>
+#include <vector>
 
 enum Tile
 {
@@ -30,12 +31,52 @@ operator>>(std::istream& is, Tile& tile);
 
 typedef boost::multi_array<Tile, 2> Tiles;
 
+// Symmetries of a square board, x being the row and y the column.
+enum Transform
+{
+    IDENTITY,
+    ROTATE_90, // clockwise
+    ROTATE_180,
+    ROTATE_270,
+    FLIP_ROWS, // x -> size-1-x
+    FLIP_COLUMNS, // y -> size-1-y
+    TRANSPOSE,
+    ANTI_TRANSPOSE
+};
+
+typedef std::vector<Transform> Transforms;
+
+/// Image of position on a size x size board, also for the padding border.
+Position
+transform_position(const Position& position, const Transform& transform, const int& size);
+
+Direction
+transform_direction(const Direction& direction, const Transform& transform);
+
+Transform
+invert_transform(const Transform& transform);
+
+/// Transforms leaving tiles unchanged, IDENTITY first. Heroes are ignored
+/// and owned mines count as neutral, so the background is what matters.
+Transforms
+detect_symmetries(const Tiles& tiles);
+
 Tiles
 parse_tiles(const int& tiles_size, const std::string& tiles_string);
 
 Tiles
 neutralize_tiles(const Tiles& tiles);
 
+std::string
+serialize_tiles(const Tiles& tiles);
+
+Tiles
+make_benchmark_tiles(const int& tiles_size);
+
+/// Benchmark board with every symmetry of the square, see detect_symmetries.
+Tiles
+make_symmetric_benchmark_tiles(const int& tiles_size);
+
 Hash
 hash_value(const Tiles& tiles);
 
@@ -56,3 +97,8 @@ extract_owned_mines(const Tiles& tiles);
 std::ostream&
 operator<<(std::ostream& os, const Tiles& tiles);
 
+/// Board as printed by operator<<, which is how --collect-map saves maps.
+/// Throws std::runtime_error when it is not a square board.
+Tiles
+read_tiles(std::istream& is);
+
@@ -0,0 +1,161 @@
+#include "uct_bot.h"
+
+#include "logger.h"
+#include <boost/bind/bind.hpp>
+
+static
+OpeningBook*
+make_opening_book(const std::string& path, const Hash& map_hash, const SymmetryGroup& symmetries)
+{
+    // a bad book only costs the book moves, the game goes on
+    try
+    {
+        OpeningBook* book = new OpeningBook(path, map_hash, symmetries);
+        LogLine(LOG_INFO) << "opening book " << book->size() << " moves for this map";
+        return book;
+    }
+    catch (std::exception& ex)
+    {
+        LogLine(LOG_ERROR) << "can't load opening book: " << ex.what();
+        return NULL;
+    }
+}
+
+MapData::MapData(const Options& opt, const Game& game) :
+    symmetries(game.background_grid, game.state),
+    book_stage(),
+    pipeline()
+{
+    if (!opt.book.empty())
+        pipeline.start(book_stage, boost::bind(make_opening_book, opt.book, game.hashed_background_tiles.hash, boost::cref(symmetries)));
+}
+
+static
+MapData*
+make_map_data(const Options& opt, const Game& game)
+{
+    return new MapData(opt, game);
+}
+
+BotTables::BotTables(const Options& opt) :
+    endgame_table(),
+    trees(),
+    maps(8)
+{
+    const int thread_count = get_scheduler().get_worker_count();
+
+    // a quarter of the memory goes to the endgame table
+    size_t max_bytes = static_cast<size_t>(opt.search_memory)*1024*1024;
+    if (opt.endgame_turns > 0)
+    {
+        endgame_table.reset(new TranspositionTable(max_bytes/4));
+        max_bytes -= max_bytes/4;
+    }
+    max_bytes /= thread_count;
+
+    for (int kk=0; kk<thread_count; kk++)
+        trees.push_back(new SearchTree(max_bytes));
+}
+
+Bot::Bot(const Options& opt, const Game& game, Rng& rng, BotTables& tables) :
+    trees(tables.trees),
+    rngs(),
+    endgame_turns(opt.endgame_turns),
+    symmetries(game.background_grid, game.state, opt.canonical_keys),
+    endgame(tables.endgame_table ? new EndgameSolver(game.background_grid, symmetries, *tables.endgame_table) : NULL),
+    map_data(tables.maps.get(game.get_map_key(), boost::bind(make_map_data, boost::cref(opt), boost::cref(game)))),
+    rng(rng)
+{
+    // the next bot made from rng, next game or connection, searches other streams
+    const Rng bot_rng = rng.split();
+    for (int kk=0; kk<static_cast<int>(trees.size()); kk++)
+        rngs.push_back(bot_rng.get_stream(kk));
+}
+
+void
+Bot::search(const int& tree_index, const CancellationToken& token)
+{
+    trees[tree_index].run(token, rngs[tree_index]);
+}
+
+Direction
+Bot::get_move(const Game& game, const CancellationToken& token)
+{
+    const double start_time = get_double_time();
+    const int turns_left = game.turn_max - game.turn;
+
+    // exact answer in the last half turns, searched for half of the budget
+    if (endgame && turns_left <= endgame_turns)
+    {
+        CancellationToken endgame_token;
+        endgame_token.set_deadline(start_time + (token.get_deadline()-start_time)/2);
+        const EndgameResult result = endgame->solve(game.state, turns_left, endgame_token);
+        LogLine(LOG_INFO) << "endgame " << (result.proven ? "proven" : "unproven") << " score " << result.score << " " << endgame->node_count << " nodes " << endgame->bound_cut_count << " bound cuts " << clock_it(get_double_time()-start_time);
+        if (result.proven) return result.direction;
+    }
+
+    // a book move is played anyway, the search only ponders the next turns
+    const OpeningBook* book = map_data->book_stage.get();
+    Direction book_direction = STAY;
+    const bool is_book_move = book && book->lookup(game.state, book_direction);
+
+    // trees that followed the game keep the subtree of the new root
+    size_t kept_count = 0;
+    size_t dropped_count = 0;
+    int kept_playout_count = 0;
+    for (SearchTrees::iterator ti=trees.begin(), tie=trees.end(); ti!=tie; ti++)
+    {
+        if (!ti->has_root(game.state))
+        {
+            ti->reset(game.state, turns_left);
+            continue;
+        }
+        ti->compact();
+        kept_count += ti->kept_node_count;
+        dropped_count += ti->dropped_node_count;
+        kept_playout_count += ti->kept_playout_count;
+    }
+    const double compact_delta = get_double_time()-start_time;
+
+    get_scheduler().parallel_for(trees.size(), boost::bind(&Bot::search, this, boost::placeholders::_1, boost::cref(token)));
+
+    DirectionVisits visits;
+    std::fill(visits.begin(), visits.end(), 0);
+    int playout_count = 0;
+    int prune_count = 0;
+    size_t node_count = 0;
+    size_t reserved_bytes = 0;
+    for (SearchTrees::const_iterator ti=trees.begin(), tie=trees.end(); ti!=tie; ti++)
+    {
+        const DirectionVisits tree_visits = ti->get_root_visits();
+        for (int direction=0; direction<5; direction++)
+            visits[direction] += tree_visits[direction];
+        playout_count += ti->playout_count;
+        prune_count += ti->prune_count;
+        node_count += ti->get_node_count();
+        reserved_bytes += ti->get_reserved_bytes();
+    }
+
+    const Direction direction = static_cast<Direction>(std::max_element(visits.begin(), visits.end())-visits.begin());
+
+    const double reserved_mb = reserved_bytes/(1024.*1024.);
+    LogLine(LOG_INFO) << "reuse " << (kept_count+dropped_count ? 100.*kept_count/(kept_count+dropped_count) : 0) << "% nodes " << kept_playout_count << " playouts kept (+" << (playout_count ? 100.*kept_playout_count/playout_count : 0) << "% playouts) " << clock_it(compact_delta);
+    LogLine(LOG_INFO) << "search " << playout_count << " playouts " << node_count << " nodes " << prune_count << " prunes " << clock_it(get_double_time()-start_time);
+    LogLine(LOG_INFO) << "memory " << reserved_mb << "MB pool " << get_peak_rss()/(1024*1024) << "MB peak rss " << static_cast<int>(reserved_mb > 0 ? node_count/reserved_mb : 0) << " nodes/MB";
+
+    if (is_book_move)
+    {
+        LogLine(LOG_INFO) << "book direction " << book_direction << " search direction " << direction;
+        return book_direction;
+    }
+
+    return direction;
+}
+
+void
+Bot::advance_game(Game& game, const Direction& direction)
+{
+    for (SearchTrees::iterator ti=trees.begin(), tie=trees.end(); ti!=tie; ti++)
+        ti->advance_root(direction);
+}
+
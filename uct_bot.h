@@ -0,0 +1,67 @@
+#pragma once
+
+#include "game.h"
+#include "search_tree.h"
+#include "endgame.h"
+#include "book.h"
+#include "startup.h"
+#include <vector>
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/scoped_ptr.hpp>
+
+// Opening book of one map, read on a worker when the map first comes in.
+struct MapData
+{
+    MapData(const Options& opt, const Game& game);
+
+    const SymmetryGroup symmetries; // of the board and the spawns
+    StartupStage<OpeningBook> book_stage; // moves of this map, if any
+    StartupPipeline pipeline;
+};
+
+// Tables of --search-memory MB made once and kept across games: a quarter
+// for the endgame table, the rest for one search tree per worker. The trees
+// hold the last game searched and a bot keeps them when it follows it.
+struct BotTables
+{
+    typedef boost::ptr_vector<SearchTree> SearchTrees;
+
+    BotTables(const Options& opt);
+
+    boost::scoped_ptr<TranspositionTable> endgame_table; // only when endgame_turns > 0
+    SearchTrees trees;
+    MapTables<MapData> maps; // of the last 8 maps, more while played
+
+private:
+
+    BotTables(const BotTables& tables); // no copy
+};
+
+struct Bot
+{
+    Bot(const Options& opt, const Game& game, Rng& rng, BotTables& tables);
+
+    Direction
+    get_move(const Game& game, const CancellationToken& token); // token may be cut during the search
+
+    void
+    advance_game(Game& game, const Direction& direction);
+
+private:
+
+    typedef BotTables::SearchTrees SearchTrees;
+    typedef std::vector<Rng> Rngs;
+
+    void
+    search(const int& tree_index, const CancellationToken& token);
+
+    SearchTrees& trees; // of the bot tables, one per worker
+    Rngs rngs;
+    const int endgame_turns;
+    const SymmetryGroup symmetries; // of the endgame table, trivial unless --canonical-keys
+    boost::scoped_ptr<EndgameSolver> endgame; // only when endgame_turns > 0
+    const MapTables<MapData>::EntryPointer map_data;
+    Rng& rng;
+
+};
+
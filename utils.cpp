@@ -7,6 +7,91 @@
 #endif
 
 #include <algorithm> // for std::random_shuffle
+#include <vector>
+#include <cassert>
+#include <sys/resource.h>
+
+static
+uint64_t
+splitmix64(uint64_t& state)
+{
+    state += 0x9e3779b97f4a7c15ULL;
+    uint64_t mixed = state;
+    mixed = (mixed ^ (mixed >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    mixed = (mixed ^ (mixed >> 27)) * 0x94d049bb133111ebULL;
+    return mixed ^ (mixed >> 31);
+}
+
+StreamRng::StreamRng(const uint64_t& seed_value)
+{
+    seed(seed_value);
+}
+
+void
+StreamRng::seed(const uint64_t& seed_value)
+{
+    uint64_t seed_state = seed_value;
+    for (int kk=0; kk<4; kk++)
+        state[kk] = splitmix64(seed_state);
+}
+
+void
+StreamRng::jump()
+{
+    static const uint64_t jump_polynomial[4] = {
+        0x180ec6d33cfd0abaULL,
+        0xd5a61266f0c9392cULL,
+        0xa9582618e03fc9aaULL,
+        0x39abdc4529b1661cULL
+    };
+    jump(jump_polynomial);
+}
+
+void
+StreamRng::long_jump()
+{
+    static const uint64_t long_jump_polynomial[4] = {
+        0x76e15d3efefdcbbfULL,
+        0xc5004e441c522fb3ULL,
+        0x77710069854ee241ULL,
+        0x39109bb02acbe635ULL
+    };
+    jump(long_jump_polynomial);
+}
+
+void
+StreamRng::jump(const uint64_t* polynomial)
+{
+    boost::array<uint64_t, 4> jumped_state = {{0, 0, 0, 0}};
+    for (int kk=0; kk<4; kk++)
+        for (int bit=0; bit<64; bit++)
+        {
+            if (polynomial[kk] & (static_cast<uint64_t>(1) << bit))
+                for (int ll=0; ll<4; ll++)
+                    jumped_state[ll] ^= state[ll];
+            (*this)();
+        }
+
+    state = jumped_state;
+}
+
+StreamRng
+StreamRng::split()
+{
+    const StreamRng copy(*this);
+    long_jump();
+    return copy;
+}
+
+StreamRng
+StreamRng::get_stream(const int& stream_index) const
+{
+    assert( stream_index >= 0 );
+    StreamRng stream(*this);
+    for (int kk=0; kk<=stream_index; kk++)
+        stream.jump();
+    return stream;
+}
 
 std::ostream&
 operator<<(std::ostream& os, const Direction& direction)
@@ -46,40 +131,12 @@ operator<<(std::ostream& os, const clock_it& clock_it)
     return os << ms << "ms";
 }
 
-OmpFlag::OmpFlag(const bool& initial_state) :
-    state(initial_state)
-{
-}
-
-void
-OmpFlag::set()
-{
-//#if defined(OPENMP_FOUND)
-//    #pragma omp atomic write
-//#endif
-    state = true;
-}
-
-void
-OmpFlag::reset()
-{
-//#if defined(OPENMP_FOUND)
-//    #pragma omp atomic write
-//#endif
-    state = false;
-}
-
-bool
-OmpFlag::test() const
+size_t
+get_peak_rss()
 {
-//#if defined(OPENMP_FOUND)
-//    bool read_state;
-//    #pragma omp atomic read
-//    read_state = state;
-//    return read_state;
-//#else
-    return state;
-//#endif
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<size_t>(usage.ru_maxrss)*1024;
 }
 
 
@@ -174,7 +231,7 @@ test_random_throughtput()
 #endif
 
     { // boost::mt no parallel
-        Rng gen;
+        MtRng gen;
         gen.seed(rand());
 
         const double start_time = get_double_time();
@@ -189,11 +246,11 @@ test_random_throughtput()
 
 #if defined(OPENMP_FOUND)
     { // boost::mt parallel
-        Rng gen_common;
+        MtRng gen_common;
         gen_common.seed(rand());
 
         const double start_time = get_double_time();
-        Rng gen_thread;
+        MtRng gen_thread;
 #pragma omp parallel default(none) shared(gen_common, std::cout) private(gen_thread)
         {
 #pragma omp critical
@@ -214,6 +271,103 @@ test_random_throughtput()
     }
 #endif
 
+    { // stream no parallel
+        StreamRng gen(rand());
+
+        uint64_t sink = 0;
+        const double start_time = get_double_time();
+        for (int kk=0; kk<payload; kk++)
+        {
+            sink ^= gen();
+        }
+        const double end_time = get_double_time();
+
+        std::cout << "stream no parallel " << static_cast<int>(1e-3*payload/(end_time-start_time)) << "krand/s " << clock_it(end_time-start_time) << " " << (sink & 1) << std::endl;
+    }
+
+#if defined(OPENMP_FOUND)
+    { // stream parallel
+        const StreamRng gen_common(rand());
+
+        uint64_t sink = 0;
+        const double start_time = get_double_time();
+#pragma omp parallel default(none) shared(gen_common) reduction(^:sink)
+        {
+            StreamRng gen_thread = gen_common.get_stream(omp_get_thread_num());
+
+#pragma omp for schedule(static, 10000)
+            for (int kk=0; kk<payload; kk++)
+            {
+                sink ^= gen_thread();
+            }
+        }
+        const double end_time = get_double_time();
+
+        std::cout << "stream parallel " << static_cast<int>(1e-3*payload/(end_time-start_time)) << "krand/s " << clock_it(end_time-start_time) << " " << (sink & 1) << std::endl;
+    }
+#endif
+
+}
+
+static
+void
+test_random_streams()
+{
+    const StreamRng master(1234);
+
+    { // same seed same sequence
+        StreamRng gen_aa(1234);
+        StreamRng gen_bb(master);
+        for (int kk=0; kk<1000; kk++)
+            assert( gen_aa() == gen_bb() );
+    }
+
+    { // streams are distinct and reproducible
+        StreamRng stream_aa = master.get_stream(0);
+        StreamRng stream_bb = master.get_stream(1);
+        StreamRng stream_cc = master.get_stream(1);
+        StreamRng gen(master);
+        const uint64_t value_aa = stream_aa();
+        const uint64_t value_bb = stream_bb();
+        assert( value_aa != value_bb );
+        assert( value_aa != gen() );
+        assert( value_bb == stream_cc() );
+    }
+
+    { // consecutive splits, one per bot, hand out different streams
+        StreamRng gen(master);
+        const StreamRng block_aa = gen.split();
+        const StreamRng block_bb = gen.split();
+        assert( block_aa.get_stream(0)() == master.get_stream(0)() );
+        for (int kk=0; kk<4; kk++)
+            for (int ll=0; ll<4; ll++)
+            {
+                StreamRng stream_aa = block_aa.get_stream(kk);
+                StreamRng stream_bb = block_bb.get_stream(ll);
+                assert( stream_aa() != stream_bb() );
+            }
+    }
+
+    { // parallel draws do not depend on scheduling
+        typedef std::vector<uint64_t> Sums;
+        const int stream_count = 16;
+        Sums sums_aa(stream_count);
+        Sums sums_bb(stream_count);
+        for (int pass=0; pass<2; pass++)
+        {
+            Sums& sums = pass == 0 ? sums_aa : sums_bb;
+#pragma omp parallel for schedule(dynamic, 1)
+            for (int kk=0; kk<stream_count; kk++)
+            {
+                StreamRng stream = master.get_stream(kk);
+                uint64_t sum = 0;
+                for (int ll=0; ll<10000; ll++)
+                    sum = sum*31 + stream();
+                sums[kk] = sum;
+            }
+        }
+        assert( sums_aa == sums_bb );
+    }
 }
 
 void
@@ -229,6 +383,7 @@ test_random()
     std::cout << rand_aa << std::endl << rand_bb << std::endl << rand_cc << std::endl;
     std::cout << std::dec;
     assert( rand_aa == rand_bb );
+    test_random_streams();
     test_random_throughtput();
     std::cout << "...done!\n";
 }
@@ -3,10 +3,72 @@
 #include <iostream>
 #include <string>
 #include <sstream>
+#include <stdint.h>
+#include <boost/array.hpp>
 #include <boost/random/mersenne_twister.hpp>
 #include <boost/random/uniform_smallint.hpp>
 
-typedef boost::random::mt19937 Rng;
+// xoshiro256** generator. Streams are obtained by jumping 2^128 draws ahead,
+// so each thread gets an independent sequence fully determined by the seed.
+// Owners of several streams, such as bots, first split a block of 2^192
+// draws off so consecutive owners never share a stream.
+struct StreamRng
+{
+    typedef uint64_t result_type;
+
+    explicit StreamRng(const uint64_t& seed_value=0);
+
+    void
+    seed(const uint64_t& seed_value);
+
+    result_type
+    operator()()
+    {
+        const uint64_t result = rotate_left(state[1]*5, 7)*9;
+        const uint64_t shifted = state[1] << 17;
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= shifted;
+        state[3] = rotate_left(state[3], 45);
+        return result;
+    }
+
+    void
+    jump();
+
+    void
+    long_jump();
+
+    /// Copy of this generator, which then long jumps past the streams of the
+    /// copy, so the next split gets different ones.
+    StreamRng
+    split();
+
+    StreamRng
+    get_stream(const int& stream_index) const;
+
+    static result_type min() { return 0; }
+    static result_type max() { return ~static_cast<uint64_t>(0); }
+
+private:
+
+    void
+    jump(const uint64_t* polynomial);
+
+    static
+    uint64_t
+    rotate_left(const uint64_t& value, const int& shift)
+    {
+        return (value << shift) | (value >> (64-shift));
+    }
+
+    boost::array<uint64_t, 4> state;
+};
+
+typedef StreamRng Rng;
+typedef boost::random::mt19937 MtRng;
 
 void
 test_random();
@@ -93,23 +155,6 @@ struct clock_it
 std::ostream&
 operator<<(std::ostream& os, const clock_it& clock_it);
 
-/****************************************/
-
-struct OmpFlag
-{
-    OmpFlag(const bool& initial_state);
-
-    void
-    set();
-
-    void
-    reset();
-
-    bool
-    test() const;
-
-private:
-
-    bool state;
-};
+size_t
+get_peak_rss(); // in bytes
 